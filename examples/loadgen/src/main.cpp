@@ -0,0 +1,339 @@
+/**
+ * Load generator for the appenders.
+ * LOADGEN_TASKS tasks call Logger::logf(...) at the combined rate of LOADGEN_RATE messages per second, in bursts,
+ * with levels and sizes drawn from a seeded pseudo-random sequence, so that every run generates exactly the same messages.
+ * The probe appender, registered after the sinks, sees every message once the sinks are done with it
+ * and records the end-to-end latency from the logf() call.
+ * The results are printed to Serial as CSV, or JSON with LOADGEN_OUTPUT_JSON=1:
+ *  - number of generated and received messages per level, and the share of dropped ones
+ *  - latency histogram with 8 sub-buckets per power of 2 (within 12.5% of the true value), and percentiles
+ *  - bytes waiting in the queue and appenders, sampled every LOADGEN_SAMPLE_MS
+ * tools/hosttest/loadgen.sh runs the same generator on the host.
+ */
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <esp_timer.h>
+#include <atomic>
+
+#include <logging.hpp>
+#include <fs-appender.hpp>
+#include <udp-appender.hpp>
+
+using namespace esp32m;
+
+// comma-separated list of sinks: null, fs (FSAppender on SPIFFS), udp (UDPAppender), udp-binary (UDPAppender in the Binary mode)
+#ifndef LOADGEN_SINKS
+#define LOADGEN_SINKS "null"
+#endif
+#ifndef LOADGEN_TASKS
+#define LOADGEN_TASKS 4
+#endif
+// messages per second, all tasks together
+#ifndef LOADGEN_RATE
+#define LOADGEN_RATE 2000
+#endif
+#ifndef LOADGEN_DURATION_MS
+#define LOADGEN_DURATION_MS 10000
+#endif
+// queue size, 0 to dispatch messages right in the logging tasks
+#ifndef LOADGEN_QUEUE
+#define LOADGEN_QUEUE 4096
+#endif
+#ifndef LOADGEN_SEED
+#define LOADGEN_SEED 1
+#endif
+// number of messages in a burst is uniformly distributed between 1 and 2*LOADGEN_BURST-1
+#ifndef LOADGEN_BURST
+#define LOADGEN_BURST 8
+#endif
+// payload size is uniformly distributed between these
+#ifndef LOADGEN_SIZE_MIN
+#define LOADGEN_SIZE_MIN 16
+#endif
+#ifndef LOADGEN_SIZE_MAX
+#define LOADGEN_SIZE_MAX 128
+#endif
+// relative weights of error, warning, info and debug messages
+#ifndef LOADGEN_WEIGHTS
+#define LOADGEN_WEIGHTS 1, 4, 35, 60
+#endif
+#ifndef LOADGEN_SAMPLE_MS
+#define LOADGEN_SAMPLE_MS 100
+#endif
+#ifndef LOADGEN_OUTPUT_JSON
+#define LOADGEN_OUTPUT_JSON 0
+#endif
+#ifndef LOADGEN_UDP_HOST
+#define LOADGEN_UDP_HOST "192.168.1.1"
+#endif
+#ifndef LOADGEN_UDP_PORT
+#define LOADGEN_UDP_PORT 1234
+#endif
+#ifndef LOADGEN_WIFI_SSID
+#define LOADGEN_WIFI_SSID ""
+#endif
+#ifndef LOADGEN_WIFI_PASSWORD
+#define LOADGEN_WIFI_PASSWORD ""
+#endif
+
+const LogLevel Levels[] = {LogLevel::Error, LogLevel::Warning, LogLevel::Info, LogLevel::Debug};
+const char *LevelNames[] = {"error", "warning", "info", "debug"};
+const uint8_t Weights[] = {LOADGEN_WEIGHTS};
+const size_t Samples = LOADGEN_DURATION_MS / LOADGEN_SAMPLE_MS + 1;
+
+/**
+ * Log-linear histogram in the spirit of HdrHistogram: 8 linear sub-buckets in every power of 2
+ */
+class Histogram
+{
+public:
+  static const int SubBits = 3;
+  static const int Sub = 1 << SubBits;
+  static const int Buckets = (32 - SubBits + 1) * Sub;
+  void record(uint32_t value)
+  {
+    _counts[index(value)].fetch_add(1, std::memory_order_relaxed);
+    if (value > _max)
+      _max = value;
+  }
+  uint32_t count(int i) const { return _counts[i].load(std::memory_order_relaxed); }
+  uint32_t max() const { return _max; }
+  static uint32_t lower(int i)
+  {
+    if (i < Sub)
+      return i;
+    int m = i / Sub + SubBits - 1;
+    return (uint32_t)(Sub + i % Sub) << (m - SubBits);
+  }
+  uint32_t percentile(double p) const
+  {
+    uint64_t total = 0;
+    for (int i = 0; i < Buckets; i++)
+      total += count(i);
+    uint64_t rank = total * p / 100, seen = 0;
+    for (int i = 0; i < Buckets; i++)
+      if ((seen += count(i)) > rank)
+        return lower(i);
+    return _max;
+  }
+
+private:
+  std::atomic<uint32_t> _counts[Buckets] = {};
+  volatile uint32_t _max = 0;
+  static int index(uint32_t v)
+  {
+    if (v < Sub)
+      return v;
+    int m = 31 - __builtin_clz(v);
+    return (m - SubBits + 1) * Sub + ((v >> (m - SubBits)) & (Sub - 1));
+  }
+};
+
+struct Sample
+{
+  uint32_t ms;
+  uint32_t pending;
+  uint32_t generated;
+  uint32_t received;
+};
+
+Histogram latency;
+std::atomic<uint32_t> generated[4];
+std::atomic<uint32_t> received[4];
+Sample samples[Samples];
+size_t sampleCount = 0;
+char payload[LOADGEN_SIZE_MAX + 1];
+int64_t started;
+
+int levelIndex(LogLevel level)
+{
+  for (int i = 0; i < 4; i++)
+    if (Levels[i] == level)
+      return i;
+  return 3;
+}
+
+/**
+ * Receives every message after the sinks, the message starts with the time it was logged at
+ */
+class Probe : public LogAppender
+{
+protected:
+  bool append(const LogMessage *message)
+  {
+    if (!message || strncmp(message->name(), "load.", 5))
+      return true;
+    auto now = esp_timer_get_time();
+    auto sent = strtoll(message->message(), nullptr, 10);
+    latency.record(now - sent);
+    received[levelIndex(message->level())]++;
+    return true;
+  }
+};
+
+/**
+ * xorshift32, the same sequence for the same seed on every run
+ */
+uint32_t next(uint32_t &state)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+void generate(void *arg)
+{
+  auto index = (uint32_t)(uintptr_t)arg;
+  char name[16];
+  snprintf(name, sizeof(name), "load.%u", index);
+  SimpleLoggable loggable(name);
+  auto &logger = loggable.logger();
+  uint32_t state = LOADGEN_SEED * 2654435761u + index + 1;
+  uint32_t weights = 0;
+  for (auto w : Weights)
+    weights += w;
+  auto end = started + LOADGEN_DURATION_MS * 1000LL;
+  auto due = started;
+  while (esp_timer_get_time() < end)
+  {
+    auto burst = 1 + next(state) % (2 * LOADGEN_BURST - 1);
+    for (uint32_t i = 0; i < burst; i++)
+    {
+      auto w = next(state) % weights;
+      int l = 0;
+      while (w >= Weights[l])
+        w -= Weights[l++];
+      int size = LOADGEN_SIZE_MIN + next(state) % (LOADGEN_SIZE_MAX - LOADGEN_SIZE_MIN + 1);
+      logger.logf(Levels[l], "%lld %.*s", (long long)esp_timer_get_time(), size, payload);
+      generated[l]++;
+    }
+    // every task keeps its share of the rate on average, regardless of how long logging took
+    due += burst * 1000000LL * LOADGEN_TASKS / LOADGEN_RATE;
+    auto wait = (due - esp_timer_get_time()) / 1000;
+    if (wait > 0)
+      vTaskDelay(pdMS_TO_TICKS(wait));
+  }
+  vTaskDelete(nullptr);
+}
+
+uint32_t total(std::atomic<uint32_t> *counters)
+{
+  uint32_t result = 0;
+  for (int i = 0; i < 4; i++)
+    result += counters[i];
+  return result;
+}
+
+bool hasSink(const char *sink)
+{
+  const char *sinks = LOADGEN_SINKS;
+  auto len = strlen(sink);
+  for (auto p = sinks; (p = strstr(p, sink)); p += len)
+    if ((p == sinks || p[-1] == ',') && (!p[len] || p[len] == ','))
+      return true;
+  return false;
+}
+
+void report()
+{
+  const double Percentiles[] = {50, 90, 99, 99.9, 100};
+  auto g = total(generated), r = total(received);
+  auto dropped = g ? 100.0 * (g - r) / g : 0;
+#if LOADGEN_OUTPUT_JSON
+  Serial.printf("{\"sinks\":\"%s\",\"tasks\":%d,\"rate\":%d,\"duration_ms\":%d,\"queue\":%d,\"seed\":%d,", LOADGEN_SINKS, LOADGEN_TASKS, LOADGEN_RATE, LOADGEN_DURATION_MS, LOADGEN_QUEUE, LOADGEN_SEED);
+  Serial.printf("\"generated\":%u,\"received\":%u,\"dropped_pct\":%.3f,\"levels\":{", g, r, dropped);
+  for (int i = 0; i < 4; i++)
+    Serial.printf("%s\"%s\":[%u,%u]", i ? "," : "", LevelNames[i], (uint32_t)generated[i], (uint32_t)received[i]);
+  Serial.print("},\"latency_us\":{");
+  for (auto p : Percentiles)
+    Serial.printf("%s\"p%g\":%u", p == Percentiles[0] ? "" : ",", p, p < 100 ? latency.percentile(p) : latency.max());
+  Serial.print("},\"histogram\":[");
+  bool first = true;
+  for (int i = 0; i < Histogram::Buckets; i++)
+    if (latency.count(i))
+    {
+      Serial.printf("%s[%u,%u]", first ? "" : ",", Histogram::lower(i), latency.count(i));
+      first = false;
+    }
+  Serial.print("],\"occupancy\":[");
+  for (size_t i = 0; i < sampleCount; i++)
+    Serial.printf("%s[%u,%u,%u,%u]", i ? "," : "", samples[i].ms, samples[i].pending, samples[i].generated, samples[i].received);
+  Serial.println("]}");
+#else
+  Serial.println("# summary");
+  Serial.println("sinks,tasks,rate,duration_ms,queue,seed,generated,received,dropped_pct");
+  Serial.printf("%s,%d,%d,%d,%d,%d,%u,%u,%.3f\n", LOADGEN_SINKS, LOADGEN_TASKS, LOADGEN_RATE, LOADGEN_DURATION_MS, LOADGEN_QUEUE, LOADGEN_SEED, g, r, dropped);
+  Serial.println("# levels");
+  Serial.println("level,generated,received");
+  for (int i = 0; i < 4; i++)
+    Serial.printf("%s,%u,%u\n", LevelNames[i], (uint32_t)generated[i], (uint32_t)received[i]);
+  Serial.println("# latency_us");
+  Serial.println("percentile,value");
+  for (auto p : Percentiles)
+    Serial.printf("%g,%u\n", p, p < 100 ? latency.percentile(p) : latency.max());
+  Serial.println("# histogram");
+  Serial.println("lower_us,count");
+  for (int i = 0; i < Histogram::Buckets; i++)
+    if (latency.count(i))
+      Serial.printf("%u,%u\n", Histogram::lower(i), latency.count(i));
+  Serial.println("# occupancy");
+  Serial.println("ms,pending_bytes,generated,received");
+  for (size_t i = 0; i < sampleCount; i++)
+    Serial.printf("%u,%u,%u,%u\n", samples[i].ms, samples[i].pending, samples[i].generated, samples[i].received);
+#endif
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  if (hasSink("udp") || hasSink("udp-binary"))
+  {
+    WiFi.begin(LOADGEN_WIFI_SSID, LOADGEN_WIFI_PASSWORD);
+    for (int i = 0; i < 100 && !WiFi.isConnected(); i++)
+      delay(100);
+  }
+  if (hasSink("fs"))
+  {
+    SPIFFS.begin(true);
+    SPIFFS.remove("/load");
+    Logging::addAppender(new FSAppender(SPIFFS, "/load", 2, 65536));
+  }
+  if (hasSink("udp"))
+    Logging::addAppender(new UDPAppender(LOADGEN_UDP_HOST, LOADGEN_UDP_PORT));
+  if (hasSink("udp-binary"))
+  {
+    auto udp = new UDPAppender(LOADGEN_UDP_HOST, LOADGEN_UDP_PORT);
+    udp->setMode(UDPAppender::Binary);
+    Logging::addAppender(udp);
+  }
+  // the probe goes last, so that it sees the messages after the sinks have recorded them
+  Logging::addAppender(new Probe());
+  Logging::setLevel(LogLevel::Debug);
+  memset(payload, 'x', LOADGEN_SIZE_MAX);
+  if (LOADGEN_QUEUE)
+    Logging::useQueue(LOADGEN_QUEUE);
+  started = esp_timer_get_time();
+  for (uint32_t i = 0; i < LOADGEN_TASKS; i++)
+    xTaskCreate(generate, "loadgen", 4096, (void *)(uintptr_t)i, 1, nullptr);
+  while (sampleCount < Samples)
+  {
+    auto &s = samples[sampleCount++];
+    s.ms = (esp_timer_get_time() - started) / 1000;
+    s.pending = Logging::pending();
+    s.generated = total(generated);
+    s.received = total(received);
+    if (s.ms >= LOADGEN_DURATION_MS)
+      break;
+    delay(LOADGEN_SAMPLE_MS);
+  }
+  // whatever is still queued is counted as received once it gets through
+  Logging::flush(5000);
+  report();
+}
+
+void loop()
+{
+  delay(1000);
+}
@@ -19,6 +19,7 @@ namespace esp32m
 
   protected:
     virtual bool append(const char *message);
+    virtual bool append(const LogSegments &segments);
   };
 
 }
\ No newline at end of file
@@ -19,6 +19,7 @@ namespace esp32m
 
     protected:
         virtual bool append(const char *message);
+        virtual bool append(const LogSegments &segments);
         virtual bool shouldRotate(File &f) { return f.size() > _maxFileSizeBytes; }
 
     private:
@@ -30,6 +31,7 @@ namespace esp32m
         SemaphoreHandle_t _lock;
 
         String newFilename(uint8_t idx); // Max 512 files on disk
+        bool open();
     };
 
 } // namespace esp32m
\ No newline at end of file
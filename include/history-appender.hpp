@@ -0,0 +1,102 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "logging.hpp"
+
+#ifndef LOGGING_HISTORY_SHARDS
+#define LOGGING_HISTORY_SHARDS 16
+#endif
+
+namespace esp32m
+{
+
+    /**
+     * Keeps the most recent messages in a RAM ring, indexed by level and by logger, so that a filtered query
+     * like "the last 200 warnings from mqtt" touches only the matching records instead of the whole ring.
+     * Every record links back to the previous record of the same level, and to the previous record of the same logger shard
+     * (loggers are spread over @c LOGGING_HISTORY_SHARDS shards by the hash of the name). Appending updates the heads of both chains,
+     * evicting the oldest record only advances the sequence number below which the links are no longer followed,
+     * so both are O(1) and the index never has to be walked to remove stale entries.
+     * @code
+     * static HistoryAppender history(16384);
+     * Logging::addAppender(&history);
+     * ...
+     * history.replay(udp, LogLevel::Warning, "mqtt", 200);
+     * @endcode
+     */
+    class HistoryAppender : public LogAppender
+    {
+    public:
+        /**
+         * @brief Receives messages found by @c query(...)
+         * @return @c false to stop the query
+         */
+        typedef bool (*Visitor)(const LogMessage *message, void *arg);
+        /**
+         * @param size Size of the ring in bytes, each message takes its size plus a 24 bytes header
+         */
+        HistoryAppender(size_t size = 8192);
+        HistoryAppender(const HistoryAppender &) = delete;
+        ~HistoryAppender();
+        /**
+         * @brief Finds the most recent messages matching the filter, and passes them to @p visitor oldest first
+         * @note The ring is not locked while @p visitor runs, so it may log. Every message is passed as a copy,
+         *       and those evicted by the newer ones before their turn are skipped
+         * @param level Messages of this level and more severe ones are included
+         * @param name Name of the logger, or @c nullptr for all loggers
+         * @param max Maximum number of messages
+         * @return Number of messages passed to @p visitor
+         */
+        size_t query(LogLevel level, const char *name, size_t max, Visitor visitor, void *arg);
+        /**
+         * @brief Sends the most recent messages matching the filter to another appender, e.g. to the network when a client connects,
+         * see @c query(...) for the parameters
+         */
+        size_t replay(LogAppender &target, LogLevel level = LogLevel::Verbose, const char *name = nullptr, size_t max = 200);
+        /**
+         * @return Number of messages currently in the ring
+         */
+        size_t count() const { return _count; }
+
+    protected:
+        virtual bool append(const LogMessage *message);
+
+    private:
+        struct Link
+        {
+            uint32_t seq;
+            uint32_t offset;
+        };
+        struct Header
+        {
+            uint32_t seq;
+            uint16_t size;
+            uint8_t level;
+            uint8_t shard;
+            Link prevLevel;
+            Link prevShard;
+        };
+        SemaphoreHandle_t _lock;
+        uint8_t *_ring;
+        size_t _size;
+        size_t _head = 0;
+        size_t _tail = 0;
+        size_t _used = 0;
+        // where the records end before the ring wraps, the rest of the ring up to its size is unused
+        size_t _wrap;
+        size_t _count = 0;
+        uint32_t _seq = 0;
+        // records with lower sequence numbers have been evicted, links to them are dead
+        uint32_t _oldest = 1;
+        Link _levels[LogLevel::Verbose + 1] = {};
+        uint32_t _levelCounts[LogLevel::Verbose + 1] = {};
+        Link _shards[LOGGING_HISTORY_SHARDS] = {};
+        uint32_t _shardCounts[LOGGING_HISTORY_SHARDS] = {};
+        Header *at(uint32_t offset) const { return (Header *)(_ring + offset); }
+        bool alive(const Link &link) const { return link.seq >= _oldest; }
+        void evict();
+    };
+
+} // namespace esp32m
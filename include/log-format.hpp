@@ -0,0 +1,265 @@
+#pragma once
+
+#if __cplusplus < 201703L
+#error "log-format.hpp requires C++17, add -std=gnu++17 to build_flags and -std=gnu++11 to build_unflags"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+#include "logging.hpp"
+
+/**
+ * Space reserved on the stack for string arguments, longer messages are rendered on the heap
+ */
+#ifndef LOGGING_FMT_STRINGS_SIZE
+#define LOGGING_FMT_STRINGS_SIZE 64
+#endif
+
+/**
+ * @brief Format string for @c LogFormat, checked against the arguments at compile time.
+ * Every {} is replaced with the next argument, use {{ and }} for literal braces.
+ */
+#ifndef FMT
+#define FMT(format)                                                      \
+  ([] {                                                                  \
+    struct Format                                                        \
+    {                                                                    \
+      static constexpr const char *value() { return format; }            \
+    };                                                                   \
+    return Format{};                                                     \
+  }())
+#endif
+
+#define logFmtE(format, ...) esp32m::LogFormat::log(this->logger(), LogLevel::Error, FMT(format), ##__VA_ARGS__)
+#define logFmtW(format, ...) esp32m::LogFormat::log(this->logger(), LogLevel::Warning, FMT(format), ##__VA_ARGS__)
+#define logFmtI(format, ...) esp32m::LogFormat::log(this->logger(), LogLevel::Info, FMT(format), ##__VA_ARGS__)
+#define logFmtD(format, ...) esp32m::LogFormat::log(this->logger(), LogLevel::Debug, FMT(format), ##__VA_ARGS__)
+#define logFmtV(format, ...) esp32m::LogFormat::log(this->logger(), LogLevel::Verbose, FMT(format), ##__VA_ARGS__)
+
+namespace esp32m
+{
+  namespace logfmt
+  {
+    /**
+     * @brief Literal run of the format string, or an argument placeholder
+     */
+    struct Piece
+    {
+      uint16_t offset;
+      uint16_t length;
+      bool arg;
+    };
+
+    template <size_t N>
+    struct Pieces
+    {
+      Piece items[N ? N : 1];
+      size_t count;
+      size_t args;
+      size_t literal;
+      bool valid;
+    };
+
+    /**
+     * @brief Splits format string into pieces, only the first @p N pieces are stored.
+     * Called twice at compile time: to count the pieces, then to store them.
+     */
+    template <size_t N>
+    constexpr Pieces<N> parse(const char *s)
+    {
+      Pieces<N> result{};
+      result.valid = true;
+      size_t i = 0;
+      while (s[i])
+      {
+        Piece p{(uint16_t)i, 0, false};
+        if (s[i] == '{' && s[i + 1] == '}')
+        {
+          p.arg = true;
+          result.args++;
+          i += 2;
+        }
+        else if ((s[i] == '{' && s[i + 1] == '{') || (s[i] == '}' && s[i + 1] == '}'))
+        {
+          p.length = 1;
+          i += 2;
+        }
+        else if (s[i] == '{' || s[i] == '}')
+        {
+          result.valid = false;
+          i++;
+          continue;
+        }
+        else
+          while (s[i] && s[i] != '{' && s[i] != '}')
+          {
+            p.length++;
+            i++;
+          }
+        if (result.count < N)
+          result.items[result.count] = p;
+        result.count++;
+        result.literal += p.length;
+      }
+      return result;
+    }
+
+    /**
+     * @brief Type the argument is rendered as, string literals become const char *
+     */
+    template <typename T>
+    using Decayed = typename std::decay<const T>::type;
+
+    template <typename T>
+    constexpr bool isString() { return std::is_same<T, const char *>::value || std::is_same<T, char *>::value; }
+
+    template <typename>
+    constexpr bool unsupported() { return false; }
+
+    /**
+     * @brief Maximum rendered size of the argument, strings are measured at runtime
+     */
+    template <typename T>
+    constexpr size_t maxSize()
+    {
+      if constexpr (std::is_same<T, bool>::value)
+        return 5;
+      else if constexpr (std::is_same<T, char>::value)
+        return 1;
+      else if constexpr (std::is_integral<T>::value || std::is_enum<T>::value)
+        return 20;
+      else if constexpr (std::is_floating_point<T>::value)
+        return 24;
+      else if constexpr (isString<T>())
+        return 0;
+      else if constexpr (std::is_pointer<T>::value)
+        return 2 + 2 * sizeof(void *);
+      else
+      {
+        static_assert(unsupported<T>(), "unsupported log argument type");
+        return 0;
+      }
+    }
+
+    template <typename T>
+    size_t dynamicSize(const T &value)
+    {
+      if constexpr (isString<T>())
+        return value ? strlen(value) : 6;
+      else
+        return 0;
+    }
+
+    inline char *writeUnsigned(char *p, unsigned long long value, unsigned base = 10)
+    {
+      char tmp[20];
+      int n = 0;
+      do
+      {
+        tmp[n++] = "0123456789abcdef"[value % base];
+        value /= base;
+      } while (value);
+      while (n)
+        *p++ = tmp[--n];
+      return p;
+    }
+
+    template <typename T>
+    char *write(char *p, const T &value)
+    {
+      if constexpr (std::is_same<T, bool>::value)
+      {
+        auto s = value ? "true" : "false";
+        auto len = strlen(s);
+        memcpy(p, s, len);
+        return p + len;
+      }
+      else if constexpr (std::is_same<T, char>::value)
+      {
+        *p = value;
+        return p + 1;
+      }
+      else if constexpr (std::is_enum<T>::value)
+        return write(p, (typename std::underlying_type<T>::type)value);
+      else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value)
+      {
+        if (value < 0)
+        {
+          *p++ = '-';
+          return writeUnsigned(p, 0ULL - (unsigned long long)value);
+        }
+        return writeUnsigned(p, (unsigned long long)value);
+      }
+      else if constexpr (std::is_integral<T>::value)
+        return writeUnsigned(p, (unsigned long long)value);
+      else if constexpr (std::is_floating_point<T>::value)
+      {
+        auto len = snprintf(p, maxSize<T>() + 1, "%g", (double)value);
+        return p + (len < 0 ? 0 : (size_t)len > maxSize<T>() ? maxSize<T>() : len);
+      }
+      else if constexpr (isString<T>())
+      {
+        auto s = value ? value : "(null)";
+        auto len = strlen(s);
+        memcpy(p, s, len);
+        return p + len;
+      }
+      else
+      {
+        *p++ = '0';
+        *p++ = 'x';
+        return writeUnsigned(p, (uintptr_t)value, 16);
+      }
+    }
+  } // namespace logfmt
+
+  /**
+   * @brief Type-safe alternative to @c Logger::logf(...).
+   * The format string is parsed at compile time, the number of placeholders is checked against the number of arguments,
+   * and the message is rendered in a single pass into the stack buffer sized for the worst case of fixed-width arguments.
+   * @code
+   * LogFormat::log(logger(), LogLevel::Info, FMT("temp {} id {}"), 21.5f, 42);
+   * logFmtI("temp {} id {}", 21.5f, 42);
+   * @endcode
+   */
+  struct LogFormat
+  {
+    template <typename F, typename... Args>
+    static void log(Logger &logger, LogLevel level, F, const Args &... args)
+    {
+      constexpr auto counted = logfmt::parse<0>(F::value());
+      static_assert(counted.valid, "unmatched brace in the log format, use {{ and }} for literal braces");
+      static_assert(counted.args == sizeof...(Args), "number of {} placeholders doesn't match the number of arguments");
+      if (!logger.enabled(level) || !logger.admit(level, F::value()))
+        return;
+      constexpr auto pieces = logfmt::parse<counted.count>(F::value());
+      constexpr size_t fixed = counted.literal + (logfmt::maxSize<logfmt::Decayed<Args>>() + ... + 0);
+      constexpr bool strings = (logfmt::isString<logfmt::Decayed<Args>>() || ... || false);
+      char stack[fixed + (strings ? LOGGING_FMT_STRINGS_SIZE : 0) + 1];
+      auto size = fixed + (logfmt::dynamicSize<logfmt::Decayed<Args>>(args) + ... + 0);
+      auto buf = size < sizeof(stack) ? stack : (char *)malloc(size + 1);
+      if (!buf)
+        return;
+      auto s = F::value();
+      auto p = buf;
+      size_t i = 0;
+      auto literals = [&] {
+        for (; i < pieces.count && !pieces.items[i].arg; i++)
+        {
+          memcpy(p, s + pieces.items[i].offset, pieces.items[i].length);
+          p += pieces.items[i].length;
+        }
+      };
+      ((literals(), i++, p = logfmt::write<logfmt::Decayed<Args>>(p, args)), ...);
+      literals();
+      *p = '\0';
+      logger.dispatch(level, buf);
+      if (buf != stack)
+        free(buf);
+    }
+  };
+
+} // namespace esp32m
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace esp32m
+{
+  /**
+   * Binary export format of @c LogMessage, sent by @c UDPAppender in @c UDPAppender::Format::Binary mode
+   * and decoded on the host by tools/logdecode. Has no dependencies, so that the host side can include it as is.
+   *
+   * Every datagram carries one frame: @c FrameHeader followed by records, each starting with @c RecordHeader.
+   * Frames may also be concatenated into a stream (e.g. TCP or a capture file), @c FrameHeader::length delimits them.
+   * All integers are little-endian, records are not aligned.
+   *
+   * Logger and task names are not repeated in every message, they are replaced with IDs defined by @c NameRecord.
+   * The definition precedes the first message that uses the ID, and is sent again periodically,
+   * so that the receiver started later, or the one that lost the datagram with the definition, catches up.
+   * An ID may be redefined at any time, the latest definition applies to the following messages.
+   *
+   * Messages are numbered sequentially within the session, the receiver detects lost ones by the gaps in the sequence.
+   * Session ID is random on every boot, and resets the sequence and dictionary on the receiver.
+   */
+  namespace logwire
+  {
+    const uint16_t Magic = 0x574C; // "LW"
+    const uint8_t Version = 1;
+    /**
+     * @brief ID of the missing name, e.g. the task of the message logged from the interrupt handler
+     */
+    const uint16_t NoName = 0xFFFF;
+
+    struct FrameHeader
+    {
+      uint16_t magic;
+      uint8_t version;
+      uint8_t flags;
+      /**
+       * @brief Size of the frame including this header
+       */
+      uint16_t length;
+      /**
+       * @brief Number of message records in the frame
+       */
+      uint16_t count;
+      uint32_t session;
+      /**
+       * @brief Sequence number of the first message record in the frame, the following ones are numbered consecutively
+       */
+      uint32_t seq;
+    } __attribute__((packed));
+
+    enum RecordType : uint8_t
+    {
+      Message = 1,
+      Name = 2
+    };
+
+    struct RecordHeader
+    {
+      uint8_t type;
+      /**
+       * @brief Size of the record including this header, records of unknown types are skipped
+       */
+      uint16_t length;
+    } __attribute__((packed));
+
+    /**
+     * @brief Followed by the message text (not null-terminated) and the structured fields encoded as in @c LogRecord:
+     * [type][key length][key][string length, for strings only][value], see @c LogFieldType
+     */
+    struct MessageRecord
+    {
+      RecordHeader header;
+      /**
+       * @brief Raw time stamp, see @c LogMessage::stamp()
+       */
+      int64_t stamp;
+      uint32_t span;
+      uint16_t name;
+      uint16_t task;
+      uint8_t level;
+      uint8_t core;
+      uint16_t messageLength;
+    } __attribute__((packed));
+
+    /**
+     * @brief Followed by the name (not null-terminated)
+     */
+    struct NameRecord
+    {
+      RecordHeader header;
+      uint16_t id;
+    } __attribute__((packed));
+
+    /**
+     * @brief Types of the structured fields, same as @c LogFieldType
+     */
+    enum FieldType : uint8_t
+    {
+      Bool,
+      Int,
+      UInt,
+      Int64,
+      UInt64,
+      Float,
+      Double,
+      String
+    };
+
+  } // namespace logwire
+} // namespace esp32m
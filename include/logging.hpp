@@ -3,12 +3,49 @@
 #include <memory>
 #include <esp_log.h>
 
+#ifndef LOGGING_RECORD_FIELDS_SIZE
+#define LOGGING_RECORD_FIELDS_SIZE 96
+#endif
+
+#ifndef LOGGING_ISR_SLOTS
+#define LOGGING_ISR_SLOTS 32
+#endif
+#define LOGGING_ISR_ARGS 4
+
+#ifndef LOGGING_TASKS
+#define LOGGING_TASKS 32
+#endif
+
+#ifndef LOGGING_LEVEL_RULES
+#define LOGGING_LEVEL_RULES 16
+#endif
+
+#ifndef LOGGING_PROFILE
+#define LOGGING_PROFILE 0
+#endif
+
+#ifndef LOGGING_PANIC_HOOK
+#define LOGGING_PANIC_HOOK 0
+#endif
+#ifndef LOGGING_PANIC_MESSAGES
+#define LOGGING_PANIC_MESSAGES 200
+#endif
+#ifndef LOGGING_PROFILE_SITES
+#define LOGGING_PROFILE_SITES 64
+#endif
+
 #define logE(format, ...) this->logger().logf(LogLevel::Error, format, ##__VA_ARGS__)
 #define logW(format, ...) this->logger().logf(LogLevel::Warning, format, ##__VA_ARGS__)
 #define logI(format, ...) this->logger().logf(LogLevel::Info, format, ##__VA_ARGS__)
 #define logD(format, ...) this->logger().logf(LogLevel::Debug, format, ##__VA_ARGS__)
 #define logV(format, ...) this->logger().logf(LogLevel::Verbose, format, ##__VA_ARGS__)
 
+#define logIsrE(format, ...) this->logger().isr(LogLevel::Error, format, ##__VA_ARGS__)
+#define logIsrW(format, ...) this->logger().isr(LogLevel::Warning, format, ##__VA_ARGS__)
+#define logIsrI(format, ...) this->logger().isr(LogLevel::Info, format, ##__VA_ARGS__)
+#define logIsrD(format, ...) this->logger().isr(LogLevel::Debug, format, ##__VA_ARGS__)
+#define logIsrV(format, ...) this->logger().isr(LogLevel::Verbose, format, ##__VA_ARGS__)
+
 #if LOGGING_REDEFINE_LOG_X
 
 #undef log_e
@@ -76,12 +113,60 @@ namespace esp32m
     const char *_name;
   };
 
+  /**
+   * @brief Type of the structured field value
+   */
+  enum class LogFieldType : uint8_t
+  {
+    Bool,
+    Int,
+    UInt,
+    Int64,
+    UInt64,
+    Float,
+    Double,
+    String
+  };
+
+  /**
+   * @brief Decoded structured field of the log message, see @c LogMessage::field(...)
+   */
+  struct LogField
+  {
+    LogFieldType type;
+    /**
+     * @brief Key, not null-terminated
+     */
+    const char *key;
+    size_t keyLen;
+    /**
+     * @brief Raw little-endian value, or characters of the string (not null-terminated)
+     */
+    const uint8_t *value;
+    size_t valueLen;
+    int64_t asInt() const;
+    uint64_t asUInt() const;
+    double asDouble() const;
+  };
+
   /**
    * @brief Information about the log message
    */
   struct __attribute__((packed)) LogMessage
   {
   public:
+    /**
+     * @brief How structured fields are rendered by @c renderFields(...)
+     */
+    enum FieldsFormat
+    {
+      /** key=value pairs separated by spaces */
+      KeyValue,
+      /** Members of JSON object (without braces), "key":value pairs separated by commas */
+      Json,
+      /** Parameters of RFC5424 STRUCTURED-DATA element, key="value" pairs separated by spaces */
+      SyslogParams
+    };
     LogMessage(const LogMessage &) = delete;
     /**
      * @return Size of this struct in bytes
@@ -94,7 +179,7 @@ namespace esp32m
     /**
      * @return Size of the message including null terminator
      */
-    size_t message_size() const { return _size - sizeof(LogMessage); }
+    size_t message_size() const { return _size - sizeof(LogMessage) - _fieldsSize; }
     /**
      * @return Name of the logger emitted the message
      */
@@ -108,14 +193,135 @@ namespace esp32m
      *         If negative, this is the current date/time in millis (NOT IN SECONDS!) since 1970-1-1 00:00
      */
     int64_t stamp() const { return _stamp; }
+    /**
+     * @return Name of the task that emitted the message, or @c nullptr if it was emitted from the interrupt handler
+     *         or more than @c LOGGING_TASKS tasks have been logging
+     */
+    const char *task() const;
+    /**
+     * @return CPU core the message was emitted on
+     */
+    uint8_t core() const { return _core; }
+    /**
+     * @return ID of the trace span the message was emitted in, 0 if none, see @c LogSpan
+     */
+    uint32_t span() const { return _span; }
+    /**
+     * @return Encoded structured fields that follow the message, see @c LogRecord
+     */
+    const uint8_t *fields() const { return (const uint8_t *)message() + message_size(); }
+    /**
+     * @return Size of the encoded structured fields
+     */
+    size_t fields_size() const { return _fieldsSize; }
+    /**
+     * @brief Decodes structured field at the given offset
+     * @param offset Offset of the field, 0 for the first one. Advanced to the next field on success.
+     * @param field Decoded field
+     * @return @c false if there are no more fields
+     */
+    bool field(size_t &offset, LogField &field) const;
+    /**
+     * @brief Renders structured fields as text, with the same semantics as @c snprintf()
+     * @return Length of the rendered fields, excluding null terminator
+     */
+    size_t renderFields(char *buf, size_t size, FieldsFormat format) const;
+    /**
+     * @brief Renders task, core and span as text, in the same way as @c renderFields(...)
+     * @return Length of the rendered context, excluding null terminator
+     */
+    size_t renderContext(char *buf, size_t size, FieldsFormat format) const;
+    /**
+     * @brief Renders the whole message as a compact JSON object {"t":stamp,"l":"level","n":"name","m":"message","task":"name","core":0,"span":1,"f":{fields}},
+     * with the same semantics as @c snprintf()
+     * @return Length of the rendered object, excluding null terminator
+     */
+    size_t toJson(char *buf, size_t size) const;
 
   private:
     size_t _size;
     int64_t _stamp;
     const char *_name;
     uint8_t _level;
-    LogMessage(size_t size, LogLevel level, int64_t stamp, const char *name, const char *message, size_t messageLen);
-    static LogMessage *alloc(LogLevel level, int64_t stamp, const char *name, const char *message);
+    uint16_t _fieldsSize;
+    uint8_t _task;
+    uint8_t _core;
+    uint32_t _span;
+    LogMessage(size_t size, LogLevel level, int64_t stamp, const char *name, const char *message, size_t messageLen, const uint8_t *fields, size_t fieldsSize);
+    static LogMessage *alloc(LogLevel level, int64_t stamp, const char *name, const char *message, const uint8_t *fields = nullptr, size_t fieldsSize = 0);
+    friend class Logger;
+  };
+
+  /**
+   * @brief Trace span of the current task. Messages logged by the task while the span is alive carry its ID, see @c LogMessage::span().
+   * Spans may be nested, the previous span is restored when the inner one goes out of scope.
+   * @code
+   * LogSpan span; // new unique ID
+   * logI("handling request");
+   * @endcode
+   */
+  class LogSpan
+  {
+  public:
+    /**
+     * @brief Starts span with the new unique ID
+     */
+    LogSpan();
+    /**
+     * @brief Starts span with the given ID, e.g. received from the peer
+     */
+    explicit LogSpan(uint32_t id);
+    LogSpan(const LogSpan &) = delete;
+    ~LogSpan();
+    uint32_t id() const { return _id; }
+    /**
+     * @return ID of the current task's span, 0 if none
+     */
+    static uint32_t current();
+
+  private:
+    uint32_t _id;
+    uint32_t _prev;
+  };
+
+  /**
+   * @brief Structured log record being built, see @c Logger::info(...) and similar.
+   * Fields are encoded into a compact binary form as they are added, and the record is sent to the log when this object goes out of scope.
+   * If the level of the record is filtered out, adding fields costs nothing.
+   * @code
+   * logger().info("reading").kv("temp", 21.5f).kv("id", 42);
+   * @endcode
+   */
+  class LogRecord
+  {
+  public:
+    LogRecord(const LogRecord &) = delete;
+    LogRecord(LogRecord &&other);
+    ~LogRecord();
+    LogRecord &kv(const char *key, bool value) { return add(key, LogFieldType::Bool, &value, 1); }
+    LogRecord &kv(const char *key, int value) { return kv(key, (long long)value); }
+    LogRecord &kv(const char *key, unsigned int value) { return kv(key, (unsigned long long)value); }
+    LogRecord &kv(const char *key, long value) { return kv(key, (long long)value); }
+    LogRecord &kv(const char *key, unsigned long value) { return kv(key, (unsigned long long)value); }
+    LogRecord &kv(const char *key, long long value);
+    LogRecord &kv(const char *key, unsigned long long value);
+    LogRecord &kv(const char *key, float value) { return add(key, LogFieldType::Float, &value, sizeof(value)); }
+    LogRecord &kv(const char *key, double value) { return add(key, LogFieldType::Double, &value, sizeof(value)); }
+    LogRecord &kv(const char *key, const char *value);
+    /**
+     * @brief Appends field encoded in the same way to @p buf, if there's room for it, e.g. to build the fields of a message elsewhere
+     * @param used Number of bytes already used in @p buf, advanced by the size of the field
+     */
+    static bool encode(uint8_t *buf, size_t capacity, size_t &used, const char *key, LogFieldType type, const void *value, size_t size);
+
+  private:
+    Logger *_logger;
+    const char *_msg;
+    LogLevel _level;
+    size_t _size = 0;
+    uint8_t _fields[LOGGING_RECORD_FIELDS_SIZE];
+    LogRecord(Logger *logger, LogLevel level, const char *msg) : _logger(logger), _msg(msg), _level(level) {}
+    LogRecord &add(const char *key, LogFieldType type, const void *value, size_t size);
     friend class Logger;
   };
 
@@ -128,6 +334,7 @@ namespace esp32m
   {
   public:
     Logger(const Logger &) = delete;
+    ~Logger();
     /**
      * @brief Level of this logger.
      * Log messages with level greater than this one will be dropped
@@ -136,9 +343,13 @@ namespace esp32m
     /**
      * @brief Set level for this logger.
      * Log messages with level greater than this one will be dropped
-     * @param level New log level
+     * @param level New log level, or @c LogLevel::Default to follow the rules set by @c Logging::setLevel(...)
      */
-    void setLevel(LogLevel level) { _level = level; }
+    void setLevel(LogLevel level)
+    {
+      _level = level;
+      _generation = 0;
+    }
     /**
      * @brief Send message to the log
      * @param level If greater than this logger's level, the message will be dropped
@@ -158,19 +369,158 @@ namespace esp32m
      * @param msg Message to be recorded
      */
     void logf(LogLevel level, const char *format, ...);
+    /**
+     * @brief Start structured log record, see @c LogRecord
+     * @param level If greater than this logger's level, the record will be dropped
+     * @param msg Message to be recorded, must stay valid until the record is sent
+     */
+    LogRecord record(LogLevel level, const char *msg) { return LogRecord(enabled(level) ? this : nullptr, level, msg); }
+    LogRecord error(const char *msg) { return record(LogLevel::Error, msg); }
+    LogRecord warning(const char *msg) { return record(LogLevel::Warning, msg); }
+    LogRecord info(const char *msg) { return record(LogLevel::Info, msg); }
+    LogRecord debug(const char *msg) { return record(LogLevel::Debug, msg); }
+    LogRecord verbose(const char *msg) { return record(LogLevel::Verbose, msg); }
+    /**
+     * @brief Record message from the interrupt handler.
+     * Nothing is formatted or allocated here: format pointer, arguments and timestamp are copied to one of @c LOGGING_ISR_SLOTS
+     * preallocated slots, and the message is formatted later by the queue task, or by the next regular log call if there's no queue.
+     * If all slots are taken, the message is dropped and counted.
+     * @note The logger must be created outside of the interrupt handler, i.e. call @c logger() at least once before enabling the interrupt.
+     * @param level If greater than this logger's level, the message will be dropped
+     * @param format Format string, must be a literal or otherwise stay valid until the message is formatted
+     * @param args Up to @c LOGGING_ISR_ARGS integer arguments, each converted to 32 bits
+     */
+    template <typename... Args>
+    void isr(LogLevel level, const char *format, Args... args)
+    {
+      static_assert(sizeof...(Args) <= LOGGING_ISR_ARGS, "too many arguments for the ISR log record");
+      const uint32_t values[] = {0, (uint32_t)(uintptr_t)args...};
+      isrEnqueue(level, format, values + 1, sizeof...(Args));
+    }
 
   private:
     const Loggable &_loggable;
     LogLevel _level = LogLevel::Default;
+    // effective level is cached until the level rules change, see Logging::_levelsGeneration
+    mutable LogLevel _effectiveLevel = LogLevel::None;
+    mutable uint32_t _generation = 0;
+    uint32_t _repeatHash = 0;
+    uint32_t _repeatStarted = 0;
+    uint16_t _repeatCount = 0;
+    uint8_t _repeatLevel = LogLevel::None;
     Logger(const Loggable &loggable) : _loggable(loggable) {}
+    bool enabled(LogLevel level) const;
+    void refreshLevel() const;
+    bool admit(LogLevel level, const void *site);
+    /**
+     * @param site Call site for @c admit(...), the format itself unless it's a copy in a temporary buffer
+     * @param label Name of the call site in the profile, see @c Logging::dumpProfile(...), must be a literal
+     */
+    void vlogf(LogLevel level, const char *format, va_list arg, const void *site, const char *label);
+    void dispatch(LogLevel level, const char *msg, const uint8_t *fields = nullptr, size_t fieldsSize = 0);
+    void send(LogLevel level, const char *msg, const uint8_t *fields = nullptr, size_t fieldsSize = 0);
+    void isrEnqueue(LogLevel level, const char *format, const uint32_t *args, size_t count);
+    static bool expandIsr();
+    /**
+     * @brief Makes sure pending summaries are emitted after their window closes, even if the logger stays quiet
+     */
+    static void armSummaries();
+    /**
+     * @brief Emits the repeat and rate limit summaries whose window has closed
+     * @return @c true if some summaries are still waiting for their window to close
+     */
+    static bool expireSummaries();
     friend class Loggable;
+    friend class LogRecord;
+    friend class LogQueue;
+    friend class Logging;
+    friend class Metrics;
+    friend struct LogFormat;
+    friend class Esp32Hook;
   };
 
   /**
    * @brief Function that transforms log message struct to readable string
+   * The string must be allocated with @c logAlloc() or @c malloc(), the caller releases it with @c logFree()
    */
   typedef char *(*LogMessageFormatter)(const LogMessage *);
 
+  /**
+   * @brief Usage of a size class of the log buffer pool, see @c Logging::usePool(...)
+   */
+  struct LogPoolStats
+  {
+    size_t blockSize;
+    size_t blocks;
+    size_t used;
+    size_t peak;
+    /** Allocations of this size that went to the heap because the pool was exhausted */
+    size_t fallbacks;
+  };
+
+  /**
+   * @brief Allocates buffer for log message or formatted string from the pool installed by @c Logging::usePool(...).
+   * Falls back to the heap if there's no pool, the pool is exhausted or the size is too large.
+   */
+  void *logAlloc(size_t size);
+
+  /**
+   * @brief Releases buffer allocated by @c logAlloc() or @c malloc()
+   */
+  void logFree(void *ptr);
+
+  /**
+   * @brief Contiguous part of the rendered message, see @c LogSegments
+   */
+  struct LogSegment
+  {
+    const char *data;
+    size_t len;
+  };
+
+  /**
+   * @brief Message rendered by the default formatter as a few segments instead of one string: time stamp and level, logger name,
+   * separator, message text and the rendered fields with the context. Text and name are not copied, the segments point into
+   * the @c LogMessage, so they stay valid only as long as it does. Sinks capable of gather output (@c sendmsg, chunked writes)
+   * send the segments as they are, the rest get them joined into one string, see @c FormattingAppender::append(const LogSegments &).
+   * The date and time part of the time stamp is cached, and is only formatted again when the second changes.
+   */
+  class LogSegments
+  {
+  public:
+    static const size_t MaxCount = 5;
+    LogSegments() {}
+    LogSegments(const LogSegments &) = delete;
+    ~LogSegments();
+    /**
+     * @brief Renders the message in the same way as the default formatter, without the trailing newline
+     * @return @c false if there's no message, or no memory for the rendered fields
+     */
+    bool render(const LogMessage *message);
+    const LogSegment *segments() const { return _segments; }
+    size_t count() const { return _count; }
+    /**
+     * @return Total length of the segments
+     */
+    size_t length() const;
+    /**
+     * @return Segments joined into null-terminated string allocated with @c logAlloc(), the caller releases it with @c logFree()
+     */
+    char *join() const;
+    /**
+     * @return @c true if messages rendered by @p formatter may be rendered as segments instead, i.e. it's the default one
+     */
+    static bool supports(LogMessageFormatter formatter);
+
+  private:
+    LogSegment _segments[MaxCount];
+    size_t _count = 0;
+    char _prefix[48];
+    char _suffix[64];
+    char *_heap = nullptr;
+    void add(const char *data, size_t len);
+  };
+
   /**
    * @brief Base abstract class for log appenders
    * Log messages may be sent to multiple appenders (e.g. UART, filesystem, network etc.)
@@ -190,14 +540,19 @@ namespace esp32m
      * @return @c true on success, @c false on failure
      */
     virtual bool append(const LogMessage *message) = 0;
+    /**
+     * @brief Appenders that keep messages in their own buffers should override this to report how much is still waiting to be recorded
+     * @note May be called from any task concurrently with @c append(...), an approximate value is fine
+     * @return Number of bytes accepted but not yet recorded
+     */
+    virtual size_t pending() { return 0; }
 
   private:
-    LogAppender *_prev = nullptr;
-    LogAppender *_next = nullptr;
     friend class Logger;
     friend class Logging;
     friend class BufferedAppender;
     friend class LogQueue;
+    friend class HistoryAppender;
   };
 
   /**
@@ -222,6 +577,18 @@ namespace esp32m
      */
     virtual bool append(const char *message) = 0;
 
+    /**
+     * @brief Receives the message rendered as segments when the default formatter is in effect.
+     * Sinks that can write the segments without joining them should override this, by default they are joined and passed to @c append(const char *)
+     */
+    virtual bool append(const LogSegments &segments);
+
+  protected:
+    /**
+     * @brief Formatter function used by this appender
+     */
+    LogMessageFormatter formatter() const { return _formatter; }
+
   private:
     LogMessageFormatter _formatter;
   };
@@ -237,6 +604,7 @@ namespace esp32m
     /**
      * @brief Adds appender to the logging subsystem.
      * All log messages passing the level check will be sent to this appender
+     * @note May be called at any time while other tasks are logging, but not from within @c LogAppender::append(...)
      * @param a Appender to be added
      */
     static void addAppender(LogAppender *a);
@@ -259,7 +627,8 @@ namespace esp32m
 
     /**
      * @brief Removes appender from the logging subsystem.
-     * Log messages will no longer be sent to this appender
+     * Log messages will no longer be sent to this appender. Returns once no other task may be sending messages to it.
+     * @note Must not be called from within @c LogAppender::append(...)
      * @param a Appender to be removed
      */
     static void removeAppender(LogAppender *a);
@@ -283,7 +652,55 @@ namespace esp32m
     /**
      * @brief Set global log level
      */
-    static void setLevel(LogLevel level) { _level = level; }
+    static void setLevel(LogLevel level);
+
+    /**
+     * @brief Set level of the loggers with matching names, unless they have their own level set by @c Logger::setLevel(...)
+     * Dotted names form a hierarchy, the most specific matching rule wins. Loggers pick the change up on their next message.
+     * @param pattern Logger name, or prefix followed by ".*" to match the logger and its descendants
+     *                (e.g. "wifi.*" matches "wifi" and "wifi.sta"), or "*" to set the global level
+     * @param level New log level, or @c LogLevel::Default to remove the rule
+     * @return @c false if all @c LOGGING_LEVEL_RULES rules are taken
+     */
+    static bool setLevel(const char *pattern, LogLevel level);
+
+    /**
+     * @brief Replace all level rules with the comma-separated list of pattern=level pairs, e.g. "wifi.*=debug,mqtt=info,*=warning"
+     * Levels are none, error, warning, info, debug, verbose or their first letters, case-insensitive.
+     * @return @c false if the list is malformed, has more than @c LOGGING_LEVEL_RULES patterns, or there's not enough memory,
+     *         in which case the rules are left intact
+     */
+    static bool configureLevels(const char *config);
+
+    /**
+     * @brief Limits the rate of messages coming from the same call site (logger and format string).
+     * Every call site owns a token bucket that holds up to @p burst tokens and is refilled at @p perSecond tokens per second.
+     * Messages logged with @c Logger::log(...), whose text is usually rendered in a buffer shared by unrelated messages, are told apart by the text.
+     * Messages arriving when the bucket is empty are dropped before they are formatted, and the number of dropped messages
+     * is reported as soon as the site is allowed to log again, whether it logs or not. Errors are never rate-limited.
+     * @param burst Maximum number of messages that may be logged in a row, 0 disables rate limiting
+     * @param perSecond Sustained number of messages per second
+     */
+    static void setRateLimit(uint16_t burst, uint16_t perSecond = 1);
+
+    /**
+     * @brief Collapses identical consecutive messages of the same logger into a single "last message repeated N times" line.
+     * The summary is emitted when a different message arrives, or within 100ms after the window has closed.
+     * Without the queue, summaries of the loggers that went quiet are passed to the appenders from the @c esp_timer task.
+     * @param windowMs Length of the suppression window in ms, 0 disables suppression
+     */
+    static void setRepeatWindow(uint32_t windowMs) { _repeatWindow = windowMs; }
+
+    /**
+     * @brief Lowers verbosity automatically while the log pipeline is saturated.
+     * The pressure is measured as the occupancy of the queue and the share of messages the appenders (or the queue) failed to accept.
+     * When either of them reaches 50%, the effective level of every logger is lowered by one step (e.g. Debug to Info) every 100ms,
+     * up to @p maxSteps steps. Once both stay below 20% for 2 seconds, the level is restored by one step, and so on.
+     * Suppressed messages are dropped before they are formatted. Errors are never suppressed.
+     * A warning is logged when the throttling starts, and a notice with the number of suppressed messages when it ends.
+     * @param maxSteps Maximum number of steps the level may be lowered by, 0 disables backpressure
+     */
+    static void setBackpressure(uint8_t maxSteps = 2);
 
     /**
      * @brief Defines how the messages are being forwarded to appenders.
@@ -292,7 +709,13 @@ namespace esp32m
      * In the former case, logging may cause unwanted delays for time-critical operations, in the latter case additional synchronization may be required in the appender.
      * To work around these issues, a queue may be installed as an intemediate layer between the loggers and appenders. The messages are then collected in the queue, 
      * and processed sequentially in the dedicated thread, ensuring thread safety and no delay side-effects.
-     * @param size Size of the queue. If set to 0, the queue will be removed.
+     * @param size Size of the queue. If set to 0, the queue will be removed: the messages left in the queue are dispatched before the queue task exits.
+     *             If that takes more than a second, e.g. because an appender is stuck, the remaining messages are discarded,
+     *             but the call still waits for the appender to return.
+     *             The memory is split between severity lanes and CPU cores: every core gets 3/8 of the size for errors and warnings, 3/8 for info
+     *             and 1/4 for debug and verbose messages. A message larger than its lane's share (at the default size on dual-core chips,
+     *             about 150 bytes of text for errors and info, and 90 bytes for debug) is not queued, but passed to the appenders right away
+     *             by the logging task, so it may be recorded ahead of the messages still in the queue.
      * @param autoFlushPeriod Period in ms, to try to flush the BufferedAppender automatically.
      *                        @c 0 = No flush period, normal behavior = Will try to flush on new entry.
      *                        @c number_of_ms = Every period, the queue will loop on all appenders, and call @c append(nullptr), in order to force BufferedAppender to flush their buffer.
@@ -300,6 +723,68 @@ namespace esp32m
      */
     static void useQueue(int size = 1024, uint32_t autoFlushPeriod = 0);
 
+    /**
+     * @brief Waits until the queue is empty and all appenders have recorded their buffered messages.
+     * Call this before @c esp_deep_sleep_start(), OTA reboot and similar to make sure the last messages are not lost.
+     * @param timeoutMs Maximum time to wait
+     * @return Number of bytes still pending when the timeout expired, 0 if everything has been recorded
+     */
+    static size_t flush(uint32_t timeoutMs = 1000);
+
+    /**
+     * @brief Non-blocking variant of @c flush(...): nudges buffering appenders to record what they can and returns immediately
+     * @return Number of bytes still waiting in the queue and in the appenders' buffers
+     */
+    static size_t pending();
+
+    /**
+     * @brief Reserves memory for log messages and formatted strings, so that logging doesn't fragment the heap over time.
+     * The memory is split between pools of 64, 128, 256 and 512 byte blocks, allocated and released without locks.
+     * Larger buffers, and buffers that don't fit in the exhausted pool, are still taken from the heap.
+     * The pools are installed once and never released.
+     * @param footprint Total size of the pools
+     * @return @c false if the pools are already installed, or there's not enough memory
+     */
+    static bool usePool(size_t footprint = 8192);
+
+    /**
+     * @brief Usage statistics of the pools installed by @c usePool(...)
+     * @param stats Array to be filled with statistics of each size class, smallest first
+     * @param count Size of the @p stats array
+     * @return Number of size classes, 0 if the pools are not installed
+     */
+    static size_t poolStats(LogPoolStats *stats, size_t count);
+
+#if LOGGING_PROFILE
+    /**
+     * @brief Logs the @p topN call sites that spent the most CPU cycles formatting and dispatching messages, then resets the counters.
+     * Call sites are identified by their format strings, up to @c LOGGING_PROFILE_SITES of them are tracked.
+     * Messages logged with @c Logger::log(...) are reported together as "log()", and ESP-IDF messages as "esp-idf".
+     * Available when built with @c LOGGING_PROFILE=1
+     * @param topN Number of call sites to report
+     */
+    static void dumpProfile(size_t topN = 10);
+#endif
+
+    /**
+     * @brief Writes the messages that are still waiting in the buffers of the appenders added with @c addBufferedAppender(...)
+     * and in the queue to UART, and to the partition set by @c usePanicPartition(...). The buffered messages go first, they are older.
+     * Takes no locks and allocates no memory, so that it can be called from the panic handler. The messages are not consumed.
+     * When built with @c LOGGING_PANIC_HOOK=1 and linked with @c -Wl,--wrap=esp_panic_handler, it's called on every panic and abort().
+     * @note When the panic partition is used, the flash is written without the OS, the way the core dump does it,
+     * so it must only be called from the panic handler. Only the sectors taken by the dump are erased.
+     * @param maxMessages Only this many most recent messages are written from the queue, and from the buffer of every buffered appender
+     * @return Number of messages written
+     */
+    static size_t dumpPending(size_t maxMessages = LOGGING_PANIC_MESSAGES);
+
+    /**
+     * @brief Makes @c dumpPending(...) save the messages to the data partition with the given label, so that they survive the reset.
+     * Messages saved before the last reset are logged as warnings by this call, so add the appenders first.
+     * @return @c false if there's no such partition
+     */
+    static bool usePanicPartition(const char *label);
+
     /**
      * @brief Hooks ESP32-specific logging mechanism, see @c esp_log_set_vprintf() in the esp-idf docs for details
      * @param install Install or remove the hook to interecept log messages
@@ -315,6 +800,15 @@ namespace esp32m
   private:
     static LogMessageFormatter _formatter;
     static LogLevel _level;
+    static volatile uint32_t _levelsGeneration;
+    /**
+     * @brief Makes all loggers re-evaluate their effective level, @c _loggingLock must be held
+     */
+    static void levelsChanged();
+    static uint16_t _rateBurst;
+    static uint16_t _ratePerSecond;
+    static uint32_t _repeatWindow;
+    friend class Logger;
   };
 
 } // namespace esp32m
\ No newline at end of file
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <initializer_list>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "logging.hpp"
+
+#ifndef LOGGING_METRICS_BUCKETS
+#define LOGGING_METRICS_BUCKETS 8
+#endif
+#ifndef LOGGING_METRICS_RECORD_SIZE
+#define LOGGING_METRICS_RECORD_SIZE 512
+#endif
+
+namespace esp32m
+{
+
+    /**
+     * @brief Base class for the metrics aggregated in-process and reported periodically by @c Metrics, instead of logging every event.
+     * Metrics register themselves by name when constructed, and are expected to live long, e.g. as static or member variables.
+     * Updates are lock-free and cheap enough for the hot path, but must not be made from interrupt handlers.
+     */
+    class Metric
+    {
+    public:
+        Metric(const Metric &) = delete;
+        const char *name() const { return _name; }
+
+    protected:
+        /**
+         * @param name Name of the metric, used as the key of the reported fields, must stay valid while the metric exists
+         */
+        Metric(const char *name);
+        virtual ~Metric();
+        /**
+         * @brief Takes the snapshot of the current value to be reported, and resets the value if it is reported per interval
+         */
+        virtual void collect() = 0;
+        /**
+         * @brief Encodes the snapshot as structured fields, either all of them or none
+         * @return @c false if there's no room in @p buf
+         */
+        virtual bool encode(uint8_t *buf, size_t capacity, size_t &used) const = 0;
+
+    private:
+        const char *_name;
+        Metric *_next = nullptr;
+        friend class Metrics;
+    };
+
+    /**
+     * @brief Number of events, reported as the increment since the previous report.
+     * Not reported if nothing happened in the interval.
+     * @code
+     * static Counter retries("wifi.retries");
+     * retries.inc();
+     * @endcode
+     */
+    class Counter : public Metric
+    {
+    public:
+        Counter(const char *name) : Metric(name) {}
+        void inc(uint32_t n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+        /**
+         * @return Increment since the previous report
+         */
+        uint32_t value() const { return _value.load(std::memory_order_relaxed); }
+
+    protected:
+        void collect();
+        bool encode(uint8_t *buf, size_t capacity, size_t &used) const;
+
+    private:
+        std::atomic<uint32_t> _value{0};
+        uint32_t _reported = 0;
+    };
+
+    /**
+     * @brief Current value of something, e.g. free heap or queue length, reported as is every time
+     */
+    class Gauge : public Metric
+    {
+    public:
+        Gauge(const char *name) : Metric(name) {}
+        void set(int32_t value) { _value.store(value, std::memory_order_relaxed); }
+        void add(int32_t delta) { _value.fetch_add(delta, std::memory_order_relaxed); }
+        int32_t value() const { return _value.load(std::memory_order_relaxed); }
+
+    protected:
+        void collect();
+        bool encode(uint8_t *buf, size_t capacity, size_t &used) const;
+
+    private:
+        std::atomic<int32_t> _value{0};
+        int32_t _reported = 0;
+    };
+
+    /**
+     * @brief Distribution of values, e.g. durations, over fixed buckets, reported per interval as the count, sum, maximum
+     * and the number of values in every non-empty bucket: "name.le10" for values <= 10, "name.inf" for those above the last bound.
+     * Not reported if there were no values in the interval.
+     * @code
+     * static Histogram readTime("sensor.read_ms", {1, 5, 10, 50, 100});
+     * readTime.record(millis() - started);
+     * @endcode
+     */
+    class Histogram : public Metric
+    {
+    public:
+        /**
+         * @param bounds Inclusive upper bounds of the buckets in ascending order, up to @c LOGGING_METRICS_BUCKETS, the rest are ignored
+         */
+        Histogram(const char *name, std::initializer_list<uint32_t> bounds);
+        void record(uint32_t value);
+
+    protected:
+        void collect();
+        bool encode(uint8_t *buf, size_t capacity, size_t &used) const;
+
+    private:
+        uint32_t _bounds[LOGGING_METRICS_BUCKETS];
+        uint8_t _buckets = 0;
+        // the last one counts values above the highest bound
+        std::atomic<uint32_t> _counts[LOGGING_METRICS_BUCKETS + 1];
+        std::atomic<uint32_t> _sum{0};
+        std::atomic<uint32_t> _max{0};
+        uint32_t _reportedCounts[LOGGING_METRICS_BUCKETS + 1];
+        uint32_t _reportedSum = 0;
+        uint32_t _reportedMax = 0;
+    };
+
+    /**
+     * @brief Reports all registered metrics as one structured record per interval, sent through the regular appenders:
+     * message "metrics" from the logger "metrics", with the field "period" (milliseconds since the previous report)
+     * followed by the fields of every metric. If they don't fit in @c LOGGING_METRICS_RECORD_SIZE bytes,
+     * the report continues in the next record. A metric whose fields don't fit in the record on their own is not reported.
+     */
+    class Metrics
+    {
+    public:
+        /**
+         * @brief Starts the task that reports metrics periodically. May be called again to change the period or level.
+         * @param periodMs Reporting period, 0 stops reporting
+         * @param level Level of the reports, they are dropped (but the metrics are still reset) if the level is filtered out
+         */
+        static void start(uint32_t periodMs = 60000, LogLevel level = LogLevel::Info);
+        /**
+         * @brief Reports metrics right away, e.g. before going to deep sleep
+         */
+        static void flush();
+
+    private:
+        static Metric *_head;
+        static volatile uint32_t _period;
+        static LogLevel _level;
+        static TaskHandle_t _task;
+        static uint32_t _reported;
+        static void add(Metric *metric);
+        static void remove(Metric *metric);
+        static void run(void *);
+        friend class Metric;
+    };
+
+} // namespace esp32m
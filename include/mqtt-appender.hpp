@@ -1,25 +1,92 @@
 #pragma once
 
 #include <mqtt_client.h>
+#include <freertos/ringbuf.h>
+#include <freertos/semphr.h>
 
 #include "logging.hpp"
 
 namespace esp32m
 {
 
+  /**
+   * Publishes log messages to the MQTT topic.
+   * By default every message is published separately with QoS 0. Messages may be batched to reduce the packet rate,
+   * and kept in the outbox while the client is disconnected, see @c setBatching() and @c setOutbox()
+   */
   class MQTTAppender : public FormattingAppender
   {
   public:
+    /**
+     * @brief Payload of batched publishes
+     */
+    enum Format
+    {
+      /** Formatted messages separated by newlines */
+      Text,
+      /** Compact JSON array of objects, see @c LogMessage::toJson(...) */
+      Json
+    };
     MQTTAppender(const MQTTAppender &) = delete;
-    MQTTAppender(const char *topic) : _topic(topic) {}
-    void init(esp_mqtt_client_handle_t handle) { _handle = handle; }
+    MQTTAppender(const char *topic) : _topic(topic), _lock(xSemaphoreCreateRecursiveMutex()) {}
+    ~MQTTAppender();
+    void init(esp_mqtt_client_handle_t handle);
+    /**
+     * @brief Pack several messages into a single publish
+     * @param maxBytes Maximum payload size, the batch is published when the next message doesn't fit. 0 disables batching.
+     * @param maxDelayMs The batch is published when its oldest message is older than this. Use @c Logging::useQueue(...) with
+     *                   @c autoFlushPeriod to publish idle batches on time.
+     * @param format Payload format
+     */
+    void setBatching(size_t maxBytes, uint32_t maxDelayMs = 1000, Format format = Format::Text);
+    /**
+     * @brief Keep payloads that could not be published while disconnected, and publish them once the connection is restored
+     * @param bufsize Size of the outbox, the oldest payloads are discarded when it overflows. 0 disables the outbox.
+     */
+    void setOutbox(size_t bufsize);
+    /**
+     * @brief QoS of publishes containing messages of @c LogLevel::Error and above. Batches are published immediately on error.
+     */
+    void setErrorQos(int qos) { _errorQos = qos; }
+    /**
+     * @brief Subscribe to the topic that changes log levels at runtime.
+     * Payload is passed to @c Logging::configureLevels(...), e.g. "wifi.*=debug,*=warning".
+     * The subscription is made right away if the client is connected, and renewed on every connect.
+     * @param topic Topic name, must stay valid while the appender is in use
+     */
+    void setControlTopic(const char *topic);
 
   protected:
+    virtual bool append(const LogMessage *message);
     virtual bool append(const char *message);
+    virtual size_t pending() { return _batchLen + _outboxBytes; }
 
   private:
     const char *_topic;
+    const char *_controlTopic = nullptr;
     esp_mqtt_client_handle_t _handle = nullptr;
+    volatile bool _connected = true;
+    SemaphoreHandle_t _lock;
+    int _errorQos = 0;
+    Format _format = Format::Text;
+    char *_batch = nullptr;
+    size_t _batchSize = 0;
+    size_t _batchLen = 0;
+    int _batchQos = 0;
+    uint32_t _batchStarted = 0;
+    uint32_t _batchDelay = 0;
+    RingbufHandle_t _outbox = nullptr;
+    char *_outboxHead = nullptr;
+    size_t _outboxHeadSize = 0;
+    size_t _outboxItems = 0;
+    size_t _outboxBytes = 0;
+    bool add(const LogMessage *message);
+    bool flush();
+    bool deliver(const char *payload, size_t len, int qos);
+    bool publish(const char *payload, size_t len, int qos);
+    void drain();
+    void save(const char *payload, size_t len, int qos);
+    static void handler(void *self, esp_event_base_t base, int32_t id, void *data);
   };
   
-} // namespace esp32m
\ No newline at end of file
+} // namespace esp32m
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <FS.h>
+
+#include "logging.hpp"
+
+namespace esp32m
+{
+
+    /**
+     * Writes log to a fixed set of preallocated segment files, easy on flash wear and safe on power loss.
+     * Each segment is a sequence of pages. A page is written once, entirely, with a header carrying the magic,
+     * page sequence number, payload length and CRC. Files never grow or get renamed after they are preallocated,
+     * so the file system doesn't have to update metadata on every message.
+     * Messages are collected in RAM until the page is full, the commit delay expires, or an error is logged.
+     * After power loss, only the first page of each segment and the pages of the newest segment are scanned to resume writing.
+     */
+    class SegmentAppender : public FormattingAppender
+    {
+    public:
+        /**
+         * @param fs File system
+         * @param name Path of the segment files, segment number is appended, e.g. "/log" gives "/log.0", "/log.1" etc.
+         * @param segments Number of segments, the oldest one is overwritten when all of them are full
+         * @param segmentSize Size of each segment file, multiple of @p pageSize
+         * @param pageSize Size of the page, the unit of writing
+         * @param commitDelayMs Partially filled page is written when its oldest message is older than this
+         */
+        SegmentAppender(FS &fs, const char *name, uint8_t segments = 4, uint32_t segmentSize = 16384, uint16_t pageSize = 256, uint32_t commitDelayMs = 1000);
+        SegmentAppender(const SegmentAppender &) = delete;
+        ~SegmentAppender();
+        /**
+         * @brief Writes the partially filled page right away
+         */
+        bool commit();
+        /**
+         * @brief Receives payload of the pages, in the order they were written
+         */
+        typedef void (*Reader)(const char *data, size_t len, void *arg);
+        /**
+         * @brief Reads committed messages, oldest first
+         */
+        void read(Reader reader, void *arg);
+
+    protected:
+        virtual bool append(const LogMessage *message);
+        virtual bool append(const char *message);
+        virtual size_t pending() { return _len; }
+
+    private:
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t seq;
+            uint16_t len;
+            uint16_t crc;
+        } __attribute__((packed));
+        FS &_fs;
+        const char *_name;
+        uint8_t _segments;
+        uint16_t _pageSize;
+        uint32_t _pagesPerSegment;
+        uint32_t _commitDelay;
+        SemaphoreHandle_t _lock;
+        File _file;
+        uint8_t *_page = nullptr;
+        size_t _len = 0;
+        uint32_t _started = 0;
+        bool _urgent = false;
+        bool _ready = false;
+        uint8_t _segment = 0;
+        uint32_t _pageIndex = 0;
+        uint32_t _seq = 1;
+        String segmentName(uint8_t i);
+        bool open();
+        bool prepare(uint8_t i);
+        bool readHeader(File &f, uint32_t page, Header &h, uint8_t *payload);
+        bool write();
+    };
+
+} // namespace esp32m
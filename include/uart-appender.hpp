@@ -0,0 +1,72 @@
+#pragma once
+
+#include <driver/uart.h>
+#include <freertos/ringbuf.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <atomic>
+
+#include "logging.hpp"
+
+namespace esp32m
+{
+
+    /**
+     * Sends output to UART without blocking the caller.
+     * Formatted lines are copied to the TX ring buffer and written to the UART by a dedicated task,
+     * which sleeps on the UART driver's TX interrupt while the hardware drains the FIFO.
+     */
+    class UARTAppender : public FormattingAppender
+    {
+    public:
+        /**
+         * @brief What to do when the TX ring buffer has no room for the message
+         */
+        enum Overflow
+        {
+            /** Discard the message, see @c dropped() */
+            Drop,
+            /** Wait until the UART task frees enough room */
+            Block
+        };
+        /**
+         * @param port UART to write to, the driver is installed if necessary
+         * @param bufsize Size of the TX ring buffer
+         * @param overflow Overflow policy. Messages of @c LogLevel::Error and above that don't fit in the buffer are always written synchronously,
+         *                 after the messages already in the buffer.
+         */
+        UARTAppender(uart_port_t port = 0, size_t bufsize = 2048, Overflow overflow = Overflow::Drop);
+        UARTAppender(const UARTAppender &) = delete;
+        /**
+         * @brief Waits for the task to write the lines still in the buffer and exit.
+         * The appender must have been removed, see @c Logging::removeAppender(...)
+         */
+        ~UARTAppender();
+        /**
+         * @return Number of messages discarded due to buffer overflow
+         */
+        uint32_t dropped() const { return _dropped; }
+
+    protected:
+        virtual bool append(const LogMessage *message);
+        virtual bool append(const char *message);
+        virtual size_t pending();
+
+    private:
+        uart_port_t _port;
+        Overflow _overflow;
+        RingbufHandle_t _buf;
+        TaskHandle_t _task = nullptr;
+        // held while writing to the UART, keeps the order of buffered and synchronously written messages
+        SemaphoreHandle_t _lock;
+        // given by the task when it has written everything and is about to exit
+        SemaphoreHandle_t _stopped;
+        volatile bool _stop = false;
+        volatile uint32_t _dropped = 0;
+        std::atomic<size_t> _pending{0};
+        bool write(const char *message, LogLevel level);
+        bool writeNext();
+        void run();
+    };
+
+} // namespace esp32m
@@ -1,9 +1,18 @@
 #pragma once
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <lwip/sockets.h>
 
 #include "logging.hpp"
 
+#ifndef LOGGING_UDP_DESTINATIONS
+#define LOGGING_UDP_DESTINATIONS 4
+#endif
+#ifndef LOGGING_UDP_RETRY_SIZE
+#define LOGGING_UDP_RETRY_SIZE 1536
+#endif
+
 namespace esp32m
 {
 
@@ -13,7 +22,15 @@ namespace esp32m
         enum Format
         {
             Text,
-            Syslog
+            Syslog,
+            /** One JSON object per datagram, see @c LogMessage::toJson(...) */
+            Json,
+            /**
+             * Messages are not rendered, but batched into compact binary frames, see log-wire.hpp.
+             * A frame is sent when it's full, when an error is logged, or when the oldest message in it is older than 200ms.
+             * Use tools/logdecode to receive and render them.
+             */
+            Binary
         };
         UDPAppender(const char *ipaddr=nullptr, uint16_t port = 514);
         UDPAppender(const UDPAppender &) = delete;
@@ -22,13 +39,96 @@ namespace esp32m
         void setMode(Format format) { _format = format; }
 
     protected:
+        /**
+         * @brief For subclasses that manage destinations on their own, the gateway is not followed
+         */
+        UDPAppender(Format format);
         virtual bool append(const LogMessage *message);
+        virtual size_t pending() { return _frameLen; }
+        /**
+         * @return @c true if the network is up and the rendered messages may be passed to @c transmit(...)
+         */
+        virtual bool ready();
+        /**
+         * @brief Sends one datagram gathered from the segments, or just the leftovers of the previous ones if @p segments is @c nullptr
+         */
+        virtual bool transmit(const LogSegment *segments, size_t count);
+        bool transmit(const void *data, size_t len)
+        {
+            LogSegment segment = {(const char *)data, len};
+            return transmit(data ? &segment : nullptr, data ? 1 : 0);
+        }
+        bool sendFrame();
+        SemaphoreHandle_t _lock = nullptr;
+        // WiFi event handler registered by this appender, removed by the destructor, 0 if none
+        size_t _wifiEvent = 0;
 
     private:
         Format _format;
 
         struct sockaddr_in _addr;
         int _fd;
+
+        struct NameSlot
+        {
+            uint32_t hash;
+            uint32_t sent;
+            bool defined;
+        };
+        uint8_t *_frame = nullptr;
+        size_t _frameLen = 0;
+        uint16_t _frameCount = 0;
+        uint32_t _frameStarted = 0;
+        uint32_t _session = 0;
+        uint32_t _seq = 0;
+        NameSlot *_names = nullptr;
+        bool appendBinary(const LogMessage *message);
+        /**
+         * @param pinned ID that must not be taken over, used by the other name of the same message
+         */
+        uint16_t nameId(const char *name, bool &define, uint16_t pinned);
+        size_t writeName(uint16_t id, const char *name);
+    };
+
+    /**
+     * Sends every message, rendered once, to up to @c LOGGING_UDP_DESTINATIONS collectors.
+     * Each destination has its own connect()ed non-blocking socket, so sending never blocks the pipeline.
+     * A datagram the socket can't take right away is kept in a small per-destination retry buffer of @c LOGGING_UDP_RETRY_SIZE bytes,
+     * and sent before the following ones. The link state is tracked by WiFi events, not polled on every message.
+     */
+    class MultiUDPAppender : public UDPAppender
+    {
+    public:
+        MultiUDPAppender(Format format = Format::Syslog);
+        MultiUDPAppender(const MultiUDPAppender &) = delete;
+        ~MultiUDPAppender();
+        /**
+         * @return @c false if the address is invalid, or all destinations are taken
+         */
+        bool addDestination(const char *ipaddr, uint16_t port = 514);
+
+    protected:
+        virtual bool ready() { return _linkUp && _count; }
+        virtual bool transmit(const LogSegment *segments, size_t count);
+        virtual size_t pending();
+
+    private:
+        struct Destination
+        {
+            struct sockaddr_in addr;
+            int fd;
+            uint8_t *retry;
+            size_t retryLen;
+        };
+        Destination _destinations[LOGGING_UDP_DESTINATIONS];
+        uint8_t _count = 0;
+        volatile bool _linkUp;
+        // the sockets are bound to the old address after reconnect, they are reopened on the next send
+        volatile bool _reopen = false;
+        bool open(Destination &d);
+        void close(Destination &d);
+        bool keep(Destination &d, const LogSegment *segments, size_t count);
+        bool flushRetry(Destination &d);
     };
 
 } // namespace esp32m
\ No newline at end of file
@@ -23,4 +23,16 @@ namespace esp32m {
         return true;
     }
 
+    bool ETSAppender::append(const LogSegments &segments)
+    {
+        for (size_t i = 0; i < segments.count(); i++)
+        {
+            auto &s = segments.segments()[i];
+            for (size_t j = 0; j < s.len; j++)
+                platform_write_char_uart(s.data[j]);
+        }
+        platform_write_char_uart('\n');
+        return true;
+    }
+
 }
\ No newline at end of file
@@ -7,6 +7,41 @@ namespace esp32m
     {
         bool result = false;
         xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+        if (open())
+        {
+            result = !message || _file.println(message) > 0;
+            if (result)
+                _file.flush();
+        }
+        xSemaphoreGiveRecursive(_lock);
+        return result;
+    }
+
+    bool FSAppender::append(const LogSegments &segments)
+    {
+        bool result = false;
+        xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+        if (open())
+        {
+            // written piece by piece into the file's own buffer, without joining them first
+            result = true;
+            for (size_t i = 0; i < segments.count() && result; i++)
+            {
+                auto &s = segments.segments()[i];
+                result = _file.write((const uint8_t *)s.data, s.len) == s.len;
+            }
+            // same line ending as println() in append(const char *)
+            result = result && _file.write((const uint8_t *)"\r\n", 2) == 2;
+            if (result)
+                _file.flush();
+        }
+        xSemaphoreGiveRecursive(_lock);
+        return result;
+    }
+
+    // Opens the file, rotating it first if needed, _lock must be held
+    bool FSAppender::open()
+    {
         if (!_file)
             _file = _fs.open(_name, "a");
         if (_file && _maxFiles > 1 && shouldRotate(_file))
@@ -34,14 +69,7 @@ namespace esp32m
             }
             _file = _fs.open(_name, "a");
         }
-        if (_file)
-        {
-            result = !message || _file.println(message) > 0;
-            if (result)
-                _file.flush();
-        }
-        xSemaphoreGiveRecursive(_lock);
-        return result;
+        return (bool)_file;
     }
 
     String FSAppender::newFilename(uint8_t i) {
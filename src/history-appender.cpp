@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "history-appender.hpp"
+
+namespace esp32m
+{
+
+    uint8_t nameShard(const char *name)
+    {
+        // FNV-1a
+        uint32_t h = 2166136261u;
+        while (*name)
+        {
+            h ^= (uint8_t)*name++;
+            h *= 16777619u;
+        }
+        return h % LOGGING_HISTORY_SHARDS;
+    }
+
+    HistoryAppender::HistoryAppender(size_t size) : _lock(xSemaphoreCreateMutex())
+    {
+        // records are kept 4-byte aligned, so that the headers may be accessed in place
+        _size = size & ~(size_t)3;
+        _ring = (uint8_t *)malloc(_size);
+        if (!_ring)
+            _size = 0;
+        _wrap = _size;
+    }
+
+    HistoryAppender::~HistoryAppender()
+    {
+        free(_ring);
+        vSemaphoreDelete(_lock);
+    }
+
+    void HistoryAppender::evict()
+    {
+        if (_tail == _wrap)
+        {
+            _used -= _size - _wrap;
+            _tail = 0;
+            _wrap = _size;
+            return;
+        }
+        auto h = at(_tail);
+        _used -= h->size;
+        _count--;
+        _levelCounts[h->level]--;
+        _shardCounts[h->shard]--;
+        _oldest = h->seq + 1;
+        _tail += h->size;
+        if (_tail == _size)
+            _tail = 0;
+    }
+
+    bool HistoryAppender::append(const LogMessage *message)
+    {
+        if (!message || !_ring)
+            return true;
+        size_t need = (sizeof(Header) + message->size() + 3) & ~(size_t)3;
+        if (need > _size || need > 0xFFFF)
+            return true; // doesn't fit, not kept
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        // records are never split, the space left at the end is skipped if the record doesn't fit there
+        size_t pad = _head + need > _size ? _size - _head : 0;
+        while (_used + pad + need > _size)
+        {
+            evict();
+            if (!_used)
+            {
+                _head = _tail = 0;
+                _wrap = _size;
+                pad = 0;
+            }
+        }
+        if (pad)
+        {
+            _wrap = _head;
+            _used += pad;
+            _head = 0;
+        }
+        uint8_t level = message->level() <= LogLevel::Verbose ? message->level() : LogLevel::Verbose;
+        auto shard = nameShard(message->name());
+        auto h = at(_head);
+        h->seq = ++_seq;
+        h->size = need;
+        h->level = level;
+        h->shard = shard;
+        h->prevLevel = _levels[level];
+        h->prevShard = _shards[shard];
+        memcpy(h + 1, message, message->size());
+        _levels[level] = {h->seq, (uint32_t)_head};
+        _shards[shard] = {h->seq, (uint32_t)_head};
+        _levelCounts[level]++;
+        _shardCounts[shard]++;
+        _count++;
+        _used += need;
+        _head += need;
+        if (_head == _size)
+            _head = 0;
+        xSemaphoreGive(_lock);
+        return true;
+    }
+
+    size_t HistoryAppender::query(LogLevel level, const char *name, size_t max, Visitor visitor, void *arg)
+    {
+        if (!visitor || !max)
+            return 0;
+        if (level > LogLevel::Verbose)
+            level = LogLevel::Verbose;
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        if (max > _count)
+            max = _count;
+        auto found = max ? (Link *)malloc(max * sizeof(Link)) : nullptr;
+        size_t n = 0;
+        if (found)
+        {
+            // walk whichever index has fewer candidates, newest first
+            size_t byLevel = 0;
+            for (int l = 0; l <= level; l++)
+                byLevel += _levelCounts[l];
+            auto shard = name ? nameShard(name) : 0;
+            if (name && _shardCounts[shard] < byLevel)
+            {
+                for (auto link = _shards[shard]; n < max && alive(link);)
+                {
+                    auto h = at(link.offset);
+                    auto m = (const LogMessage *)(h + 1);
+                    if (h->level <= level && !strcmp(m->name(), name))
+                        found[n++] = link;
+                    link = h->prevShard;
+                }
+            }
+            else
+            {
+                // the chains of the included levels are merged by sequence number
+                Link links[LogLevel::Verbose + 1];
+                memcpy(links, _levels, sizeof(links));
+                while (n < max)
+                {
+                    int newest = -1;
+                    for (int l = 0; l <= level; l++)
+                        if (alive(links[l]) && (newest < 0 || links[l].seq > links[newest].seq))
+                            newest = l;
+                    if (newest < 0)
+                        break;
+                    auto h = at(links[newest].offset);
+                    auto m = (const LogMessage *)(h + 1);
+                    if (!name || !strcmp(m->name(), name))
+                        found[n++] = links[newest];
+                    links[newest] = h->prevLevel;
+                }
+            }
+        }
+        xSemaphoreGive(_lock);
+        // every message is copied out and passed to the visitor without the lock, so that the visitor may log,
+        // including to this appender. Messages evicted in the meantime are skipped
+        size_t result = 0;
+        LogMessage *copy = nullptr;
+        size_t copySize = 0;
+        for (size_t i = n; i-- > 0;)
+        {
+            xSemaphoreTake(_lock, portMAX_DELAY);
+            auto h = at(found[i].offset);
+            auto m = (const LogMessage *)(h + 1);
+            bool kept = alive(found[i]);
+            if (kept && m->size() > copySize)
+            {
+                free(copy);
+                copySize = m->size();
+                copy = (LogMessage *)malloc(copySize);
+                if (!copy)
+                    copySize = 0;
+            }
+            kept = kept && copy;
+            if (kept)
+                memcpy(copy, m, m->size());
+            xSemaphoreGive(_lock);
+            if (!kept)
+                continue;
+            result++;
+            if (!visitor(copy, arg))
+                break;
+        }
+        free(copy);
+        free(found);
+        return result;
+    }
+
+    size_t HistoryAppender::replay(LogAppender &target, LogLevel level, const char *name, size_t max)
+    {
+        return query(level, name, max, [](const LogMessage *message, void *arg) {
+            return ((LogAppender *)arg)->append(message);
+        }, &target);
+    }
+
+} // namespace esp32m
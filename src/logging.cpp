@@ -2,13 +2,25 @@
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
+#include <math.h>
+#include <atomic>
 #include <freertos/FreeRTOS.h>
-#include <freertos/ringbuf.h>
 #include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <esp_timer.h>
 #include <esp_task_wdt.h>
+#include <esp_partition.h>
+#include <esp_idf_version.h>
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+#include <esp_private/spi_flash_os.h>
+#else
+#include <esp_spi_flash.h>
+#include <esp_flash_internal.h>
+#endif
 #include <esp32-hal.h>
+#if LOGGING_PROFILE
+#include <esp_cpu.h>
+#endif
 
 #include "logging.hpp"
 #include "platform-uart.hpp"
@@ -17,11 +29,295 @@ namespace esp32m
 {
 
     LogLevel Logging::_level = LogLevel::Debug;
+    volatile uint32_t Logging::_levelsGeneration = 1;
     LogMessageFormatter Logging::_formatter = nullptr;
-    LogAppender *_appenders = nullptr;
+    uint16_t Logging::_rateBurst = 0;
+    uint16_t Logging::_ratePerSecond = 0;
+    uint32_t Logging::_repeatWindow = 0;
     SemaphoreHandle_t _loggingLock = xSemaphoreCreateMutex();
 
-    LogMessage *LogMessage::alloc(LogLevel level, int64_t stamp, const char *name, const char *message)
+#ifndef LOGGING_POOL_RACE_WINDOW
+// runs between reading the link of the top block and swapping the head, the host test makes other tasks run there
+#define LOGGING_POOL_RACE_WINDOW()
+#endif
+
+    /**
+     * Pool of fixed-size blocks.
+     * Free blocks form a stack linked by 16-bit indices stored in the blocks themselves. The head packs the index of the top block
+     * with a tag that changes on every update, so that a block taken and returned by another task in the meantime fails the CAS.
+     */
+    class BlockPool
+    {
+    public:
+        static const uint16_t Empty = 0xFFFF;
+        void init(uint8_t *base, size_t blockSize, size_t blocks)
+        {
+            _base = base;
+            _blockSize = blockSize;
+            _blocks = blocks < Empty ? blocks : Empty - 1;
+            for (size_t i = 0; i < _blocks; i++)
+                next(i) = i + 1 < _blocks ? i + 1 : Empty;
+            _head.store(_blocks ? 0 : Empty);
+        }
+        size_t blockSize() const { return _blockSize; }
+        bool owns(const void *ptr) const { return ptr >= _base && ptr < _base + _blockSize * _blocks; }
+        void *alloc()
+        {
+            auto head = _head.load(std::memory_order_acquire);
+            for (;;)
+            {
+                uint16_t index = head & 0xFFFF;
+                if (index == Empty)
+                    return nullptr;
+                // the block may be taken by someone else while we read its link, the tag makes the CAS fail then
+                auto updated = ((head & 0xFFFF0000) + 0x10000) | next(index);
+                LOGGING_POOL_RACE_WINDOW();
+                if (_head.compare_exchange_weak(head, updated, std::memory_order_acquire))
+                {
+                    auto used = ++_used;
+                    auto peak = _peak.load();
+                    while (used > peak && !_peak.compare_exchange_weak(peak, used))
+                        ;
+                    return _base + index * _blockSize;
+                }
+            }
+        }
+        void free(void *ptr)
+        {
+            uint16_t index = ((uint8_t *)ptr - _base) / _blockSize;
+            // before the block can be taken again, so that the count never exceeds the pool
+            _used--;
+            auto head = _head.load(std::memory_order_relaxed);
+            do
+                next(index) = head & 0xFFFF;
+            while (!_head.compare_exchange_weak(head, ((head & 0xFFFF0000) + 0x10000) | index, std::memory_order_release));
+        }
+        void stats(LogPoolStats &s) const
+        {
+            s.blockSize = _blockSize;
+            s.blocks = _blocks;
+            s.used = _used;
+            s.peak = _peak;
+            s.fallbacks = _fallbacks;
+        }
+        std::atomic<size_t> _fallbacks{0};
+
+    private:
+        uint8_t *_base = nullptr;
+        size_t _blockSize = 0;
+        size_t _blocks = 0;
+        std::atomic<uint32_t> _head{Empty};
+        std::atomic<size_t> _used{0};
+        std::atomic<size_t> _peak{0};
+        volatile uint16_t &next(size_t index) { return *(volatile uint16_t *)(_base + index * _blockSize); }
+    };
+
+    const size_t PoolClasses = 4;
+    BlockPool _pools[PoolClasses];
+    std::atomic<uint8_t *> _poolArena{nullptr};
+    size_t _poolArenaSize = 0;
+
+    void *logAlloc(size_t size)
+    {
+        if (_poolArena.load(std::memory_order_acquire))
+            for (auto &pool : _pools)
+                if (size <= pool.blockSize())
+                {
+                    auto block = pool.alloc();
+                    if (block)
+                        return block;
+                    pool._fallbacks++;
+                    break;
+                }
+        return malloc(size);
+    }
+
+    void logFree(void *ptr)
+    {
+        auto arena = _poolArena.load(std::memory_order_acquire);
+        if (arena && ptr >= arena && ptr < arena + _poolArenaSize)
+        {
+            for (auto &pool : _pools)
+                if (pool.owns(ptr))
+                {
+                    pool.free(ptr);
+                    return;
+                }
+        }
+        free(ptr);
+    }
+
+    bool Logging::usePool(size_t footprint)
+    {
+        xSemaphoreTake(_loggingLock, portMAX_DELAY);
+        auto arena = _poolArena.load() ? nullptr : (uint8_t *)malloc(footprint);
+        if (arena)
+        {
+            // every size class gets the same share of memory
+            auto share = footprint / PoolClasses;
+            auto p = arena;
+            for (size_t i = 0; i < PoolClasses; i++)
+            {
+                size_t blockSize = 64 << i;
+                _pools[i].init(p, blockSize, share / blockSize);
+                p += share / blockSize * blockSize;
+            }
+            _poolArenaSize = p - arena;
+            _poolArena.store(arena, std::memory_order_release);
+        }
+        xSemaphoreGive(_loggingLock);
+        return arena != nullptr;
+    }
+
+    size_t Logging::poolStats(LogPoolStats *stats, size_t count)
+    {
+        if (!_poolArena.load())
+            return 0;
+        for (size_t i = 0; i < count && i < PoolClasses; i++)
+            _pools[i].stats(stats[i]);
+        return PoolClasses;
+    }
+
+    /**
+     * Immutable snapshot of the registered appenders.
+     * @c Logging::addAppender(...) and @c Logging::removeAppender(...) build a new snapshot and swap it atomically,
+     * so the dispatch path iterates a contiguous array without taking any locks.
+     */
+    struct AppenderList
+    {
+        size_t count;
+        LogAppender **items() { return (LogAppender **)(this + 1); }
+        static AppenderList *alloc(size_t count)
+        {
+            auto list = (AppenderList *)malloc(sizeof(AppenderList) + count * sizeof(LogAppender *));
+            if (list)
+                list->count = count;
+            return list;
+        }
+    };
+
+    std::atomic<AppenderList *> _appenders(nullptr);
+    SemaphoreHandle_t _appendersLock = xSemaphoreCreateMutex();
+    // readers register in the counter of the current epoch, writers flip the epoch and wait for the previous one to drain
+    std::atomic<uint32_t> _appendersEpoch(0);
+    std::atomic<uint32_t> _appendersReaders[2];
+
+    /**
+     * Read-side guard of the appender snapshot. The snapshot stays valid for the lifetime of the guard.
+     * @note Appenders must not be added or removed while the guard is held by the same task, that would never finish waiting for the grace period
+     */
+    class Appenders
+    {
+    public:
+        Appenders()
+        {
+            for (;;)
+            {
+                _epoch = _appendersEpoch.load();
+                _appendersReaders[_epoch & 1].fetch_add(1);
+                if (_appendersEpoch.load() == _epoch)
+                    break;
+                _appendersReaders[_epoch & 1].fetch_sub(1);
+            }
+            _list = _appenders.load();
+        }
+        ~Appenders()
+        {
+            _appendersReaders[_epoch & 1].fetch_sub(1, std::memory_order_release);
+        }
+        Appenders(const Appenders &) = delete;
+        size_t count() const { return _list ? _list->count : 0; }
+        LogAppender **begin() const { return _list ? _list->items() : nullptr; }
+        LogAppender **end() const { return _list ? _list->items() + _list->count : nullptr; }
+
+        /**
+         * @brief Replaces the snapshot and frees the old one once no reader can see it anymore
+         * @note Must be called with @c _appendersLock held
+         */
+        static void replace(AppenderList *list)
+        {
+            auto old = _appenders.exchange(list);
+            auto epoch = _appendersEpoch.fetch_add(1);
+            while (_appendersReaders[epoch & 1].load() != 0)
+                vTaskDelay(1);
+            free(old);
+        }
+
+    private:
+        uint32_t _epoch;
+        AppenderList *_list;
+    };
+
+    /**
+     * Names of the tasks that have been logging, referenced from messages by 1-based index.
+     * Every task looks its index up once, and keeps it in thread-local storage along with the current span.
+     */
+    struct LogTask
+    {
+        TaskHandle_t handle;
+        char name[16];
+    };
+
+    LogTask _tasks[LOGGING_TASKS] = {};
+    portMUX_TYPE _tasksLock = portMUX_INITIALIZER_UNLOCKED;
+    thread_local uint8_t _taskIndex = 0;
+    thread_local uint32_t _currentSpan = 0;
+    std::atomic<uint32_t> _spanIds{0};
+
+    uint32_t nextSpanId()
+    {
+        uint32_t id;
+        do
+            id = ++_spanIds;
+        while (!id);
+        return id;
+    }
+
+    uint8_t currentTask()
+    {
+        if (_taskIndex || xPortInIsrContext())
+            return _taskIndex;
+        auto handle = xTaskGetCurrentTaskHandle();
+        if (!handle)
+            return 0;
+        auto name = pcTaskGetName(handle);
+        portENTER_CRITICAL(&_tasksLock);
+        // handle of the deleted task may be reused by the new one, the entry gets its name
+        for (int i = 0; i < LOGGING_TASKS; i++)
+            if (_tasks[i].handle == handle || !_tasks[i].handle)
+            {
+                _tasks[i].handle = handle;
+                strncpy(_tasks[i].name, name ? name : "?", sizeof(_tasks[i].name) - 1);
+                _taskIndex = i + 1;
+                break;
+            }
+        portEXIT_CRITICAL(&_tasksLock);
+        return _taskIndex;
+    }
+
+    const char *LogMessage::task() const
+    {
+        return _task && _task <= LOGGING_TASKS ? _tasks[_task - 1].name : nullptr;
+    }
+
+    LogSpan::LogSpan() : LogSpan(nextSpanId()) {}
+
+    LogSpan::LogSpan(uint32_t id) : _id(id), _prev(_currentSpan)
+    {
+        _currentSpan = id;
+    }
+
+    LogSpan::~LogSpan()
+    {
+        _currentSpan = _prev;
+    }
+
+    uint32_t LogSpan::current()
+    {
+        return _currentSpan;
+    }
+
+    LogMessage *LogMessage::alloc(LogLevel level, int64_t stamp, const char *name, const char *message, const uint8_t *fields, size_t fieldsSize)
     {
         size_t ml = strlen(message);
         while (ml)
@@ -32,15 +328,426 @@ namespace esp32m
             else
                 break;
         }
-        size_t size = sizeof(LogMessage) + ml + 1;
-        void *pool = malloc(size);
-        return new (pool) LogMessage(size, level, stamp, name, message, ml);
+        size_t size = sizeof(LogMessage) + ml + 1 + fieldsSize;
+        void *pool = logAlloc(size);
+        if (!pool)
+            return nullptr;
+        return new (pool) LogMessage(size, level, stamp, name, message, ml, fields, fieldsSize);
     }
 
-    LogMessage::LogMessage(size_t size, LogLevel level, int64_t stamp, const char *name, const char *message, size_t messageLen)
-        : _size(size), _stamp(stamp), _name(name), _level(level)
+    LogMessage::LogMessage(size_t size, LogLevel level, int64_t stamp, const char *name, const char *message, size_t messageLen, const uint8_t *fields, size_t fieldsSize)
+        : _size(size), _stamp(stamp), _name(name), _level(level), _fieldsSize(fieldsSize),
+          _task(currentTask()), _core(xPortGetCoreID()), _span(_currentSpan)
     {
         strncpy((char *)this->message(), message, messageLen)[messageLen] = '\0';
+        if (fieldsSize)
+            memcpy((uint8_t *)this->fields(), fields, fieldsSize);
+    }
+
+    size_t fieldValueSize(LogFieldType type)
+    {
+        switch (type)
+        {
+        case LogFieldType::Bool:
+            return 1;
+        case LogFieldType::Int:
+        case LogFieldType::UInt:
+        case LogFieldType::Float:
+            return 4;
+        case LogFieldType::Int64:
+        case LogFieldType::UInt64:
+        case LogFieldType::Double:
+            return 8;
+        default:
+            return 0;
+        }
+    }
+
+    bool LogMessage::field(size_t &offset, LogField &field) const
+    {
+        auto f = fields();
+        auto fs = fields_size();
+        // type, key length, key, [string length], value
+        if (offset + 2 > fs)
+            return false;
+        field.type = (LogFieldType)f[offset];
+        field.keyLen = f[offset + 1];
+        field.key = (const char *)f + offset + 2;
+        auto pos = offset + 2 + field.keyLen;
+        if (field.type == LogFieldType::String)
+        {
+            if (pos + 1 > fs)
+                return false;
+            field.valueLen = f[pos++];
+        }
+        else
+            field.valueLen = fieldValueSize(field.type);
+        if (!field.valueLen && field.type != LogFieldType::String)
+            return false;
+        field.value = f + pos;
+        pos += field.valueLen;
+        if (pos > fs)
+            return false;
+        offset = pos;
+        return true;
+    }
+
+    int64_t LogField::asInt() const
+    {
+        switch (type)
+        {
+        case LogFieldType::Bool:
+            return value[0];
+        case LogFieldType::Int:
+        {
+            int32_t v;
+            memcpy(&v, value, sizeof(v));
+            return v;
+        }
+        case LogFieldType::Int64:
+        {
+            int64_t v;
+            memcpy(&v, value, sizeof(v));
+            return v;
+        }
+        case LogFieldType::UInt:
+        case LogFieldType::UInt64:
+            return (int64_t)asUInt();
+        case LogFieldType::Float:
+        case LogFieldType::Double:
+            return (int64_t)asDouble();
+        default:
+            return 0;
+        }
+    }
+
+    uint64_t LogField::asUInt() const
+    {
+        switch (type)
+        {
+        case LogFieldType::UInt:
+        {
+            uint32_t v;
+            memcpy(&v, value, sizeof(v));
+            return v;
+        }
+        case LogFieldType::UInt64:
+        {
+            uint64_t v;
+            memcpy(&v, value, sizeof(v));
+            return v;
+        }
+        default:
+            return (uint64_t)asInt();
+        }
+    }
+
+    double LogField::asDouble() const
+    {
+        switch (type)
+        {
+        case LogFieldType::Float:
+        {
+            float v;
+            memcpy(&v, value, sizeof(v));
+            return v;
+        }
+        case LogFieldType::Double:
+        {
+            double v;
+            memcpy(&v, value, sizeof(v));
+            return v;
+        }
+        case LogFieldType::UInt:
+        case LogFieldType::UInt64:
+            return (double)asUInt();
+        default:
+            return (double)asInt();
+        }
+    }
+
+    /**
+     * Text output with the semantics of snprintf(): counts the full length even when the buffer is exhausted
+     */
+    class TextWriter
+    {
+    public:
+        TextWriter(char *buf, size_t size) : _buf(buf), _size(size)
+        {
+            if (size)
+                buf[0] = 0;
+        }
+        size_t length() const { return _len; }
+        void put(char c)
+        {
+            if (_len + 1 < _size)
+            {
+                _buf[_len] = c;
+                _buf[_len + 1] = 0;
+            }
+            _len++;
+        }
+        void write(const char *s, size_t n)
+        {
+            while (n--)
+                put(*s++);
+        }
+        void write(const char *s) { write(s, strlen(s)); }
+        void printf(const char *format, ...)
+        {
+            char tmp[64];
+            va_list arg;
+            va_start(arg, format);
+            auto n = vsnprintf(tmp, sizeof(tmp), format, arg);
+            va_end(arg);
+            if (n > 0)
+                write(tmp, n < sizeof(tmp) ? n : sizeof(tmp) - 1);
+        }
+        void json(const char *s, size_t n)
+        {
+            put('"');
+            for (; n; n--, s++)
+            {
+                auto c = (uint8_t)*s;
+                switch (c)
+                {
+                case '"':
+                case '\\':
+                    put('\\');
+                    put(c);
+                    break;
+                case '\n':
+                    write("\\n", 2);
+                    break;
+                case '\r':
+                    write("\\r", 2);
+                    break;
+                case '\t':
+                    write("\\t", 2);
+                    break;
+                default:
+                    if (c < 0x20)
+                        printf("\\u%04x", c);
+                    else
+                        put(c);
+                }
+            }
+            put('"');
+        }
+        void json(const char *s) { json(s, strlen(s)); }
+
+    private:
+        char *_buf;
+        size_t _size;
+        size_t _len = 0;
+    };
+
+    void writeField(TextWriter &w, const LogField &f, LogMessage::FieldsFormat format)
+    {
+        bool quote = format == LogMessage::FieldsFormat::SyslogParams;
+        if (format == LogMessage::FieldsFormat::Json)
+        {
+            w.json(f.key, f.keyLen);
+            w.put(':');
+        }
+        else
+        {
+            w.write(f.key, f.keyLen);
+            w.put('=');
+        }
+        if (f.type == LogFieldType::String)
+        {
+            auto s = (const char *)f.value;
+            if (format == LogMessage::FieldsFormat::Json)
+                w.json(s, f.valueLen);
+            else
+            {
+                for (size_t i = 0; !quote && i < f.valueLen; i++)
+                    quote = s[i] == ' ' || s[i] == '"' || s[i] == '=';
+                if (quote)
+                    w.put('"');
+                for (size_t i = 0; i < f.valueLen; i++)
+                {
+                    // RFC5424 requires '"', '\' and ']' to be escaped in PARAM-VALUE
+                    if (quote && (s[i] == '"' || s[i] == '\\' || (s[i] == ']' && format == LogMessage::FieldsFormat::SyslogParams)))
+                        w.put('\\');
+                    w.put(s[i]);
+                }
+                if (quote)
+                    w.put('"');
+            }
+            return;
+        }
+        if (quote)
+            w.put('"');
+        switch (f.type)
+        {
+        case LogFieldType::Bool:
+            w.write(f.value[0] ? "true" : "false");
+            break;
+        case LogFieldType::Int:
+        case LogFieldType::Int64:
+            w.printf("%lld", (long long)f.asInt());
+            break;
+        case LogFieldType::UInt:
+        case LogFieldType::UInt64:
+            w.printf("%llu", (unsigned long long)f.asUInt());
+            break;
+        default:
+        {
+            auto d = f.asDouble();
+            if (format == LogMessage::FieldsFormat::Json && !isfinite(d))
+                w.write("null");
+            else
+                w.printf("%g", d);
+        }
+        }
+        if (quote)
+            w.put('"');
+    }
+
+    size_t LogMessage::renderFields(char *buf, size_t size, FieldsFormat format) const
+    {
+        TextWriter w(buf, size);
+        size_t offset = 0;
+        LogField f;
+        while (field(offset, f))
+        {
+            if (w.length())
+                w.put(format == FieldsFormat::Json ? ',' : ' ');
+            writeField(w, f, format);
+        }
+        return w.length();
+    }
+
+    /**
+     * @brief Writes task, core and span of the message as fields, separated from the preceding text if there's any
+     */
+    void writeContext(TextWriter &w, const LogMessage *m, LogMessage::FieldsFormat format)
+    {
+        auto name = m->task();
+        uint32_t core = m->core(), span = m->span();
+        LogField fields[] = {
+            {LogFieldType::String, "task", 4, (const uint8_t *)name, name ? strlen(name) : 0},
+            {LogFieldType::UInt, "core", 4, (const uint8_t *)&core, sizeof(core)},
+            {LogFieldType::UInt, "span", 4, (const uint8_t *)&span, sizeof(span)},
+        };
+        for (auto &f : fields)
+        {
+            if ((f.type == LogFieldType::String && !name) || (f.value == (const uint8_t *)&span && !span))
+                continue;
+            if (w.length())
+                w.put(format == LogMessage::FieldsFormat::Json ? ',' : ' ');
+            writeField(w, f, format);
+        }
+    }
+
+    size_t LogMessage::renderContext(char *buf, size_t size, FieldsFormat format) const
+    {
+        TextWriter w(buf, size);
+        writeContext(w, this, format);
+        return w.length();
+    }
+
+    size_t LogMessage::toJson(char *buf, size_t size) const
+    {
+        static const char *levels = "??EWIDV";
+        auto l = level();
+        TextWriter w(buf, size);
+        w.printf("{\"t\":%lld,\"l\":\"%c\",\"n\":", (long long)stamp(), l >= 0 && l < 7 ? levels[l] : '?');
+        w.json(name());
+        w.write(",\"m\":");
+        w.json(message());
+        writeContext(w, this, FieldsFormat::Json);
+        if (fields_size())
+        {
+            w.write(",\"f\":{");
+            size_t offset = 0;
+            LogField f;
+            bool first = true;
+            while (field(offset, f))
+            {
+                if (!first)
+                    w.put(',');
+                first = false;
+                writeField(w, f, FieldsFormat::Json);
+            }
+            w.put('}');
+        }
+        w.put('}');
+        return w.length();
+    }
+
+    LogRecord::LogRecord(LogRecord &&other)
+        : _logger(other._logger), _msg(other._msg), _level(other._level), _size(other._size)
+    {
+        memcpy(_fields, other._fields, _size);
+        other._logger = nullptr;
+    }
+
+    LogRecord::~LogRecord()
+    {
+        if (_logger && _logger->admit(_level, _msg))
+            _logger->dispatch(_level, _msg, _fields, _size);
+    }
+
+    LogRecord &LogRecord::add(const char *key, LogFieldType type, const void *value, size_t size)
+    {
+        if (_logger)
+            encode(_fields, sizeof(_fields), _size, key, type, value, size);
+        return *this;
+    }
+
+    bool LogRecord::encode(uint8_t *buf, size_t capacity, size_t &used, const char *key, LogFieldType type, const void *value, size_t size)
+    {
+        if (!key)
+            return false;
+        auto kl = strlen(key);
+        if (kl > 255)
+            kl = 255;
+        auto extra = type == LogFieldType::String ? 1 : 0;
+        if (used + 2 + kl + extra + size > capacity)
+            return false; // no room, the field is dropped
+        auto p = buf + used;
+        *p++ = (uint8_t)type;
+        *p++ = kl;
+        memcpy(p, key, kl);
+        p += kl;
+        if (extra)
+            *p++ = size;
+        memcpy(p, value, size);
+        used += 2 + kl + extra + size;
+        return true;
+    }
+
+    LogRecord &LogRecord::kv(const char *key, long long value)
+    {
+        if (value >= INT32_MIN && value <= INT32_MAX)
+        {
+            int32_t v = value;
+            return add(key, LogFieldType::Int, &v, sizeof(v));
+        }
+        int64_t v = value;
+        return add(key, LogFieldType::Int64, &v, sizeof(v));
+    }
+
+    LogRecord &LogRecord::kv(const char *key, unsigned long long value)
+    {
+        if (value <= UINT32_MAX)
+        {
+            uint32_t v = value;
+            return add(key, LogFieldType::UInt, &v, sizeof(v));
+        }
+        uint64_t v = value;
+        return add(key, LogFieldType::UInt64, &v, sizeof(v));
+    }
+
+    LogRecord &LogRecord::kv(const char *key, const char *value)
+    {
+        if (!value)
+            value = "";
+        auto len = strlen(value);
+        return add(key, LogFieldType::String, value, len > 255 ? 255 : len);
     }
 
     Logger &Loggable::logger()
@@ -53,6 +760,297 @@ namespace esp32m
         return *_logger;
     }
 
+    /**
+     * Adaptive backpressure, see Logging::setBackpressure(...).
+     * Appenders' results are counted by the code that calls them, and evaluated together with the queue occupancy once per window.
+     */
+    std::atomic<uint8_t> _backpressureSteps{0};
+    std::atomic<uint8_t> _throttle{0};
+    std::atomic<uint32_t> _appendAttempts{0};
+    std::atomic<uint32_t> _appendFailures{0};
+    std::atomic<uint32_t> _throttled{0};
+
+    bool appended(bool result)
+    {
+        if (_backpressureSteps.load(std::memory_order_relaxed))
+        {
+            _appendAttempts.fetch_add(1, std::memory_order_relaxed);
+            if (!result)
+                _appendFailures.fetch_add(1, std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    void govern();
+
+    class LogQueue;
+    std::atomic<LogQueue *> logQueue(nullptr);
+    // same grace period scheme as the appenders: the queue is deleted only after the tasks that might have seen it let go
+    std::atomic<uint32_t> _queueEpoch(0);
+    std::atomic<uint32_t> _queueReaders[2];
+
+    /**
+     * Read-side guard of the queue, the queue is not deleted for the lifetime of the guard.
+     * Producers may wait for room in the queue while holding it, the queue task keeps draining until all of them are done.
+     * @note The queue must not be replaced or removed while the guard is held by the same task
+     */
+    class QueueRef
+    {
+    public:
+        // may be used from interrupt handlers, registering never waits
+        IRAM_ATTR QueueRef()
+        {
+            for (;;)
+            {
+                _epoch = _queueEpoch.load();
+                _queueReaders[_epoch & 1].fetch_add(1);
+                if (_queueEpoch.load() == _epoch)
+                    break;
+                _queueReaders[_epoch & 1].fetch_sub(1);
+            }
+            _queue = logQueue.load();
+        }
+        IRAM_ATTR ~QueueRef()
+        {
+            _queueReaders[_epoch & 1].fetch_sub(1, std::memory_order_release);
+        }
+        QueueRef(const QueueRef &) = delete;
+        LogQueue *get() const { return _queue; }
+        LogQueue *operator->() const { return _queue; }
+        explicit operator bool() const { return _queue != nullptr; }
+
+        /**
+         * @brief Hides the queue from new readers and waits until none of the current ones can use it anymore
+         */
+        static void detach()
+        {
+            logQueue.store(nullptr);
+            auto epoch = _queueEpoch.fetch_add(1);
+            while (_queueReaders[epoch & 1].load() != 0)
+                vTaskDelay(1);
+        }
+
+    private:
+        uint32_t _epoch;
+        LogQueue *_queue;
+    };
+
+    /**
+     * Records of messages logged from interrupt handlers, see @c Logger::isr(...)
+     * This is a bounded lock-free queue: producers claim a slot by advancing the head, then publish it by bumping slot's sequence.
+     * There's only one consumer at a time, the one that wins @c _expanding.
+     */
+    class IsrRing
+    {
+    public:
+        struct Record
+        {
+            Logger *logger;
+            const char *format;
+            int64_t time;
+            uint32_t args[LOGGING_ISR_ARGS];
+            LogLevel level;
+            uint8_t core;
+        };
+        IsrRing()
+        {
+            for (uint32_t i = 0; i < LOGGING_ISR_SLOTS; i++)
+                _slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+        IRAM_ATTR bool push(const Record &record)
+        {
+            auto pos = _head.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                auto &slot = _slots[pos % LOGGING_ISR_SLOTS];
+                auto diff = (int32_t)(slot.seq.load(std::memory_order_acquire) - pos);
+                if (!diff)
+                {
+                    if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        slot.record = record;
+                        slot.seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                    pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+        /**
+         * @brief Consumer side, must be called by the owner of @c _expanding only
+         */
+        bool pop(Record &record)
+        {
+            auto &slot = _slots[_tail % LOGGING_ISR_SLOTS];
+            if (slot.seq.load(std::memory_order_acquire) != _tail + 1)
+                return false;
+            record = slot.record;
+            slot.seq.store(_tail + LOGGING_ISR_SLOTS, std::memory_order_release);
+            _tail++;
+            return true;
+        }
+        bool empty() const
+        {
+            return _slots[_tail % LOGGING_ISR_SLOTS].seq.load(std::memory_order_acquire) != _tail + 1;
+        }
+        uint32_t takeDropped() { return _dropped.exchange(0); }
+        bool acquire() { return !_expanding.exchange(true); }
+        void release() { _expanding.store(false); }
+
+    private:
+        static_assert((LOGGING_ISR_SLOTS & (LOGGING_ISR_SLOTS - 1)) == 0, "LOGGING_ISR_SLOTS must be a power of 2");
+        struct Slot
+        {
+            std::atomic<uint32_t> seq;
+            Record record;
+        };
+        Slot _slots[LOGGING_ISR_SLOTS];
+        std::atomic<uint32_t> _head{0};
+        uint32_t _tail = 0;
+        std::atomic<uint32_t> _dropped{0};
+        std::atomic<bool> _expanding{false};
+    } isrRing;
+
+    /**
+     * Single-producer single-consumer ring of log messages.
+     * Each record is a header with the message size and the ordering key, followed by the message itself.
+     * Producer and consumer positions run over twice the buffer size, to tell a full ring from an empty one.
+     */
+    class StagingRing
+    {
+    public:
+        ~StagingRing() { free(_buf); }
+        bool init(size_t size)
+        {
+            _size = size & ~3;
+            _buf = (uint8_t *)malloc(_size);
+            return _buf != nullptr;
+        }
+        size_t capacity() const { return _size; }
+        /**
+         * @return @c true if a message of @p size bytes fits in the ring when it's empty
+         */
+        bool fits(size_t size) const { return ((sizeof(Header) + size + 3) & ~3) <= _size; }
+        /**
+         * @return Number of bytes occupied by records that were not consumed yet
+         */
+        size_t used() const
+        {
+            auto head = _head.load(std::memory_order_acquire);
+            auto tail = _tail.load(std::memory_order_acquire);
+            return head >= tail ? head - tail : head + 2 * _size - tail;
+        }
+        /**
+         * @brief Producer side. Callers must make sure there's only one producer at a time.
+         */
+        bool push(const LogMessage *message, int64_t key)
+        {
+            size_t need = (sizeof(Header) + message->size() + 3) & ~3;
+            auto head = _head.load(std::memory_order_relaxed);
+            auto pos = head % _size;
+            auto contiguous = _size - pos;
+            // records don't wrap around, the tail of the buffer is skipped if it's too short
+            auto total = need > contiguous ? contiguous + need : need;
+            if (need > _size || _size - used() < total)
+                return false;
+            if (need > contiguous)
+            {
+                ((Header *)(_buf + pos))->size = Skip;
+                pos = 0;
+            }
+            auto h = (Header *)(_buf + pos);
+            h->size = message->size();
+            h->key = key;
+            memcpy(h + 1, message, message->size());
+            _head.store((head + total) % (2 * _size), std::memory_order_release);
+            return true;
+        }
+        /**
+         * @brief Consumer side: the oldest record, or @c nullptr if the ring is empty
+         */
+        LogMessage *peek(int64_t *key = nullptr)
+        {
+            auto tail = _tail.load(std::memory_order_relaxed);
+            if (tail == _head.load(std::memory_order_acquire))
+                return nullptr;
+            auto h = (Header *)(_buf + tail % _size);
+            if (h->size == Skip)
+            {
+                tail = (tail + _size - tail % _size) % (2 * _size);
+                _tail.store(tail, std::memory_order_release);
+                h = (Header *)_buf;
+            }
+            if (key)
+                *key = h->key;
+            return (LogMessage *)(h + 1);
+        }
+        /**
+         * @brief Consumer side: releases the record returned by @c peek()
+         */
+        void pop()
+        {
+            auto tail = _tail.load(std::memory_order_relaxed);
+            auto h = (Header *)(_buf + tail % _size);
+            size_t size = (sizeof(Header) + h->size + 3) & ~3;
+            _tail.store((tail + size) % (2 * _size), std::memory_order_release);
+        }
+        size_t tail() const { return _tail.load(std::memory_order_relaxed); }
+        /**
+         * @brief Reads the record without consuming it, see @c Logging::dumpPending(...).
+         * The ring is not trusted to be consistent, the producer or the consumer may have stopped anywhere.
+         * @param pos Position of the record, @c tail() for the oldest one. Advanced to the next record.
+         * @return @c nullptr at the end of the ring, or where the ring looks corrupted
+         */
+        const LogMessage *read(size_t &pos, int64_t *key) const
+        {
+            auto head = _head.load(std::memory_order_relaxed);
+            auto left = (head + 2 * _size - pos) % (2 * _size);
+            if (!_buf || !left || left > _size || pos % 4)
+                return nullptr;
+            auto h = (const Header *)(_buf + pos % _size);
+            if (h->size == Skip)
+            {
+                auto skipped = _size - pos % _size;
+                if (skipped >= left)
+                    return nullptr;
+                left -= skipped;
+                pos = (pos + skipped) % (2 * _size);
+                h = (const Header *)_buf;
+            }
+            size_t size = (sizeof(Header) + h->size + 3) & ~3;
+            if (h->size < sizeof(LogMessage) || size > left || size > _size - pos % _size)
+                return nullptr;
+            auto message = (const LogMessage *)(h + 1);
+            if (message->size() != h->size || !message->name())
+                return nullptr;
+            *key = h->key;
+            pos = (pos + size) % (2 * _size);
+            return message;
+        }
+
+    private:
+        struct Header
+        {
+            uint32_t size;
+            int64_t key;
+        } __attribute__((packed));
+        static const uint32_t Skip = 0xFFFFFFFF;
+        uint8_t *_buf = nullptr;
+        size_t _size = 0;
+        std::atomic<size_t> _head{0};
+        std::atomic<size_t> _tail{0};
+    };
+
+    /**
+     * Keeps messages in a ring until the appender can take them. The ring can be read by @c Logging::dumpPending(...) without taking locks.
+     * Buffered appenders are linked in a list for that, changed only while holding @c _appendersLock.
+     */
     class BufferedAppender : public LogAppender
     {
     public:
@@ -60,55 +1058,96 @@ namespace esp32m
             : _appender(appender), _autoRelease(autoRelease), _max_loop_item_sent(maxLoopItems)
         {
             _lock = xSemaphoreCreateMutex();
-            _handle = xRingbufferCreate(bufsize, RINGBUF_TYPE_NOSPLIT);
-            _item_to_be_sent = nullptr;
+            _ring = new StagingRing();
+            if (!_ring->init(bufsize))
+            {
+                delete _ring;
+                _ring = nullptr;
+            }
+            xSemaphoreTake(_appendersLock, portMAX_DELAY);
+            _next = _first;
+            _first = this;
+            xSemaphoreGive(_appendersLock);
         }
         ~BufferedAppender()
         {
+            xSemaphoreTake(_appendersLock, portMAX_DELAY);
+            for (auto p = &_first; *p; p = &(*p)->_next)
+                if (*p == this)
+                {
+                    *p = _next;
+                    break;
+                }
+            xSemaphoreGive(_appendersLock);
             release();
         }
+        /**
+         * @brief Writes the messages still in the buffers, oldest first, see @c Logging::dumpPending(...)
+         * @return Number of messages written
+         */
+        static size_t dump(size_t maxMessages, void (*write)(const LogMessage *))
+        {
+            size_t result = 0;
+            for (auto b = _first; b; b = b->_next)
+            {
+                auto ring = b->_ring;
+                if (!ring)
+                    continue;
+                int64_t key;
+                size_t total = 0;
+                for (auto pos = ring->tail(); ring->read(pos, &key);)
+                    total++;
+                auto skip = total > maxMessages ? total - maxMessages : 0;
+                auto pos = ring->tail();
+                while (auto message = ring->read(pos, &key))
+                    if (skip)
+                        skip--;
+                    else
+                    {
+                        write(message);
+                        result++;
+                    }
+            }
+            return result;
+        }
 
     protected:
         bool append(const LogMessage *message)
         {
-            if (!_handle) // No Ring Buffer = It has been released by autoRelease option
+            if (!_ring) // No Ring Buffer = It has been released by autoRelease option
                 return _appender.append(message);
 
-            size_t size;
             bool ok = false;
             bool append_result = false;
-            
+            LogMessage *item;
+
             // First always add message in ring buffer... always...
             if (message) {
                 for (;;) // BE CAREFUL... If this loop takes too much time and useQueue is in use : the WDG of Queue task could never be called...
                 {
                     xSemaphoreTake(_lock, portMAX_DELAY);
-                    if (xRingbufferSend(_handle, message, message->size(), 0))
+                    if (_ring->push(message, esp_timer_get_time()))
                     {
                         // Ok, message added to buffer.
+                        _pending += message->size();
                         xSemaphoreGive(_lock);
                         break;
                     }
-                    xSemaphoreGive(_lock);
                     // KO ! : No space left in buffer...
-                    
-                    if(!_item_to_be_sent) {
-                        // Retreive item to be sent from the ring buffer : the older one.
-                        xSemaphoreTake(_lock, portMAX_DELAY);
-                        _item_to_be_sent = (LogMessage *)xRingbufferReceive(_handle, &size, 0);
-                        xSemaphoreGive(_lock);
-                    }
-                    if (!_item_to_be_sent){
+                    // The item to be sent is the oldest one in the ring buffer, it stays there until it's sent
+                    item = _ring->peek();
+                    xSemaphoreGive(_lock);
+                    if (!item){
                         // No item in buffer.
                         // Warning : No space left in buffer... message to add to buffer is bigger than the full buffer size !
                         break;
                     }
 
-                    append_result = _appender.append(_item_to_be_sent); // Try to "send" item... last chance before loosing it due to buffer rotation!
+                    append_result = appended(_appender.append(item)); // Try to "send" item... last chance before loosing it due to buffer rotation!
                     xSemaphoreTake(_lock, portMAX_DELAY);
-                    vRingbufferReturnItem(_handle, _item_to_be_sent); // Here we remove item, even if it has not really been sent ! Free space in buffer...
+                    _pending -= item->size();
+                    _ring->pop(); // Here we remove item, even if it has not really been sent ! Free space in buffer...
                     xSemaphoreGive(_lock);
-                    _item_to_be_sent = nullptr; // Reset pointer, indicating the item has been removed from Ring buffer
                 }
             }
             else {
@@ -116,133 +1155,553 @@ namespace esp32m
             }
 
             // Second : try to flush the buffered items (in the FIFO order of course)
-            // If not possible, stop and keep the last not sent item in memory (_item_to_be_sent)
+            // If not possible, stop and keep the item not sent in the buffer for the next try
             // Limit the loop to _max_loop_item_sent to avoid too long loop in case of useQueue is in use (avoid WDG interrupt/reset)
             uint32_t max_loop_items_counter = _max_loop_item_sent ? _max_loop_item_sent : 0xFFFFFFFF;
             for(; max_loop_items_counter>0; max_loop_items_counter--)
             {
-                if(!_item_to_be_sent) {
-                    // Retreive item to be sent from the ring buffer
-                    xSemaphoreTake(_lock, portMAX_DELAY);
-                    _item_to_be_sent = (LogMessage *)xRingbufferReceive(_handle, &size, 0);
-                    xSemaphoreGive(_lock);
-                    if (!_item_to_be_sent){
-                        // No more item in buffer. All items sent.
-                        ok = true;
+                // Retreive item to be sent from the ring buffer
+                xSemaphoreTake(_lock, portMAX_DELAY);
+                item = _ring->peek();
+                xSemaphoreGive(_lock);
+                if (!item){
+                    // No more item in buffer. All items sent.
+                    ok = true;
+                    break;
+                }
+                append_result = appended(_appender.append(item));
+                if (!append_result) {
+                    // Item not sent ! Keep it in the buffer for next try...
+                    // Stop trying to send items for the moment... maybe appender is not ready.
+                    break;
+                }
+                // Ok, item has been sent by appender.
+                // Remove it from the buffer.
+                xSemaphoreTake(_lock, portMAX_DELAY);
+                _pending -= item->size();
+                _ring->pop();
+                xSemaphoreGive(_lock);
+            }
+            if (ok && _autoRelease)
+                release();
+            return true;
+        }
+
+        size_t pending()
+        {
+            return _pending + _appender.pending();
+        }
+    
+    private:
+        static BufferedAppender *_first;
+        BufferedAppender *_next;
+        LogAppender &_appender;
+        std::atomic<size_t> _pending{0};
+        bool _autoRelease;
+        StagingRing *_ring;
+        SemaphoreHandle_t _lock;
+        uint32_t _max_loop_item_sent;
+        void release()
+        {
+            if (!_lock)
+                return;
+            xSemaphoreTake(_lock, portMAX_DELAY);
+            auto ring = _ring;
+            // the panic dump reads the ring without the lock, it must not find it freed
+            _ring = nullptr;
+            delete ring;
+            _pending = 0;
+            xSemaphoreGive(_lock);
+            vSemaphoreDelete(_lock);
+            _lock = nullptr;
+        }
+    };
+
+    BufferedAppender *BufferedAppender::_first = nullptr;
+
+    /**
+     * Messages are queued in separate lanes by severity, so that a flood of verbose messages can't push errors out:
+     * lane 0 for errors and warnings, lane 1 for info, lane 2 for debug and verbose.
+     * Every lane has a staging ring per CPU core. Producers only contend with the tasks running on the same core,
+     * and the queue task merges the rings of a lane in the order the messages were enqueued.
+     * The queue task drains lanes in weighted rounds, and lower lanes start shedding messages before the queue is full.
+     */
+    class LogQueue
+    {
+    public:
+        LogQueue(size_t bufsize, uint32_t autoFlushPeriod)
+            : _flush_period_ms(autoFlushPeriod), _bufsize(bufsize)
+        {
+            _stopped = xSemaphoreCreateBinary();
+            for (int c = 0; c < portNUM_PROCESSORS; c++)
+            {
+                _cores[c].lock = portMUX_INITIALIZER_UNLOCKED;
+                _lanes[0].rings[c].init(bufsize * 3 / 8 / portNUM_PROCESSORS);
+                _lanes[1].rings[c].init(bufsize * 3 / 8 / portNUM_PROCESSORS);
+                _lanes[2].rings[c].init(bufsize / 4 / portNUM_PROCESSORS);
+                for (auto &lane : _lanes)
+                    _cores[c].capacity += lane.rings[c].capacity();
+            }
+            xTaskCreate([](void *self) { ((LogQueue *)self)->run(); }, "esp32m::log-queue", 4096, this, tskIDLE_PRIORITY, &_task);
+            logQueue = this;
+        }
+        ~LogQueue()
+        {
+            // new messages go straight to the appenders. Producers still waiting for room get it from the running task,
+            // once they are done, the task dispatches what's left in the queue and exits
+            QueueRef::detach();
+            _stop = true;
+            xTaskNotifyGive(_task);
+            if (!xSemaphoreTake(_stopped, pdMS_TO_TICKS(StopTimeoutMs)))
+            {
+                // an appender is stuck, give up on the remaining messages.
+                // The task is not deleted, it may be holding the appenders snapshot, and it's subscribed to the watchdog
+                _discard = true;
+                xSemaphoreTake(_stopped, portMAX_DELAY);
+            }
+            vSemaphoreDelete(_stopped);
+        }
+        /**
+         * @return @c false if the message is larger than the rings of its lane, and can never be queued
+         */
+        bool fits(const LogMessage *message) const
+        {
+            return _lanes[laneOf(message->level())].rings[0].fits(message->size());
+        }
+        bool enqueue(const LogMessage *message)
+        {
+            auto l = laneOf(message->level());
+            auto &lane = _lanes[l];
+            if (!lane.rings[0].fits(message->size()))
+            {
+                // waiting for room wouldn't help
+                lane.shed++;
+                return false;
+            }
+            auto key = esp_timer_get_time();
+            // debug never waits for room in its lane, info and errors wait up to 10 ticks
+            for (int attempt = 0; attempt <= (l == 2 ? 0 : 10); attempt++)
+            {
+                if (attempt)
+                    vTaskDelay(1);
+                auto c = xPortGetCoreID();
+                auto &core = _cores[c];
+                bool result = false;
+                portENTER_CRITICAL(&core.lock);
+                // under pressure, debug is shed at 3/4 of this core's queue capacity and info at 7/8, errors always get their chance
+                if (!l || used(c) + message->size() < (l == 1 ? core.capacity * 7 / 8 : core.capacity * 3 / 4))
+                    result = lane.rings[c].push(message, key);
+                portEXIT_CRITICAL(&core.lock);
+                if (result)
+                {
+                    // the queue task announces when it's about to sleep, wake it up only then
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (_sleeping.load(std::memory_order_relaxed))
+                        xTaskNotifyGive(_task);
+                    return true;
+                }
+            }
+            lane.shed++;
+            return false;
+        }
+        /**
+         * @return Number of bytes enqueued but not yet dispatched to all appenders
+         */
+        size_t pending() const
+        {
+            size_t result = 0;
+            for (int c = 0; c < portNUM_PROCESSORS; c++)
+                result += used(c);
+            return result;
+        }
+        /**
+         * @return How full the queue is, in percent
+         */
+        uint8_t occupancy() const
+        {
+            size_t capacity = 0;
+            for (auto &core : _cores)
+                capacity += core.capacity;
+            return capacity ? pending() * 100 / capacity : 0;
+        }
+        /**
+         * @brief Wakes the queue task up if it's waiting for messages, may be called from the interrupt handler
+         */
+        IRAM_ATTR void wake()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!_sleeping.load(std::memory_order_relaxed))
+                return;
+            if (xPortInIsrContext())
+            {
+                BaseType_t woken = pdFALSE;
+                vTaskNotifyGiveFromISR(_task, &woken);
+                if (woken)
+                    portYIELD_FROM_ISR();
+            }
+            else
+                xTaskNotifyGive(_task);
+        }
+        /**
+         * @brief Passes the most recent @p maxMessages messages to @p write, oldest first, without consuming them
+         * @return Number of messages passed
+         */
+        size_t dump(size_t maxMessages, void (*write)(const LogMessage *))
+        {
+            struct Cursor
+            {
+                const StagingRing *ring;
+                size_t pos;
+                const LogMessage *message;
+                int64_t key;
+            } cursors[3 * portNUM_PROCESSORS];
+            size_t total = 0, n = 0;
+            for (auto &lane : _lanes)
+                for (auto &ring : lane.rings)
+                {
+                    auto &c = cursors[n++];
+                    c.ring = &ring;
+                    c.pos = ring.tail();
+                    for (auto pos = c.pos; ring.read(pos, &c.key);)
+                        total++;
+                    c.message = ring.read(c.pos, &c.key);
+                }
+            auto skip = total > maxMessages ? total - maxMessages : 0;
+            size_t result = 0;
+            for (;;)
+            {
+                Cursor *oldest = nullptr;
+                for (auto &c : cursors)
+                    if (c.message && (!oldest || c.key < oldest->key))
+                        oldest = &c;
+                if (!oldest)
+                    break;
+                if (skip)
+                    skip--;
+                else
+                {
+                    write(oldest->message);
+                    result++;
+                }
+                oldest->message = oldest->ring->read(oldest->pos, &oldest->key);
+            }
+            return result;
+        }
+        /**
+         * @brief Makes the queue task ask appenders to flush their buffers as soon as the queue is empty
+         */
+        void requestFlush()
+        {
+            _flushRequested = true;
+            xTaskNotifyGive(_task);
+        }
+
+    private:
+        static const uint32_t StopTimeoutMs = 1000;
+        struct Lane
+        {
+            StagingRing rings[portNUM_PROCESSORS];
+            std::atomic<uint32_t> shed{0};
+        };
+        struct Core
+        {
+            portMUX_TYPE lock;
+            size_t capacity = 0;
+        };
+        // number of messages taken from each lane per round
+        const uint8_t Weights[3] = {4, 2, 1};
+        uint32_t _flush_period_ms;
+        size_t _bufsize;
+        SemaphoreHandle_t _stopped;
+        Lane _lanes[3];
+        Core _cores[portNUM_PROCESSORS];
+        TaskHandle_t _task = nullptr;
+        std::atomic<bool> _sleeping{false};
+        volatile bool _flushRequested = false;
+        volatile bool _stop = false;
+        volatile bool _discard = false;
+        friend class Logging;
+        static int laneOf(LogLevel level)
+        {
+            return level <= LogLevel::Warning ? 0 : (level == LogLevel::Info ? 1 : 2);
+        }
+        size_t used(int core) const
+        {
+            size_t result = 0;
+            for (auto &lane : _lanes)
+                result += lane.rings[core].used();
+            return result;
+        }
+        /**
+         * @return Ring of the lane with the oldest message, or @c nullptr if the lane is empty
+         */
+        StagingRing *oldest(Lane &lane)
+        {
+            StagingRing *result = nullptr;
+            int64_t min = 0;
+            for (auto &ring : lane.rings)
+            {
+                int64_t key;
+                if (ring.peek(&key) && (!result || key < min))
+                {
+                    result = &ring;
+                    min = key;
+                }
+            }
+            return result;
+        }
+        void nudge()
+        {
+            Appenders appenders;
+            for (auto appender : appenders)
+                //TODO : Loop only on "Buffered" Appenders ?
+                appender->append(nullptr); // nullptr ! Just to "flush" BufferedAppenders
+        }
+        void reportShed()
+        {
+            uint32_t shed[3];
+            for (int i = 0; i < 3; i++)
+                shed[i] = _lanes[i].shed.exchange(0);
+            if (shed[0] || shed[1] || shed[2])
+                Logging::system().logf(LogLevel::Warning, "log queue overflow, dropped %u error/warning, %u info, %u debug/verbose messages", shed[0], shed[1], shed[2]);
+        }
+        bool drain()
+        {
+            bool any = Logger::expandIsr();
+            for (int i = 0; i < 3; i++)
+                for (int w = 0; w < Weights[i] && !_discard; w++)
+                {
+                    auto ring = oldest(_lanes[i]);
+                    if (!ring)
                         break;
-                    }
+                    auto item = ring->peek();
+                    Appenders appenders;
+                    for (auto appender : appenders)
+                        appended(appender->append(item));
+                    ring->pop();
+                    any = true;
                 }
-                else {
-                    // There is already an item waiting to be sent... (not sent last time)
+            return any;
+        }
+        void run()
+        {
+            const TickType_t ticks_timeout = _flush_period_ms ? (TickType_t)(_flush_period_ms/portTICK_PERIOD_MS) : 100;
+            esp_task_wdt_add(nullptr);
+            for (;;)
+            {
+                esp_task_wdt_reset();
+                if (_discard)
+                    break;
+                if (drain())
+                {
+                    yield();
+                    continue;
                 }
-                append_result = _appender.append(_item_to_be_sent);
-                if (!append_result) {
-                    // Item not sent ! Keep it in memory for next try... Do not remove it from buffer !
-                    // Stop trying to send items for the moment... maybe appender is not ready.
+                reportShed();
+                // the level is restored even if nothing is logged
+                govern();
+                if (_stop)
                     break;
+                if (_flushRequested)
+                {
+                    _flushRequested = false;
+                    nudge();
+                    continue;
                 }
-                // Ok, item has been sent by appender.
-                // Remove it from the buffer.
-                xSemaphoreTake(_lock, portMAX_DELAY);
-                vRingbufferReturnItem(_handle, _item_to_be_sent);
-                xSemaphoreGive(_lock);
-                _item_to_be_sent = nullptr; // Reset pointer, indicating the item has been sent.
+                _sleeping.store(true);
+                // a producer might have pushed before seeing the flag
+                auto idle = !pending() && isrRing.empty();
+                if (idle && !ulTaskNotifyTake(pdTRUE, ticks_timeout) && _flush_period_ms)
+                    nudge();
+                _sleeping.store(false);
             }
-            if (ok && _autoRelease)
-                release();
-            return true;
+            esp_task_wdt_delete(nullptr);
+            xSemaphoreGive(_stopped);
+            vTaskDelete(nullptr);
         }
-    
-    private:
-        LogAppender &_appender;
-        bool _autoRelease;
-        RingbufHandle_t _handle;
-        SemaphoreHandle_t _lock;
-        LogMessage *_item_to_be_sent;
-        uint32_t _max_loop_item_sent;
-        void release()
+    };
+
+    /**
+     * Panic dump, see Logging::dumpPending(...).
+     * Nothing here may take a lock or allocate memory, the heap or the lock owner may be the reason of the panic.
+     */
+    const uint32_t PanicMagic = 0x50474F4C; // "LOGP"
+    const size_t PanicSectorSize = 4096;
+    struct PanicHeader
+    {
+        uint32_t magic;
+        uint32_t length;
+    };
+    const esp_partition_t *_panicPartition = nullptr;
+    size_t _panicOffset = 0;
+    // sectors are erased as the dump grows, there's no time to erase the whole partition
+    size_t _panicErased = 0;
+    volatile bool _panicDumping = false;
+
+    char *panicUnsigned(char *p, uint64_t value, int width = 0)
+    {
+        char tmp[20];
+        int n = 0;
+        do
+        {
+            tmp[n++] = '0' + value % 10;
+            value /= 10;
+        } while (value || n < width);
+        while (n)
+            *p++ = tmp[--n];
+        return p;
+    }
+
+    void panicPut(const char *s, size_t len)
+    {
+        for (size_t i = 0; i < len; i++)
+            platform_write_char_uart(s[i]);
+        if (!_panicPartition || _panicOffset >= _panicPartition->size - sizeof(PanicHeader))
+            return;
+        if (len > _panicPartition->size - sizeof(PanicHeader) - _panicOffset)
+            len = _panicPartition->size - sizeof(PanicHeader) - _panicOffset;
+        auto end = sizeof(PanicHeader) + _panicOffset + len;
+        if (end > _panicErased)
         {
-            if (!_handle)
+            auto size = (end - _panicErased + PanicSectorSize - 1) / PanicSectorSize * PanicSectorSize;
+            if (size > _panicPartition->size - _panicErased)
+                size = _panicPartition->size - _panicErased;
+            if (esp_partition_erase_range(_panicPartition, _panicErased, size) != ESP_OK)
+            {
+                _panicPartition = nullptr;
                 return;
-            xSemaphoreTake(_lock, portMAX_DELAY);
-            vRingbufferDelete(_handle);
-            xSemaphoreGive(_lock);
-            _handle = nullptr;
-            vSemaphoreDelete(_lock);
+            }
+            _panicErased += size;
         }
-    };
-
-    class LogQueue;
-    LogQueue *logQueue = nullptr;
+        if (esp_partition_write(_panicPartition, sizeof(PanicHeader) + _panicOffset, s, len) == ESP_OK)
+            _panicOffset += len;
+    }
 
-    class LogQueue
+    /**
+     * @brief Renders the message without printf(), which may allocate: time stamp in UTC, level, name and text, structured fields are omitted
+     */
+    void panicWrite(const LogMessage *message)
     {
-    public:
-        LogQueue(size_t bufsize, uint32_t autoFlushPeriod)
-            : _bufsize(bufsize), _flush_period_ms(autoFlushPeriod)
+        static const char *levels = "??EWIDV";
+        char buf[192];
+        auto p = buf;
+        auto stamp = message->stamp();
+        if (stamp < 0)
         {
-            _lock = xSemaphoreCreateMutex();
-            _buf = xRingbufferCreate(bufsize, RINGBUF_TYPE_NOSPLIT);
-            xTaskCreate([](void *self) { ((LogQueue *)self)->run(); }, "esp32m::log-queue", 4096, this, tskIDLE_PRIORITY, &_task);
-            logQueue = this;
+            stamp = -stamp;
+            time_t now = stamp / 1000;
+            struct tm t;
+            gmtime_r(&now, &t);
+            p = panicUnsigned(p, t.tm_year + 1900);
+            *p++ = '-';
+            p = panicUnsigned(p, t.tm_mon + 1, 2);
+            *p++ = '-';
+            p = panicUnsigned(p, t.tm_mday, 2);
+            *p++ = ' ';
+            p = panicUnsigned(p, t.tm_hour, 2);
+            *p++ = ':';
+            p = panicUnsigned(p, t.tm_min, 2);
+            *p++ = ':';
+            p = panicUnsigned(p, t.tm_sec, 2);
         }
-        ~LogQueue()
+        else
         {
-            xSemaphoreTake(_lock, portMAX_DELAY);
-            vTaskDelete(_task);
-            vRingbufferDelete(_buf);
-            logQueue = nullptr;
-            xSemaphoreGive(_lock);
-            vSemaphoreDelete(_lock);
+            auto seconds = stamp / 1000;
+            p = panicUnsigned(p, seconds / 86400);
+            *p++ = ':';
+            p = panicUnsigned(p, seconds / 3600 % 24, 2);
+            *p++ = ':';
+            p = panicUnsigned(p, seconds / 60 % 60, 2);
+            *p++ = ':';
+            p = panicUnsigned(p, seconds % 60, 2);
         }
-        bool enqueue(const LogMessage *message)
+        *p++ = '.';
+        p = panicUnsigned(p, stamp % 1000, 4);
+        *p++ = ' ';
+        auto level = message->level();
+        *p++ = level >= 0 && level < 7 ? levels[level] : '?';
+        *p++ = ' ';
+        auto end = buf + sizeof(buf) - 1;
+        for (auto s = message->name(); *s && p < end - 2; s++)
+            *p++ = *s;
+        *p++ = ' ';
+        *p++ = ' ';
+        auto s = message->message();
+        for (size_t i = 0; i + 1 < message->message_size() && p < end; i++)
+            *p++ = s[i];
+        *p++ = '\n';
+        panicPut(buf, p - buf);
+    }
+
+    size_t Logging::dumpPending(size_t maxMessages)
+    {
+        // the panic handler can't wait for a grace period, the queue is read as it is
+        auto queue = logQueue.load();
+        // a panic while dumping must not start over
+        if (_panicDumping)
+            return 0;
+        _panicDumping = true;
+        _panicOffset = 0;
+        _panicErased = 0;
+        if (_panicPartition)
         {
-            xSemaphoreTake(_lock, portMAX_DELAY);
-            auto result = xRingbufferSend(_buf, message, message->size(), 10);
-            xSemaphoreGive(_lock);
-            return result;
+            // the other core may be stopped while holding the flash lock, bypass the OS like the core dump does
+            spi_flash_guard_set(&g_flash_guard_no_os_ops);
+            esp_flash_app_disable_protect(true);
+        }
+        static const char header[] = "\n--- log messages not delivered before the panic ---\n";
+        static const char footer[] = "--- end of undelivered log messages ---\n";
+        panicPut(header, sizeof(header) - 1);
+        // the buffered messages were dispatched before the ones still in the queue
+        auto result = BufferedAppender::dump(maxMessages, panicWrite);
+        if (queue)
+            result += queue->dump(maxMessages, panicWrite);
+        panicPut(footer, sizeof(footer) - 1);
+        // the header goes last, the dump is only valid if it has been written completely
+        if (_panicPartition)
+        {
+            PanicHeader h = {PanicMagic, (uint32_t)_panicOffset};
+            esp_partition_write(_panicPartition, 0, &h, sizeof(h));
         }
+        _panicDumping = false;
+        return result;
+    }
 
-    private:
-        uint32_t _flush_period_ms;
-        size_t _bufsize;
-        SemaphoreHandle_t _lock;
-        RingbufHandle_t _buf;
-        TaskHandle_t _task = nullptr;
-        friend class Logging;
-        void run()
+    bool Logging::usePanicPartition(const char *label)
+    {
+        auto partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        if (!partition || partition->size <= sizeof(PanicHeader))
+            return false;
+        PanicHeader h;
+        if (esp_partition_read(partition, 0, &h, sizeof(h)) == ESP_OK && h.magic == PanicMagic && h.length <= partition->size - sizeof(h))
         {
-            const TickType_t ticks_timeout = _flush_period_ms ? (TickType_t)(_flush_period_ms/portTICK_PERIOD_MS) : 100;
-            esp_task_wdt_add(nullptr);
-            for (;;)
+            char chunk[64];
+            char line[256];
+            size_t len = 0;
+            for (size_t offset = 0; offset < h.length; offset += sizeof(chunk))
             {
-                esp_task_wdt_reset();
-                size_t size;
-                LogMessage *item = (LogMessage *)xRingbufferReceive(_buf, &size, ticks_timeout);
-                if (item)
+                auto n = h.length - offset < sizeof(chunk) ? h.length - offset : sizeof(chunk);
+                if (esp_partition_read(partition, sizeof(h) + offset, chunk, n) != ESP_OK)
+                    break;
+                for (size_t i = 0; i < n; i++)
                 {
-                    LogAppender *appender = _appenders;
-                    while (appender)
+                    if (chunk[i] != '\n' && len < sizeof(line) - 1)
+                        line[len++] = chunk[i];
+                    else if (chunk[i] == '\n')
                     {
-                        appender->append(item);
-                        appender = appender->_next;
+                        line[len] = '\0';
+                        if (len && strncmp(line, "---", 3))
+                            system().logf(LogLevel::Warning, "before the crash: %s", line);
+                        len = 0;
                     }
-                    vRingbufferReturnItem(_buf, item);
                 }
-                else if(_flush_period_ms) {
-                    LogAppender *appender = _appenders;
-                    while (appender)
-                    {
-                        //TODO : Loop only on "Buffered" Appenders ?
-                        appender->append(nullptr); // nullptr ! Just to "flush" BufferedAppenders
-                        appender = appender->_next;
-                    }
-                }
-                else {}
-                yield();
             }
+            // the dump is replayed only once
+            esp_partition_erase_range(partition, 0, PanicSectorSize);
         }
-    };
+        _panicPartition = partition;
+        return true;
+    }
 
     int64_t timeOrUptime()
     {
@@ -255,26 +1714,56 @@ namespace esp32m
         return esp_timer_get_time() / 1000;
     }
 
-    char *format(const LogMessage *msg)
+    portMUX_TYPE _stampLock = portMUX_INITIALIZER_UNLOCKED;
+    time_t _stampSecond = -1;
+    char _stampText[32];
+
+    LogSegments::~LogSegments()
+    {
+        logFree(_heap);
+    }
+
+    void LogSegments::add(const char *data, size_t len)
+    {
+        _segments[_count].data = data;
+        _segments[_count].len = len;
+        _count++;
+    }
+
+    bool LogSegments::render(const LogMessage *msg)
     {
         static const char *levels = "??EWIDV";
+        logFree(_heap);
+        _heap = nullptr;
+        _count = 0;
         if (!msg)
-            return nullptr;
+            return false;
         auto stamp = msg->stamp();
-        char *buf = nullptr;
         auto level = msg->level();
-        auto name = msg->name();
         char l = level >= 0 && level < 7 ? levels[level] : '?';
+        int len;
         if (stamp < 0)
         {
             stamp = -stamp;
-            char strftime_buf[32];
+            char strftime_buf[sizeof(_stampText)];
             time_t now = stamp / 1000;
-            struct tm timeinfo;
-            localtime_r(&now, &timeinfo);
-            strftime(strftime_buf, sizeof(strftime_buf), "%F %T", &timeinfo);
-            buf = (char *)malloc(strlen(strftime_buf) + 1 /*dot*/ + 4 /*millis*/ + 1 /*space*/ + 1 /*level*/ + 1 /*space*/ + strlen(name) + 2 /*spaces*/ + msg->message_size() + 1 /*zero*/);
-            sprintf(buf, "%s.%04d %c %s  %s", strftime_buf, (int)(stamp % 1000), l, name, msg->message());
+            // localtime_r() and strftime() cost more than the rest of the message, and the result only changes once a second
+            portENTER_CRITICAL(&_stampLock);
+            bool cached = now == _stampSecond;
+            if (cached)
+                memcpy(strftime_buf, _stampText, sizeof(strftime_buf));
+            portEXIT_CRITICAL(&_stampLock);
+            if (!cached)
+            {
+                struct tm timeinfo;
+                localtime_r(&now, &timeinfo);
+                strftime(strftime_buf, sizeof(strftime_buf), "%F %T", &timeinfo);
+                portENTER_CRITICAL(&_stampLock);
+                memcpy(_stampText, strftime_buf, sizeof(_stampText));
+                _stampSecond = now;
+                portEXIT_CRITICAL(&_stampLock);
+            }
+            len = snprintf(_prefix, sizeof(_prefix), "%s.%04d %c ", strftime_buf, (int)(stamp % 1000), l);
         }
         else
         {
@@ -286,78 +1775,655 @@ namespace esp32m
             stamp /= 60;
             int hours = stamp % 24;
             int days = stamp / 24;
-            buf = (char *)malloc(6 /*days*/ + 1 /*colon*/ + 2 /*hours*/ + 1 /*colon*/ + 2 /*minutes*/ + 1 /*colon*/ + 2 /*seconds*/ + 1 /*colon*/ + 4 /*millis*/ + 1 /*space*/ + 1 /*level*/ + 1 /*space*/ + strlen(name) + 2 /*spaces*/ + msg->message_size() + 1 /*zero*/);
-            sprintf(buf, "%d:%02d:%02d:%02d.%04d %c %s  %s", days, hours, minutes, seconds, millis, l, name, msg->message());
+            len = snprintf(_prefix, sizeof(_prefix), "%d:%02d:%02d:%02d.%04d %c ", days, hours, minutes, seconds, millis, l);
+        }
+        add(_prefix, len < (int)sizeof(_prefix) ? len : sizeof(_prefix) - 1);
+        auto name = msg->name();
+        add(name, strlen(name));
+        add("  ", 2);
+        add(msg->message(), strlen(msg->message()));
+        // structured fields and the context are rendered as " key=value" pairs after the message
+        auto fl = msg->fields_size() ? msg->renderFields(nullptr, 0, LogMessage::FieldsFormat::KeyValue) : 0;
+        auto cl = msg->renderContext(nullptr, 0, LogMessage::FieldsFormat::KeyValue);
+        auto sl = (fl ? 1 + fl : 0) + 1 + cl;
+        auto suffix = _suffix;
+        if (sl + 1 > sizeof(_suffix))
+        {
+            suffix = _heap = (char *)logAlloc(sl + 1);
+            if (!suffix)
+            {
+                _count = 0;
+                return false;
+            }
+        }
+        size_t sp = 0;
+        if (fl)
+        {
+            suffix[sp++] = ' ';
+            sp += msg->renderFields(suffix + sp, fl + 1, LogMessage::FieldsFormat::KeyValue);
+        }
+        suffix[sp++] = ' ';
+        sp += msg->renderContext(suffix + sp, cl + 1, LogMessage::FieldsFormat::KeyValue);
+        add(suffix, sp);
+        return true;
+    }
+
+    size_t LogSegments::length() const
+    {
+        size_t result = 0;
+        for (size_t i = 0; i < _count; i++)
+            result += _segments[i].len;
+        return result;
+    }
+
+    char *LogSegments::join() const
+    {
+        auto buf = (char *)logAlloc(length() + 1);
+        if (!buf)
+            return nullptr;
+        auto p = buf;
+        for (size_t i = 0; i < _count; i++)
+        {
+            memcpy(p, _segments[i].data, _segments[i].len);
+            p += _segments[i].len;
+        }
+        *p = '\0';
+        return buf;
+    }
+
+    char *format(const LogMessage *msg)
+    {
+        LogSegments segments;
+        return segments.render(msg) ? segments.join() : nullptr;
+    }
+
+    bool LogSegments::supports(LogMessageFormatter formatter)
+    {
+        return formatter == format;
+    }
+
+    FormattingAppender::FormattingAppender(LogMessageFormatter formatter)
+    {
+        _formatter = formatter == nullptr ? Logging::formatter() : formatter;
+    }
+
+    bool FormattingAppender::append(const LogMessage *message)
+    {
+        if (message && _formatter == format)
+        {
+            LogSegments segments;
+            return !segments.render(message) || this->append(segments);
+        }
+        auto str = _formatter(message);
+        if (!str)
+            return true;
+        auto result = this->append(str);
+        logFree(str);
+        return result;
+    }
+
+    bool FormattingAppender::append(const LogSegments &segments)
+    {
+        auto str = segments.join();
+        if (!str)
+            return true;
+        auto result = this->append(str);
+        logFree(str);
+        return result;
+    }
+
+    bool isEmpty(const char *s)
+    {
+        if (!s)
+            return true;
+        auto l = strlen(s);
+        if (!l)
+            return true;
+        for (int i = 0; i < l; i++)
+            if (!isspace(s[i]))
+                return false;
+        return true;
+    }
+
+    uint32_t uptimeMs()
+    {
+        return (uint32_t)(esp_timer_get_time() / 1000);
+    }
+
+    uint32_t hashMessage(const char *msg)
+    {
+        uint32_t h = 2166136261u;
+        while (*msg)
+        {
+            h ^= (uint8_t)*msg++;
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    /**
+     * @brief Call site of the text that doesn't come from a literal: line and stack buffers are shared by unrelated messages
+     */
+    const void *textSite(const char *text)
+    {
+        return text ? (const void *)(uintptr_t)hashMessage(text) : nullptr;
+    }
+
+    /**
+     * Token bucket of a single call site, identified by the logger and the format string.
+     * Sites hashing to the same slot share the bucket, the most recent one owns it. The new owner takes over the tokens,
+     * so that sites taking turns can't get a full burst each.
+     */
+    struct RateBucket
+    {
+        Logger *logger;
+        const void *site;
+        uint32_t tokens; // in 1/1000 of a token
+        uint32_t refilled;
+        uint16_t dropped;
+        uint8_t level; // of the most recent dropped message
+    };
+
+    const int RateBuckets = 32;
+    RateBucket _rateBuckets[RateBuckets] = {};
+    portMUX_TYPE _rateLock = portMUX_INITIALIZER_UNLOCKED;
+    // loggers holding back a "last message repeated" summary, those that don't fit emit it when they log again
+    const int RepeatSlots = 16;
+    Logger *_repeating[RepeatSlots] = {};
+    // summaries of quiet loggers are checked this often while there are any
+    const uint32_t SummaryPeriodMs = 100;
+    std::atomic<bool> _summariesArmed(false);
+
+    Logger::~Logger()
+    {
+        // summaries of this logger can't be emitted anymore
+        portENTER_CRITICAL(&_rateLock);
+        for (auto &slot : _repeating)
+            if (slot == this)
+                slot = nullptr;
+        for (auto &b : _rateBuckets)
+            if (b.logger == this)
+                memset(&b, 0, sizeof(b));
+        portEXIT_CRITICAL(&_rateLock);
+    }
+
+    void Logging::setRateLimit(uint16_t burst, uint16_t perSecond)
+    {
+        portENTER_CRITICAL(&_rateLock);
+        memset(_rateBuckets, 0, sizeof(_rateBuckets));
+        _rateBurst = burst;
+        _ratePerSecond = perSecond;
+        portEXIT_CRITICAL(&_rateLock);
+    }
+
+    // pressure is evaluated at most once per window, the level is restored one step after CalmMs without pressure
+    const uint32_t GovernorWindowMs = 100;
+    const uint32_t CalmMs = 2000;
+    // percent of the queue capacity, or of the appends that failed
+    const uint8_t HighPressure = 50;
+    const uint8_t LowPressure = 20;
+    std::atomic<uint32_t> _governorWindow{0};
+    uint32_t _calmSince = 0;
+
+    void Logging::setBackpressure(uint8_t maxSteps)
+    {
+        _backpressureSteps = maxSteps;
+        if (!maxSteps)
+            _throttle = 0;
+    }
+
+    void govern()
+    {
+        auto steps = _backpressureSteps.load(std::memory_order_relaxed);
+        if (!steps)
+            return;
+        auto now = uptimeMs();
+        auto window = _governorWindow.load(std::memory_order_relaxed);
+        // only one task evaluates the window
+        if (now - window < GovernorWindowMs || !_governorWindow.compare_exchange_strong(window, now))
+            return;
+        QueueRef queue;
+        uint8_t occupancy = queue ? queue->occupancy() : 0;
+        auto attempts = _appendAttempts.exchange(0);
+        auto failures = _appendFailures.exchange(0);
+        // a few failures of a quiet appender are not the pressure
+        uint8_t failed = attempts >= 8 ? failures * 100 / attempts : 0;
+        auto throttle = _throttle.load();
+        auto prev = throttle;
+        if (occupancy >= HighPressure || failed >= HighPressure)
+        {
+            _calmSince = now;
+            if (throttle < steps)
+                throttle++;
+        }
+        else if (occupancy >= LowPressure || failed >= LowPressure)
+            _calmSince = now;
+        else if (throttle && now - _calmSince >= CalmMs)
+        {
+            _calmSince = now;
+            throttle--;
+        }
+        if (throttle > steps)
+            throttle = steps;
+        if (throttle == prev)
+            return;
+        _throttle = throttle;
+        if (!prev)
+            Logging::system().logf(LogLevel::Warning, "log pipeline saturated (queue %u%%, %u%% appends failed), lowering verbosity", occupancy, failed);
+        else if (!throttle)
+            Logging::system().logf(LogLevel::Info, "log pipeline recovered, verbosity restored, %u messages suppressed", _throttled.exchange(0));
+    }
+
+#if LOGGING_PROFILE
+    /**
+     * Cost of a single call site, identified by the format string, or by a fixed label where the format isn't a literal
+     */
+    struct ProfileSite
+    {
+        const char *site;
+        uint32_t count;
+        uint64_t bytes;
+        uint64_t formatCycles;
+        uint64_t dispatchCycles;
+    };
+
+    ProfileSite _profileSites[LOGGING_PROFILE_SITES] = {};
+    uint32_t _profileOverflow = 0;
+    bool _profileDumping = false;
+    portMUX_TYPE _profileLock = portMUX_INITIALIZER_UNLOCKED;
+
+    void profile(const char *site, size_t bytes, uint32_t formatCycles, uint32_t dispatchCycles)
+    {
+        if (_profileDumping)
+            return;
+        auto i = ((uintptr_t)site >> 2) % LOGGING_PROFILE_SITES;
+        portENTER_CRITICAL(&_profileLock);
+        for (int probe = 0; probe < LOGGING_PROFILE_SITES; probe++, i = (i + 1) % LOGGING_PROFILE_SITES)
+        {
+            auto &p = _profileSites[i];
+            if (p.site && p.site != site)
+                continue;
+            p.site = site;
+            p.count++;
+            p.bytes += bytes;
+            p.formatCycles += formatCycles;
+            p.dispatchCycles += dispatchCycles;
+            portEXIT_CRITICAL(&_profileLock);
+            return;
+        }
+        _profileOverflow++;
+        portEXIT_CRITICAL(&_profileLock);
+    }
+
+    void Logging::dumpProfile(size_t topN)
+    {
+        // take a snapshot, so that reporting doesn't block the loggers and doesn't count itself
+        auto sites = (ProfileSite *)malloc(sizeof(_profileSites));
+        if (!sites)
+            return;
+        portENTER_CRITICAL(&_profileLock);
+        memcpy(sites, _profileSites, sizeof(_profileSites));
+        memset(_profileSites, 0, sizeof(_profileSites));
+        auto overflow = _profileOverflow;
+        _profileOverflow = 0;
+        portEXIT_CRITICAL(&_profileLock);
+        _profileDumping = true;
+        auto &logger = system();
+        logger.logf(LogLevel::Info, "log profile: top %u sites by cycles (count, bytes, format cycles, dispatch cycles)", topN);
+        for (size_t n = 0; n < topN; n++)
+        {
+            ProfileSite *top = nullptr;
+            for (auto &p : *(ProfileSite(*)[LOGGING_PROFILE_SITES])sites)
+                if (p.count && (!top || p.formatCycles + p.dispatchCycles > top->formatCycles + top->dispatchCycles))
+                    top = &p;
+            if (!top)
+                break;
+            logger.logf(LogLevel::Info, "%2u. %u %llu %llu %llu \"%.48s\"", n + 1, top->count, top->bytes, top->formatCycles, top->dispatchCycles, top->site);
+            top->count = 0;
+        }
+        if (overflow)
+            logger.logf(LogLevel::Info, "%u calls from untracked sites", overflow);
+        _profileDumping = false;
+        free(sites);
+    }
+#endif
+
+    bool Logger::enabled(LogLevel level) const
+    {
+        if (_generation != Logging::_levelsGeneration)
+            refreshLevel();
+        if (level > _effectiveLevel)
+            return false;
+        govern();
+        // under backpressure, the threshold is lowered by the number of steps taken, errors always pass
+        auto throttle = _throttle.load(std::memory_order_relaxed);
+        if (throttle && level > LogLevel::Error && level + throttle > _effectiveLevel)
+        {
+            _throttled.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    bool Logger::admit(LogLevel level, const void *site)
+    {
+        auto burst = Logging::_rateBurst;
+        if (!burst || level <= LogLevel::Error)
+            return true;
+        auto now = uptimeMs();
+        uint16_t dropped = 0, prevDropped = 0;
+        Logger *prev = nullptr;
+        LogLevel prevLevel = LogLevel::None;
+        bool result, arm = false;
+        auto &b = _rateBuckets[(((uintptr_t)this >> 2) ^ ((uintptr_t)site >> 2)) % RateBuckets];
+        portENTER_CRITICAL(&_rateLock);
+        if (!b.logger)
+            b.tokens = burst * 1000;
+        else
+        {
+            auto elapsed = now - b.refilled;
+            if (elapsed > 60000)
+                elapsed = 60000;
+            b.tokens += elapsed * Logging::_ratePerSecond;
+            if (b.tokens > burst * 1000u)
+                b.tokens = burst * 1000;
+        }
+        if (b.logger != this || b.site != site)
+        {
+            // the previous owner's summary goes out now, it has no bucket to wait in anymore
+            prev = b.logger;
+            prevDropped = b.dropped;
+            prevLevel = (LogLevel)b.level;
+            b.logger = this;
+            b.site = site;
+            b.dropped = 0;
+        }
+        b.refilled = now;
+        result = b.tokens >= 1000;
+        if (result)
+        {
+            b.tokens -= 1000;
+            dropped = b.dropped;
+            b.dropped = 0;
+        }
+        else
+        {
+            arm = !b.dropped;
+            if (b.dropped < 0xFFFF)
+                b.dropped++;
+            b.level = level;
+        }
+        portEXIT_CRITICAL(&_rateLock);
+        char buf[48];
+        if (prev && prevDropped)
+        {
+            snprintf(buf, sizeof(buf), "%u similar messages suppressed", prevDropped);
+            prev->send(prevLevel, buf);
+        }
+        if (dropped)
+        {
+            snprintf(buf, sizeof(buf), "%u similar messages suppressed", dropped);
+            send(level, buf);
+        }
+        if (arm)
+            armSummaries();
+        return result;
+    }
+
+    void Logger::log(LogLevel level, const char *msg)
+    {
+        if (!enabled(level) || !admit(level, textSite(msg)))
+            return;
+#if LOGGING_PROFILE
+        auto started = esp_cpu_get_ccount();
+        dispatch(level, msg);
+        profile("log()", strlen(msg), 0, esp_cpu_get_ccount() - started);
+#else
+        dispatch(level, msg);
+#endif
+    }
+
+    void Logger::dispatch(LogLevel level, const char *msg, const uint8_t *fields, size_t fieldsSize)
+    {
+        if (!fieldsSize && isEmpty(msg))
+            return;
+        auto window = Logging::_repeatWindow;
+        if (window)
+        {
+            auto now = uptimeMs();
+            auto hash = hashMessage(msg);
+            for (size_t i = 0; i < fieldsSize; i++)
+                hash = (hash ^ fields[i]) * 16777619u;
+            uint16_t repeated = 0;
+            LogLevel repeatedLevel;
+            portENTER_CRITICAL(&_rateLock);
+            bool same = _repeatStarted && hash == _repeatHash && level == _repeatLevel;
+            if (same && now - _repeatStarted < window && _repeatCount < 0xFFFF)
+            {
+                bool arm = false;
+                if (!_repeatCount++)
+                {
+                    Logger **free = nullptr;
+                    for (auto &slot : _repeating)
+                        if (slot == this)
+                        {
+                            free = nullptr;
+                            arm = true;
+                            break;
+                        }
+                        else if (!slot && !free)
+                            free = &slot;
+                    if (free)
+                    {
+                        *free = this;
+                        arm = true;
+                    }
+                }
+                portEXIT_CRITICAL(&_rateLock);
+                if (arm)
+                    armSummaries();
+                return;
+            }
+            repeated = _repeatCount;
+            repeatedLevel = (LogLevel)_repeatLevel;
+            _repeatHash = hash;
+            _repeatLevel = level;
+            _repeatStarted = now ? now : 1;
+            _repeatCount = 0;
+            portEXIT_CRITICAL(&_rateLock);
+            if (repeated)
+            {
+                char buf[48];
+                snprintf(buf, sizeof(buf), "last message repeated %u times", repeated);
+                send(repeatedLevel, buf);
+            }
         }
-        return buf;
-    }
-
-    FormattingAppender::FormattingAppender(LogMessageFormatter formatter)
-    {
-        _formatter = formatter == nullptr ? Logging::formatter() : formatter;
+        send(level, msg, fields, fieldsSize);
     }
 
-    bool FormattingAppender::append(const LogMessage *message)
+    void Logger::armSummaries()
     {
-        auto str = _formatter(message);
-        if (!str)
-            return true;
-        auto result = this->append(str);
-        free(str);
-        return result;
+        static esp_timer_handle_t timer = [] {
+            esp_timer_create_args_t args = {};
+            args.callback = [](void *) {
+                _summariesArmed = false;
+                if (expireSummaries())
+                    armSummaries();
+            };
+            args.name = "esp32m::log-summaries";
+            esp_timer_handle_t result = nullptr;
+            esp_timer_create(&args, &result);
+            return result;
+        }();
+        if (timer && !_summariesArmed.exchange(true))
+            esp_timer_start_once(timer, SummaryPeriodMs * 1000);
     }
 
-    bool isEmpty(const char *s)
+    bool Logger::expireSummaries()
     {
-        if (!s)
-            return true;
-        auto l = strlen(s);
-        if (!l)
-            return true;
-        for (int i = 0; i < l; i++)
-            if (!isspace(s[i]))
-                return false;
-        return true;
+        bool pending = false;
+        // one summary at a time, it's sent outside of the lock
+        for (;;)
+        {
+            Logger *logger = nullptr;
+            LogLevel level = LogLevel::None;
+            uint16_t count = 0;
+            bool repeated = false;
+            auto now = uptimeMs();
+            auto window = Logging::_repeatWindow;
+            pending = false;
+            portENTER_CRITICAL(&_rateLock);
+            for (auto &slot : _repeating)
+            {
+                if (!slot)
+                    continue;
+                if (!slot->_repeatCount)
+                    // the logger emitted the summary itself
+                    slot = nullptr;
+                else if (now - slot->_repeatStarted >= window)
+                {
+                    logger = slot;
+                    level = (LogLevel)logger->_repeatLevel;
+                    count = logger->_repeatCount;
+                    logger->_repeatCount = 0;
+                    repeated = true;
+                    slot = nullptr;
+                    break;
+                }
+                else
+                    pending = true;
+            }
+            if (!logger)
+                for (auto &b : _rateBuckets)
+                {
+                    if (!b.dropped)
+                        continue;
+                    auto elapsed = now - b.refilled;
+                    if (elapsed > 60000)
+                        elapsed = 60000;
+                    auto tokens = b.tokens + elapsed * Logging::_ratePerSecond;
+                    if (tokens < 1000)
+                    {
+                        pending = true;
+                        continue;
+                    }
+                    auto burst = Logging::_rateBurst * 1000u;
+                    b.tokens = tokens > burst ? burst : tokens;
+                    b.refilled = now;
+                    logger = b.logger;
+                    level = (LogLevel)b.level;
+                    count = b.dropped;
+                    b.dropped = 0;
+                    break;
+                }
+            portEXIT_CRITICAL(&_rateLock);
+            if (!logger)
+                return pending;
+            char buf[48];
+            snprintf(buf, sizeof(buf), repeated ? "last message repeated %u times" : "%u similar messages suppressed", count);
+            logger->send(level, buf);
+        }
     }
 
-    void Logger::log(LogLevel level, const char *msg)
+    void Logger::send(LogLevel level, const char *msg, const uint8_t *fields, size_t fieldsSize)
     {
-        if (isEmpty(msg))
-            return;
-        auto effectiveLevel = _level;
-        if (effectiveLevel == LogLevel::Default)
-            effectiveLevel = Logging::level();
-        if (level > effectiveLevel)
-            return;
+        // held until the message is in the queue, the queue can't go away while waiting for room
+        QueueRef queue;
+        // without the queue, messages from interrupt handlers are formatted by the next task that logs
+        if (!queue)
+            expandIsr();
         auto name = _loggable.logName();
-        LogMessage *message = LogMessage::alloc(level, timeOrUptime(), name, msg);
+        LogMessage *message = LogMessage::alloc(level, timeOrUptime(), name, msg, fields, fieldsSize);
         if (!message)
             return;
-        if (!_appenders)
+        Appenders appenders;
+        if (!appenders.count())
         {
             auto m = Logging::formatter()(message);
             if (m)
             {
                 ets_printf("%s\n", m);
-                free(m);
+                logFree(m);
             }
         }
         else
         {
-            LogQueue *queue = logQueue;
-            if (queue)
-                queue->enqueue(message);
+            // messages too large for the rings of their lane go straight to the appenders, whatever their level
+            if (queue && queue->fits(message))
+                appended(queue->enqueue(message));
             else
+                for (auto appender : appenders)
+                    appended(appender->append(message));
+        }
+        logFree(message);
+    }
+
+    IRAM_ATTR void Logger::isrEnqueue(LogLevel level, const char *format, const uint32_t *args, size_t count)
+    {
+        // level rules can't be looked up here, fall back to the global level if the cached one is stale
+        auto effectiveLevel = _level;
+        if (_generation == Logging::_levelsGeneration)
+            effectiveLevel = _effectiveLevel;
+        else if (effectiveLevel == LogLevel::Default)
+            effectiveLevel = Logging::_level;
+        if (!format || level > effectiveLevel)
+            return;
+        IsrRing::Record record;
+        record.logger = this;
+        record.format = format;
+        record.time = esp_timer_get_time();
+        record.level = level;
+        record.core = xPortGetCoreID();
+        for (size_t i = 0; i < LOGGING_ISR_ARGS; i++)
+            record.args[i] = i < count ? args[i] : 0;
+        if (!isrRing.push(record))
+            return;
+        QueueRef queue;
+        if (queue)
+            queue->wake();
+    }
+
+    bool Logger::expandIsr()
+    {
+        if (isrRing.empty() || !isrRing.acquire())
+            return false;
+        IsrRing::Record record;
+        while (isrRing.pop(record))
+        {
+            char buf[128];
+            auto a = record.args;
+            if (snprintf(buf, sizeof(buf), record.format, a[0], a[1], a[2], a[3]) < 0)
+                continue;
+            // the message is stamped with the time it was recorded, not the time it was formatted
+            auto stamp = timeOrUptime();
+            auto age = (esp_timer_get_time() - record.time) / 1000;
+            stamp = stamp < 0 ? stamp + age : stamp - age;
+            auto message = LogMessage::alloc(record.level, stamp, record.logger->_loggable.logName(), buf);
+            if (!message)
+                continue;
+            message->_task = 0;
+            message->_core = record.core;
+            message->_span = 0;
+            Appenders appenders;
+            if (!appenders.count())
             {
-                LogAppender *appender = _appenders;
-                while (appender)
+                auto m = Logging::formatter()(message);
+                if (m)
                 {
-                    appender->append(message);
-                    appender = appender->_next;
+                    ets_printf("%s\n", m);
+                    logFree(m);
                 }
             }
+            else
+                for (auto appender : appenders)
+                    appended(appender->append(message));
+            logFree(message);
         }
-        free(message);
+        isrRing.release();
+        auto dropped = isrRing.takeDropped();
+        if (dropped)
+            Logging::system().logf(LogLevel::Warning, "ISR log slots overflow, dropped %u messages", dropped);
+        return true;
     }
 
     void Logger::logf(LogLevel level, const char *format, ...)
@@ -372,21 +2438,41 @@ namespace esp32m
 
     void Logger::logf(LogLevel level, const char *format, va_list arg)
     {
-        if (!format)
+        vlogf(level, format, arg, format, format);
+    }
+
+    void Logger::vlogf(LogLevel level, const char *format, va_list arg, const void *site, const char *label)
+    {
+        if (!format || !enabled(level) || !admit(level, site))
             return;
-        char buf[64];
+#if LOGGING_PROFILE
+        auto started = esp_cpu_get_ccount();
+#endif
+        char buf[128];
         char *temp = buf;
-        auto len = vsnprintf(NULL, 0, format, arg);
+        va_list copy;
+        va_copy(copy, arg);
+        auto len = vsnprintf(buf, sizeof(buf), format, copy);
+        va_end(copy);
+        if (len < 0)
+            return;
         if (len >= sizeof(buf))
         {
-            temp = (char *)malloc(len + 1);
+            // only messages that don't fit in the stack buffer are rendered twice
+            temp = (char *)logAlloc(len + 1);
             if (temp == NULL)
                 return;
+            vsnprintf(temp, len + 1, format, arg);
         }
-        vsnprintf(temp, len + 1, format, arg);
-        log(level, temp);
-        if (len >= sizeof(buf))
-            free(temp);
+#if LOGGING_PROFILE
+        auto formatted = esp_cpu_get_ccount();
+        dispatch(level, temp);
+        profile(label, len, formatted - started, esp_cpu_get_ccount() - formatted);
+#else
+        dispatch(level, temp);
+#endif
+        if (temp != buf)
+            logFree(temp);
     }
 
     void Logging::addBufferedAppender(LogAppender *a, int bufsize, bool autoRelease, uint32_t maxLoopItems)
@@ -399,16 +2485,18 @@ namespace esp32m
     {
         if (!a)
             return;
-        LogAppender *appender = _appenders;
-        if (!appender)
-            _appenders = a;
-        else
+        xSemaphoreTake(_appendersLock, portMAX_DELAY);
+        auto current = _appenders.load();
+        auto count = current ? current->count : 0;
+        auto list = AppenderList::alloc(count + 1);
+        if (list)
         {
-            while (appender->_next)
-                appender = appender->_next;
-            appender->_next = a;
-            a->_prev = appender;
+            if (count)
+                memcpy(list->items(), current->items(), count * sizeof(LogAppender *));
+            list->items()[count] = a;
+            Appenders::replace(list);
         }
+        xSemaphoreGive(_appendersLock);
     }
 
     LogMessageFormatter Logging::formatter()
@@ -420,27 +2508,64 @@ namespace esp32m
     {
         if (!a)
             return;
-        LogAppender *appender = _appenders;
-        if (appender == a)
-            _appenders = nullptr;
-        else
-            while (appender)
+        xSemaphoreTake(_appendersLock, portMAX_DELAY);
+        auto current = _appenders.load();
+        auto count = current ? current->count : 0;
+        for (size_t i = 0; i < count; i++)
+            if (current->items()[i] == a)
             {
-                if (appender == a)
+                AppenderList *list = nullptr;
+                if (count > 1)
                 {
-                    if (a->_prev)
-                        a->_prev->_next = a->_next;
-                    if (a->_next)
-                        a->_next->_prev = a->_prev;
-                    break;
+                    list = AppenderList::alloc(count - 1);
+                    if (!list)
+                        break;
+                    memcpy(list->items(), current->items(), i * sizeof(LogAppender *));
+                    memcpy(list->items() + i, current->items() + i + 1, (count - i - 1) * sizeof(LogAppender *));
                 }
-                appender = appender->_next;
+                Appenders::replace(list);
+                break;
             }
+        xSemaphoreGive(_appendersLock);
+    }
+
+    size_t Logging::pending()
+    {
+        size_t result = 0;
+        QueueRef q;
+        if (!q)
+            Logger::expandIsr();
+        if (q)
+        {
+            result += q->pending() + (isrRing.empty() ? 0 : 1);
+            q->requestFlush();
+        }
+        Appenders appenders;
+        for (auto appender : appenders)
+        {
+            // without the queue, buffered appenders are flushed by the caller
+            if (!q)
+                appender->append(nullptr);
+            result += appender->pending();
+        }
+        return result;
+    }
+
+    size_t Logging::flush(uint32_t timeoutMs)
+    {
+        auto started = uptimeMs();
+        for (;;)
+        {
+            auto result = pending();
+            if (!result || uptimeMs() - started >= timeoutMs)
+                return result;
+            vTaskDelay(1);
+        }
     }
 
     void Logging::useQueue(int size, uint32_t autoFlushPeriod)
     {
-        auto q = logQueue;
+        auto q = logQueue.load();
         if (size)
         {
             if (q)
@@ -513,6 +2638,334 @@ namespace esp32m
         return l;
     }
 
+    /**
+     * Level rule set by @c Logging::setLevel(pattern, level), the pattern is stored without the trailing ".*"
+     */
+    struct LevelRule
+    {
+        char *pattern;
+        size_t len;
+        bool descendants;
+        LogLevel level;
+    };
+
+    LevelRule _levelRules[LOGGING_LEVEL_RULES] = {};
+
+    bool parseLevel(const char *str, size_t len, LogLevel &l)
+    {
+        static const char *names[] = {"none", nullptr, "error", "warning", "info", "debug", "verbose"};
+        if (len == 1)
+        {
+            if (toupper(*str) == 'N')
+            {
+                l = LogLevel::None;
+                return true;
+            }
+            return charToLevel(toupper(*str), l);
+        }
+        for (int i = 0; i < 7; i++)
+            if (names[i] && strlen(names[i]) == len && !strncasecmp(names[i], str, len))
+            {
+                l = (LogLevel)i;
+                return true;
+            }
+        return false;
+    }
+
+    /**
+     * @brief Adds, updates or removes the rule, @c _loggingLock must be held if @p rules are @c _levelRules
+     */
+    bool setLevelRule(LevelRule *rules, const char *pattern, size_t len, LogLevel level)
+    {
+        bool descendants = len >= 2 && !strncmp(pattern + len - 2, ".*", 2);
+        if (descendants)
+            len -= 2;
+        LevelRule *free = nullptr;
+        for (auto &rule : *(LevelRule(*)[LOGGING_LEVEL_RULES])rules)
+        {
+            if (!rule.pattern)
+            {
+                if (!free)
+                    free = &rule;
+                continue;
+            }
+            if (rule.len != len || rule.descendants != descendants || strncmp(rule.pattern, pattern, len))
+                continue;
+            if (level == LogLevel::Default)
+            {
+                ::free(rule.pattern);
+                rule.pattern = nullptr;
+            }
+            else
+                rule.level = level;
+            return true;
+        }
+        if (level == LogLevel::Default)
+            return true;
+        if (!free || !(free->pattern = strndup(pattern, len)))
+            return false;
+        free->len = len;
+        free->descendants = descendants;
+        free->level = level;
+        return true;
+    }
+
+    void clearLevelRules(LevelRule *rules)
+    {
+        for (auto &rule : *(LevelRule(*)[LOGGING_LEVEL_RULES])rules)
+        {
+            free(rule.pattern);
+            rule.pattern = nullptr;
+        }
+    }
+
+    /**
+     * @brief Parses pattern=level list into @p rules, and the level of the "*" pattern into @p global
+     */
+    bool parseLevels(const char *config, LogLevel &global, LevelRule *rules)
+    {
+        auto p = config;
+        while (*p)
+        {
+            while (*p == ',' || isspace((unsigned char)*p))
+                p++;
+            if (!*p)
+                break;
+            auto end = strchr(p, ',');
+            if (!end)
+                end = p + strlen(p);
+            auto eq = (const char *)memchr(p, '=', end - p);
+            if (!eq || eq == p)
+                return false;
+            auto pe = eq;
+            while (pe > p && isspace((unsigned char)pe[-1]))
+                pe--;
+            auto v = eq + 1;
+            while (v < end && isspace((unsigned char)*v))
+                v++;
+            auto ve = end;
+            while (ve > v && isspace((unsigned char)ve[-1]))
+                ve--;
+            LogLevel level;
+            if (!parseLevel(v, ve - v, level))
+                return false;
+            if (pe - p == 1 && *p == '*')
+                global = level;
+            else if (!setLevelRule(rules, p, pe - p, level))
+                return false;
+            p = end;
+        }
+        return true;
+    }
+
+    void Logging::levelsChanged()
+    {
+        auto generation = _levelsGeneration + 1;
+        _levelsGeneration = generation ? generation : 1;
+    }
+
+    void Logging::setLevel(LogLevel level)
+    {
+        xSemaphoreTake(_loggingLock, portMAX_DELAY);
+        _level = level;
+        levelsChanged();
+        xSemaphoreGive(_loggingLock);
+    }
+
+    bool Logging::setLevel(const char *pattern, LogLevel level)
+    {
+        if (!pattern)
+            return false;
+        if (!strcmp(pattern, "*"))
+        {
+            if (level != LogLevel::Default)
+                setLevel(level);
+            return true;
+        }
+        xSemaphoreTake(_loggingLock, portMAX_DELAY);
+        auto result = setLevelRule(_levelRules, pattern, strlen(pattern), level);
+        levelsChanged();
+        xSemaphoreGive(_loggingLock);
+        return result;
+    }
+
+    bool Logging::configureLevels(const char *config)
+    {
+        if (!config)
+            return false;
+        // the new rules are built aside, so that a malformed list or lack of memory leaves the current ones intact
+        LevelRule rules[LOGGING_LEVEL_RULES] = {};
+        auto global = LogLevel::Default;
+        if (!parseLevels(config, global, rules))
+        {
+            clearLevelRules(rules);
+            return false;
+        }
+        xSemaphoreTake(_loggingLock, portMAX_DELAY);
+        for (int i = 0; i < LOGGING_LEVEL_RULES; i++)
+        {
+            auto old = _levelRules[i];
+            _levelRules[i] = rules[i];
+            rules[i] = old;
+        }
+        if (global != LogLevel::Default)
+            _level = global;
+        levelsChanged();
+        xSemaphoreGive(_loggingLock);
+        clearLevelRules(rules);
+        return true;
+    }
+
+    void Logger::refreshLevel() const
+    {
+        uint32_t generation = Logging::_levelsGeneration;
+        auto level = _level;
+        if (level == LogLevel::Default)
+        {
+            auto name = _loggable.logName();
+            size_t best = 0;
+            xSemaphoreTake(_loggingLock, portMAX_DELAY);
+            level = Logging::_level;
+            if (name)
+                for (auto &rule : _levelRules)
+                {
+                    if (!rule.pattern || strncmp(name, rule.pattern, rule.len))
+                        continue;
+                    auto c = name[rule.len];
+                    if (c && !(rule.descendants && c == '.'))
+                        continue;
+                    // longer patterns are more specific, exact match beats descendants of the same name
+                    auto specificity = rule.len * 2 + (rule.descendants ? 1 : 2);
+                    if (specificity > best)
+                    {
+                        best = specificity;
+                        level = rule.level;
+                    }
+                }
+            xSemaphoreGive(_loggingLock);
+        }
+        _effectiveLevel = level;
+        _generation = generation;
+    }
+
+    /**
+     * Fixed table of per-task slots.
+     * A task claims a slot while it has unfinished state (e.g. a partial line) and releases it afterwards,
+     * so the table only needs as many slots as there are tasks that are in the middle of something at the same time.
+     * The slot contents are only touched by the owning task, no locking is required.
+     */
+    template <typename T, int N>
+    class TaskSlots
+    {
+    public:
+        TaskSlots() : _slots()
+        {
+            for (int i = 0; i < N; i++)
+                _owners[i].store(nullptr, std::memory_order_relaxed);
+        }
+        int size() const { return N; }
+        int indexOf(const T *slot) const { return slot - _slots; }
+        T *find(TaskHandle_t task)
+        {
+            for (int i = 0; i < N; i++)
+                if (_owners[i].load(std::memory_order_acquire) == task)
+                    return &_slots[i];
+            return nullptr;
+        }
+        T *claim(TaskHandle_t task)
+        {
+            auto slot = find(task);
+            if (slot)
+                return slot;
+            for (int i = 0; i < N; i++)
+            {
+                TaskHandle_t expected = nullptr;
+                if (_owners[i].compare_exchange_strong(expected, task, std::memory_order_acq_rel))
+                    return &_slots[i];
+            }
+            return nullptr;
+        }
+        void release(T *slot)
+        {
+            *slot = T();
+            _owners[slot - _slots].store(nullptr, std::memory_order_release);
+        }
+
+    private:
+        std::atomic<TaskHandle_t> _owners[N];
+        T _slots[N];
+    };
+
+    /**
+     * Loggers for ESP-IDF tags, created once per tag and never released while the hook is installed.
+     * Lookups are lock-free, insertions are serialized by @c _lock
+     */
+    class TagLoggers
+    {
+    public:
+        TagLoggers() : _entries(), _lock(xSemaphoreCreateMutex()) {}
+        ~TagLoggers()
+        {
+            vSemaphoreDelete(_lock);
+            for (int i = 0; i < Size; i++)
+            {
+                auto e = _entries[i].load(std::memory_order_relaxed);
+                if (e)
+                {
+                    free((void *)e->tag);
+                    delete e;
+                }
+            }
+        }
+        Logger &get(const char *tag)
+        {
+            if (!tag)
+                return Logging::system();
+            auto i = hashMessage(tag) % Size;
+            auto e = lookup(tag, i);
+            if (e)
+                return e->loggable.logger();
+            // not _loggingLock: creating the logger takes it
+            xSemaphoreTake(_lock, portMAX_DELAY);
+            e = lookup(tag, i);
+            if (!e)
+                for (int n = 0; n < Size; n++, i = (i + 1) % Size)
+                    if (!_entries[i].load(std::memory_order_relaxed))
+                    {
+                        auto t = strdup(tag);
+                        e = new Entry(t);
+                        e->loggable.logger();
+                        _entries[i].store(e, std::memory_order_release);
+                        break;
+                    }
+            xSemaphoreGive(_lock);
+            return e ? e->loggable.logger() : Logging::system();
+        }
+
+    private:
+        struct Entry
+        {
+            const char *tag;
+            SimpleLoggable loggable;
+            Entry(const char *t) : tag(t), loggable(t) {}
+        };
+        static const int Size = 32;
+        std::atomic<Entry *> _entries[Size];
+        SemaphoreHandle_t _lock;
+        Entry *lookup(const char *tag, uint32_t i)
+        {
+            for (int n = 0; n < Size; n++, i = (i + 1) % Size)
+            {
+                auto e = _entries[i].load(std::memory_order_acquire);
+                if (!e)
+                    break;
+                if (e->tag == tag || !strcmp(e->tag, tag))
+                    return e;
+            }
+            return nullptr;
+        }
+    };
+
     class Esp32Hook;
     Esp32Hook *_esp32Hook = nullptr;
 
@@ -531,36 +2984,104 @@ namespace esp32m
         }
 
     private:
+        /**
+         * State of a task between the header and the body of a message that ESP-IDF writes with two calls
+         */
+        struct Pending
+        {
+            Logger *logger;
+            LogLevel level;
+            uint8_t recursion;
+        };
         vprintf_like_t _prevLogger = nullptr;
-        uint8_t _recursion = 0;
-        const char *_pendingName = nullptr;
-        LogLevel _pendingLevel = LogLevel::None;
+        TaskSlots<Pending, 8> _tasks;
+        TagLoggers _loggers;
+
+        /**
+         * Matches the "L (%u) %s: " header of ESP-IDF log formats, optionally preceded by the color escape sequence
+         * @return Pointer to the remainder of the format, or @c nullptr if there's no header
+         */
+        static const char *matchHeader(const char *str, char &levelChar)
+        {
+            if (str[0] == '\033')
+            {
+                auto m = strchr(str, 'm');
+                if (!m)
+                    return nullptr;
+                str = m + 1;
+            }
+            if (!str[0] || str[1] != ' ' || str[2] != '(' || str[3] != '%')
+                return nullptr;
+            auto p = str + 4;
+            if (*p == 'l')
+                p++;
+            if ((*p != 'u' && *p != 'd') || strncmp(p + 1, ") %s:", 5))
+                return nullptr;
+            levelChar = str[0];
+            p += 6;
+            if (*p == ' ')
+                p++;
+            return p;
+        }
+
         static int esp32hook(const char *str, va_list arg)
         {
             auto h = _esp32Hook;
-            if (!h || h->_recursion)
+            if (!h)
                 return 0;
-            h->_recursion++;
-            if (h->_pendingName)
+            auto p = h->_tasks.claim(xTaskGetCurrentTaskHandle());
+            if (!p)
+                return h->_prevLogger ? h->_prevLogger(str, arg) : 0;
+            if (p->recursion)
+                return 0;
+            p->recursion++;
+            char lc;
+            const char *body;
+            if (p->logger)
             {
-                SimpleLoggable log(h->_pendingName);
-                log.logger().logf(h->_pendingLevel, str, arg);
-                h->_pendingLevel = LogLevel::None;
-                h->_pendingName = nullptr;
+                p->logger->vlogf(p->level, str, arg, str, "esp-idf");
+                p->logger = nullptr;
             }
             else if (!strcmp(str, "%c (%d) %s:"))
             {
-                charToLevel((char)va_arg(arg, int), h->_pendingLevel);
+                charToLevel((char)va_arg(arg, int), p->level);
                 va_arg(arg, long);
-                h->_pendingName = va_arg(arg, const char *);
+                p->logger = &h->_loggers.get(va_arg(arg, const char *));
+            }
+            else if ((body = matchHeader(str, lc)))
+            {
+                LogLevel level = LogLevel::Debug;
+                charToLevel(lc, level);
+                va_arg(arg, unsigned long);
+                auto &logger = h->_loggers.get(va_arg(arg, const char *));
+                if (*body)
+                {
+                    // drop the trailing color reset sequence
+                    char fmt[128];
+                    auto reset = strstr(body, "\033[0m");
+                    if (reset && reset - body < sizeof(fmt))
+                    {
+                        memcpy(fmt, body, reset - body);
+                        fmt[reset - body] = 0;
+                        body = fmt;
+                    }
+                    logger.vlogf(level, body, arg, body == fmt ? textSite(fmt) : body, "esp-idf");
+                }
+                else
+                {
+                    p->logger = &logger;
+                    p->level = level;
+                }
             }
             else
             {
                 const char *mptr = str;
                 auto level = detectLevel(&mptr);
-                Logging::system().logf(level, mptr, arg);
+                Logging::system().vlogf(level, mptr, arg, mptr, "esp-idf");
             }
-            h->_recursion--;
+            p->recursion--;
+            if (!p->logger)
+                h->_tasks.release(p);
             return strlen(str);
         }
     };
@@ -591,7 +3112,10 @@ namespace esp32m
         SerialHook(size_t bufsize)
         {
             _lock = xSemaphoreCreateMutex();
-            _serialBuf = (char *)malloc(_serialBufLen = bufsize);
+            _flushLock = xSemaphoreCreateMutex();
+            // a buffer per slot, the shared one, and the copy of the shared line being logged
+            _serialBuf = (char *)malloc(bufsize * (_lines.size() + 2));
+            _serialBufLen = _serialBuf ? bufsize : 0;
             serialHook = this;
             ets_install_putc1(hook);
         }
@@ -599,52 +3123,116 @@ namespace esp32m
         {
             ets_install_putc1(platform_write_char_uart);
             xSemaphoreTake(_lock, portMAX_DELAY);
+            xSemaphoreTake(_flushLock, portMAX_DELAY);
             free(_serialBuf);
             _serialBufLen = 0;
-            _serialBufPtr = 0;
             serialHook = nullptr;
+            xSemaphoreGive(_flushLock);
             xSemaphoreGive(_lock);
+            vSemaphoreDelete(_flushLock);
             vSemaphoreDelete(_lock);
         }
 
     private:
+        /**
+         * Partial line of a single task
+         */
+        struct Line
+        {
+            int ptr;
+            uint8_t recursion;
+        };
         static void hook(char c)
         {
             auto h = serialHook;
-            if (!h || h->_recursion)
+            if (!h)
                 return;
             h->hookImpl(c);
         }
         void hookImpl(char c)
         {
-            _recursion++;
-            xSemaphoreTake(_lock, portMAX_DELAY);
-            auto b = _serialBuf;
             auto bl = _serialBufLen;
-            if (b && bl)
+            if (!bl)
+                return;
+            auto task = xTaskGetCurrentTaskHandle();
+            auto line = _lines.find(task);
+            if (line && line->recursion)
+                return;
+            if (!line && (c == '\n' || c == '\r') && !_shared.ptr)
+                return; // nothing to flush
+            if (!line && (line = _lines.claim(task)))
             {
-                if (c == '\n' || _serialBufPtr >= bl - 1)
-                {
-                    b[_serialBufPtr] = 0;
-                    _serialBufPtr = 0;
-                    const char **mptr = (const char **)&b;
-                    auto level = detectLevel(mptr);
-                    xSemaphoreGive(_lock);
-                    Logging::system().log(level, *mptr);
-                    xSemaphoreTake(_lock, portMAX_DELAY);
-                }
-                if (c != '\n' && c != '\r')
-                    b[_serialBufPtr++] = c;
+                line->ptr = 0;
+                line->recursion = 0;
+            }
+            if (line)
+                append(line, _serialBuf + _lines.indexOf(line) * bl, bl, c);
+            else
+                appendShared(task, bl, c);
+        }
+        void append(Line *line, char *b, size_t bl, char c)
+        {
+            if (line->recursion)
+                return;
+            if (c == '\n' || line->ptr >= bl - 1)
+            {
+                b[line->ptr] = 0;
+                line->ptr = 0;
+                line->recursion++;
+                log(b);
+                line->recursion--;
+            }
+            store(line, b, c);
+        }
+        /**
+         * More tasks are writing partial lines than we have slots for, they share the last buffer
+         */
+        void appendShared(TaskHandle_t task, size_t bl, char c)
+        {
+            if (_sharedTask == task)
+                return; // output of the logger, while the shared line is being logged
+            xSemaphoreTake(_lock, portMAX_DELAY);
+            auto b = _serialBuf + _lines.size() * bl;
+            if ((c != '\n' && _shared.ptr < bl - 1) || !_shared.ptr)
+            {
+                store(&_shared, b, c);
+                xSemaphoreGive(_lock);
+                return;
             }
+            // the line is logged from a copy without holding _lock, the output of the logger may come back here
+            xSemaphoreTake(_flushLock, portMAX_DELAY);
+            auto copy = b + bl;
+            memcpy(copy, b, _shared.ptr);
+            copy[_shared.ptr] = 0;
+            _shared.ptr = 0;
+            store(&_shared, b, c);
             xSemaphoreGive(_lock);
-            _recursion--;
+            _sharedTask = task;
+            log(copy);
+            _sharedTask = nullptr;
+            xSemaphoreGive(_flushLock);
+        }
+        void store(Line *line, char *b, char c)
+        {
+            if (c != '\n' && c != '\r')
+                b[line->ptr++] = c;
+            else if (line != &_shared && !line->ptr)
+                _lines.release(line);
+        }
+        static void log(const char *line)
+        {
+            auto level = detectLevel(&line);
+            Logging::system().log(level, line);
         }
 
         SemaphoreHandle_t _lock;
+        // held while the copy of the shared line is being logged
+        SemaphoreHandle_t _flushLock;
+        volatile TaskHandle_t _sharedTask = nullptr;
         char *_serialBuf;
         size_t _serialBufLen;
-        int _serialBufPtr = 0;
-        uint8_t _recursion = 0;
+        TaskSlots<Line, 8> _lines;
+        Line _shared = {};
         friend class Logging;
     };
 
@@ -666,3 +3254,16 @@ namespace esp32m
     }
 
 } // namespace esp32m
+
+#if LOGGING_PANIC_HOOK
+extern "C" void __real_esp_panic_handler(void *info);
+
+/**
+ * Called in place of esp_panic_handler() when linked with -Wl,--wrap=esp_panic_handler
+ */
+extern "C" void __wrap_esp_panic_handler(void *info)
+{
+    esp32m::Logging::dumpPending();
+    __real_esp_panic_handler(info);
+}
+#endif
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/semphr.h>
+#include <esp32-hal.h>
+
+#include "metrics.hpp"
+
+namespace esp32m
+{
+
+    Metric *Metrics::_head = nullptr;
+    volatile uint32_t Metrics::_period = 0;
+    LogLevel Metrics::_level = LogLevel::Info;
+    TaskHandle_t Metrics::_task = nullptr;
+    uint32_t Metrics::_reported = 0;
+
+    /**
+     * Guards the list of metrics and serializes reports. Metrics may be constructed during static initialization,
+     * so the mutex is created on first use rather than by another static initializer.
+     */
+    SemaphoreHandle_t metricsLock()
+    {
+        static SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+        return lock;
+    }
+
+    bool encodeUInt(uint8_t *buf, size_t capacity, size_t &used, const char *key, uint32_t value)
+    {
+        return LogRecord::encode(buf, capacity, used, key, LogFieldType::UInt, &value, sizeof(value));
+    }
+
+    Metric::Metric(const char *name) : _name(name)
+    {
+        Metrics::add(this);
+    }
+
+    Metric::~Metric()
+    {
+        Metrics::remove(this);
+    }
+
+    void Counter::collect()
+    {
+        _reported = _value.exchange(0, std::memory_order_relaxed);
+    }
+
+    bool Counter::encode(uint8_t *buf, size_t capacity, size_t &used) const
+    {
+        return !_reported || encodeUInt(buf, capacity, used, name(), _reported);
+    }
+
+    void Gauge::collect()
+    {
+        _reported = _value.load(std::memory_order_relaxed);
+    }
+
+    bool Gauge::encode(uint8_t *buf, size_t capacity, size_t &used) const
+    {
+        int32_t value = _reported;
+        return LogRecord::encode(buf, capacity, used, name(), LogFieldType::Int, &value, sizeof(value));
+    }
+
+    Histogram::Histogram(const char *name, std::initializer_list<uint32_t> bounds) : Metric(name)
+    {
+        for (auto b : bounds)
+            if (_buckets < LOGGING_METRICS_BUCKETS)
+                _bounds[_buckets++] = b;
+        for (auto &c : _counts)
+            c.store(0, std::memory_order_relaxed);
+        memset(_reportedCounts, 0, sizeof(_reportedCounts));
+    }
+
+    void Histogram::record(uint32_t value)
+    {
+        // buckets are few, linear search is as fast as any
+        uint8_t i = 0;
+        while (i < _buckets && value > _bounds[i])
+            i++;
+        _counts[i].fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(value, std::memory_order_relaxed);
+        auto max = _max.load(std::memory_order_relaxed);
+        while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+            ;
+    }
+
+    void Histogram::collect()
+    {
+        // values recorded while collecting may be split between the intervals, but are never lost
+        for (uint8_t i = 0; i <= _buckets; i++)
+            _reportedCounts[i] = _counts[i].exchange(0, std::memory_order_relaxed);
+        _reportedSum = _sum.exchange(0, std::memory_order_relaxed);
+        _reportedMax = _max.exchange(0, std::memory_order_relaxed);
+    }
+
+    bool Histogram::encode(uint8_t *buf, size_t capacity, size_t &used) const
+    {
+        uint32_t count = 0;
+        for (uint8_t i = 0; i <= _buckets; i++)
+            count += _reportedCounts[i];
+        if (!count)
+            return true;
+        auto start = used;
+        char key[48];
+        bool result = true;
+        auto put = [&](const char *suffix, uint32_t value) {
+            snprintf(key, sizeof(key), "%s.%s", name(), suffix);
+            result = result && encodeUInt(buf, capacity, used, key, value);
+        };
+        put("count", count);
+        put("sum", _reportedSum);
+        put("max", _reportedMax);
+        for (uint8_t i = 0; i <= _buckets && result; i++)
+            if (_reportedCounts[i])
+            {
+                char suffix[16];
+                if (i < _buckets)
+                    snprintf(suffix, sizeof(suffix), "le%u", _bounds[i]);
+                else
+                    strcpy(suffix, "inf");
+                put(suffix, _reportedCounts[i]);
+            }
+        if (!result)
+            used = start;
+        return result;
+    }
+
+    void Metrics::add(Metric *metric)
+    {
+        // appended, so that the fields are reported in the order the metrics were created
+        auto lock = metricsLock();
+        xSemaphoreTake(lock, portMAX_DELAY);
+        auto p = &_head;
+        while (*p)
+            p = &(*p)->_next;
+        *p = metric;
+        xSemaphoreGive(lock);
+    }
+
+    void Metrics::remove(Metric *metric)
+    {
+        auto lock = metricsLock();
+        xSemaphoreTake(lock, portMAX_DELAY);
+        for (auto p = &_head; *p; p = &(*p)->_next)
+            if (*p == metric)
+            {
+                *p = metric->_next;
+                break;
+            }
+        xSemaphoreGive(lock);
+    }
+
+    void Metrics::flush()
+    {
+        static SimpleLoggable loggable("metrics");
+        auto &logger = loggable.logger();
+        auto buf = (uint8_t *)malloc(LOGGING_METRICS_RECORD_SIZE);
+        auto lock = metricsLock();
+        xSemaphoreTake(lock, portMAX_DELAY);
+        auto now = millis();
+        uint32_t period = _reported ? now - _reported : now;
+        _reported = now;
+        // metrics are reset even if the report is dropped, so that the next one covers only its own period
+        auto level = _level;
+        bool enabled = buf && logger.enabled(level);
+        // every record starts with the period, the fields of the metrics follow
+        size_t used = 0;
+        if (enabled)
+            encodeUInt(buf, LOGGING_METRICS_RECORD_SIZE, used, "period", period);
+        auto header = used;
+        for (auto m = _head; m; m = m->_next)
+        {
+            m->collect();
+            if (!enabled || m->encode(buf, LOGGING_METRICS_RECORD_SIZE, used))
+                continue;
+            if (used > header)
+            {
+                logger.send(level, "metrics", buf, used);
+                used = header;
+            }
+            m->encode(buf, LOGGING_METRICS_RECORD_SIZE, used); // too big for the record on its own, dropped if this fails
+        }
+        if (used > header)
+            logger.send(level, "metrics", buf, used);
+        xSemaphoreGive(lock);
+        free(buf);
+    }
+
+    void Metrics::run(void *)
+    {
+        auto wake = xTaskGetTickCount();
+        for (;;)
+        {
+            uint32_t period = _period;
+            if (!period)
+            {
+                // stopped, the task stays around until started again
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                wake = xTaskGetTickCount();
+                continue;
+            }
+            vTaskDelayUntil(&wake, pdMS_TO_TICKS(period));
+            if (_period)
+                flush();
+        }
+    }
+
+    void Metrics::start(uint32_t periodMs, LogLevel level)
+    {
+        _level = level;
+        _period = periodMs;
+        if (!_reported)
+            _reported = millis();
+        if (_task)
+            xTaskNotifyGive(_task);
+        else if (periodMs)
+            xTaskCreate(run, "esp32m::metrics", 3072, nullptr, tskIDLE_PRIORITY, &_task);
+    }
+
+} // namespace esp32m
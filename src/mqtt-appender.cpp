@@ -1,19 +1,300 @@
+#include <string.h>
+#include <esp_timer.h>
+#include <esp_idf_version.h>
+
 #include "mqtt-appender.hpp"
 
 namespace esp32m
 {
+    static uint32_t nowMs()
+    {
+        return (uint32_t)(esp_timer_get_time() / 1000);
+    }
+
+    MQTTAppender::~MQTTAppender()
+    {
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+        if (_handle)
+            esp_mqtt_client_unregister_event(_handle, MQTT_EVENT_ANY, handler);
+#endif
+        free(_batch);
+        if (_outbox)
+            vRingbufferDelete(_outbox);
+        vSemaphoreDelete(_lock);
+    }
+
+    void MQTTAppender::init(esp_mqtt_client_handle_t handle)
+    {
+        _handle = handle;
+        if (handle)
+            esp_mqtt_client_register_event(handle, MQTT_EVENT_ANY, handler, this);
+    }
+
+    void MQTTAppender::handler(void *self, esp_event_base_t base, int32_t id, void *data)
+    {
+        auto a = (MQTTAppender *)self;
+        auto event = (esp_mqtt_event_handle_t)data;
+        switch (id)
+        {
+        case MQTT_EVENT_CONNECTED:
+            a->_connected = true;
+            if (a->_controlTopic)
+                esp_mqtt_client_subscribe(a->_handle, a->_controlTopic, 1);
+            break;
+        case MQTT_EVENT_DATA:
+            // fragmented payloads are ignored, level configuration is expected to be short
+            if (a->_controlTopic && event->topic_len == (int)strlen(a->_controlTopic) && !strncmp(event->topic, a->_controlTopic, event->topic_len) &&
+                !event->current_data_offset && event->data_len == event->total_data_len)
+            {
+                char config[256];
+                if (event->data_len >= (int)sizeof(config))
+                    break;
+                memcpy(config, event->data, event->data_len);
+                config[event->data_len] = '\0';
+                if (!Logging::configureLevels(config))
+                    Logging::system().logf(LogLevel::Warning, "invalid log levels: %s", config);
+            }
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            a->_connected = false;
+            break;
+        default:
+            break;
+        }
+    }
+
+    void MQTTAppender::setControlTopic(const char *topic)
+    {
+        _controlTopic = topic;
+        // fails harmlessly if not connected yet, the subscription is made on connect then
+        if (_handle && topic)
+            esp_mqtt_client_subscribe(_handle, topic, 1);
+    }
+
+    void MQTTAppender::setBatching(size_t maxBytes, uint32_t maxDelayMs, Format format)
+    {
+        xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+        if (_handle)
+            flush();
+        free(_batch);
+        _batch = maxBytes ? (char *)malloc(maxBytes) : nullptr;
+        _batchSize = _batch ? maxBytes : 0;
+        _batchDelay = maxDelayMs;
+        _format = format;
+        xSemaphoreGiveRecursive(_lock);
+    }
+
+    void MQTTAppender::setOutbox(size_t bufsize)
+    {
+        xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+        if (_outbox)
+            vRingbufferDelete(_outbox);
+        _outbox = bufsize ? xRingbufferCreate(bufsize, RINGBUF_TYPE_NOSPLIT) : nullptr;
+        _outboxHead = nullptr;
+        _outboxItems = 0;
+        _outboxBytes = 0;
+        xSemaphoreGiveRecursive(_lock);
+    }
+
+    bool MQTTAppender::append(const LogMessage *message)
+    {
+        if (!_handle)
+            return false;
+        bool result;
+        xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+        drain();
+        if (!message)
+        {
+            if (_batchLen && nowMs() - _batchStarted >= _batchDelay)
+                flush();
+            result = _connected;
+        }
+        else if (_batch)
+            result = add(message);
+        else
+        {
+            result = true;
+            auto str = formatter()(message);
+            if (str)
+            {
+                result = deliver(str, strlen(str), message->level() <= LogLevel::Error ? _errorQos : 0);
+                logFree(str);
+            }
+        }
+        xSemaphoreGiveRecursive(_lock);
+        return result;
+    }
+
     bool MQTTAppender::append(const char *message)
     {
         if (!_handle)
             return false;
         if (!message)
             return true;
-        auto messageIdOrErrorCode = esp_mqtt_client_publish(_handle, _topic, message, strlen(message), 0, false);
-        // Strict positive value indicates a message id. 
+        xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+        drain();
+        auto result = deliver(message, strlen(message), 0);
+        xSemaphoreGiveRecursive(_lock);
+        return result;
+    }
+
+    bool MQTTAppender::add(const LogMessage *message)
+    {
+        char *str = nullptr;
+        size_t len;
+        if (_format == Format::Json)
+        {
+            len = message->toJson(nullptr, 0);
+            str = (char *)logAlloc(len + 1);
+            if (!str)
+                return true;
+            message->toJson(str, len + 1);
+        }
+        else
+        {
+            str = formatter()(message);
+            if (!str)
+                return true;
+            len = strlen(str);
+        }
+        // one byte for the separator, one for the closing bracket of JSON array
+        if (_batchLen && _batchLen + 1 + len + 1 > _batchSize)
+            flush();
+        bool result = true;
+        if (1 + len + 1 > _batchSize)
+        {
+            auto qos = message->level() <= LogLevel::Error ? _errorQos : 0;
+            if (_format == Format::Json)
+            {
+                // still an array, so that the receiver doesn't have to tell single messages from batches
+                auto array = (char *)logAlloc(len + 2);
+                if (array)
+                {
+                    array[0] = '[';
+                    memcpy(array + 1, str, len);
+                    array[len + 1] = ']';
+                    result = deliver(array, len + 2, qos);
+                    logFree(array);
+                }
+            }
+            else
+                result = deliver(str, len, qos);
+        }
+        else
+        {
+            if (!_batchLen)
+                _batchStarted = nowMs();
+            if (_format == Format::Json)
+            {
+                _batch[_batchLen] = _batchLen ? ',' : '[';
+                _batchLen++;
+            }
+            else if (_batchLen)
+                _batch[_batchLen++] = '\n';
+            memcpy(_batch + _batchLen, str, len);
+            _batchLen += len;
+            if (message->level() <= LogLevel::Error)
+            {
+                if (_errorQos > _batchQos)
+                    _batchQos = _errorQos;
+                result = flush();
+            }
+            else if (nowMs() - _batchStarted >= _batchDelay)
+                result = flush();
+        }
+        logFree(str);
+        return result;
+    }
+
+    bool MQTTAppender::flush()
+    {
+        if (!_batchLen)
+            return true;
+        if (_format == Format::Json)
+            _batch[_batchLen++] = ']';
+        auto result = deliver(_batch, _batchLen, _batchQos);
+        _batchLen = 0;
+        _batchQos = 0;
+        return result;
+    }
+
+    bool MQTTAppender::deliver(const char *payload, size_t len, int qos)
+    {
+        if (_outboxItems)
+        {
+            // there are older payloads waiting, keep the order
+            save(payload, len, qos);
+            return true;
+        }
+        if (publish(payload, len, qos))
+            return true;
+        if (!_outbox)
+            return false;
+        save(payload, len, qos);
+        return true;
+    }
+
+    bool MQTTAppender::publish(const char *payload, size_t len, int qos)
+    {
+        if (!_connected)
+            return false;
+        auto messageIdOrErrorCode = esp_mqtt_client_publish(_handle, _topic, payload, len, qos, false);
+        // Strict positive value indicates a message id.
         // - when QoS==0, message id is always 0 as per esp-idf's esp_mqtt_client_publish
-        // Strict negative value indicates an error. 
-        if (messageIdOrErrorCode >= 0) {return true;}
-        return false;
+        // Strict negative value indicates an error.
+        // the failure may be transient (e.g. the client's outbox is full), the connection state is left to the events
+        return messageIdOrErrorCode >= 0;
     }
-    
-} // namespace esp32m
\ No newline at end of file
+
+    void MQTTAppender::save(const char *payload, size_t len, int qos)
+    {
+        // first byte of the item is QoS, the rest is payload
+        if (len + 1 > xRingbufferGetMaxItemSize(_outbox))
+            return; // would never fit, the queued payloads are kept
+        void *item;
+        while (!xRingbufferSendAcquire(_outbox, &item, len + 1, 0))
+        {
+            // discard the oldest payload
+            auto oldest = _outboxHead;
+            auto size = _outboxHeadSize;
+            _outboxHead = nullptr;
+            if (!oldest)
+            {
+                oldest = (char *)xRingbufferReceive(_outbox, &size, 0);
+                if (!oldest)
+                    return;
+            }
+            vRingbufferReturnItem(_outbox, oldest);
+            _outboxItems--;
+            _outboxBytes -= size;
+        }
+        *(uint8_t *)item = qos;
+        memcpy((uint8_t *)item + 1, payload, len);
+        xRingbufferSendComplete(_outbox, item);
+        _outboxItems++;
+        _outboxBytes += len + 1;
+    }
+
+    void MQTTAppender::drain()
+    {
+        if (!_outbox || !_connected)
+            return;
+        while (_outboxItems)
+        {
+            if (!_outboxHead)
+            {
+                _outboxHead = (char *)xRingbufferReceive(_outbox, &_outboxHeadSize, 0);
+                if (!_outboxHead)
+                    break;
+            }
+            // the head stays received but not returned until it is published
+            if (!publish(_outboxHead + 1, _outboxHeadSize - 1, *(uint8_t *)_outboxHead))
+                break;
+            vRingbufferReturnItem(_outbox, _outboxHead);
+            _outboxHead = nullptr;
+            _outboxItems--;
+            _outboxBytes -= _outboxHeadSize;
+        }
+    }
+
+} // namespace esp32m
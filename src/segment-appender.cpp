@@ -0,0 +1,235 @@
+#include <string.h>
+#include <esp32-hal.h>
+
+#include "segment-appender.hpp"
+
+namespace esp32m
+{
+    const uint32_t SegmentMagic = 0x4753474C; // "LGSG"
+
+    uint16_t crc16(uint16_t crc, const uint8_t *data, size_t len)
+    {
+        while (len--)
+        {
+            crc ^= (uint16_t)*data++ << 8;
+            for (int i = 0; i < 8; i++)
+                crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+        return crc;
+    }
+
+    SegmentAppender::SegmentAppender(FS &fs, const char *name, uint8_t segments, uint32_t segmentSize, uint16_t pageSize, uint32_t commitDelayMs)
+        : _fs(fs), _name(name), _segments(segments ? segments : 1), _pageSize(pageSize > sizeof(Header) ? pageSize : 256),
+          _pagesPerSegment(segmentSize / _pageSize), _commitDelay(commitDelayMs), _lock(xSemaphoreCreateRecursiveMutex())
+    {
+        if (!_pagesPerSegment)
+            _pagesPerSegment = 1;
+    }
+
+    SegmentAppender::~SegmentAppender()
+    {
+        commit();
+        if (_file)
+            _file.close();
+        free(_page);
+        vSemaphoreDelete(_lock);
+    }
+
+    bool SegmentAppender::append(const LogMessage *message)
+    {
+        xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+        bool result;
+        if (message)
+        {
+            // errors must survive the reset that may follow them
+            _urgent = message->level() <= LogLevel::Error;
+            result = FormattingAppender::append(message);
+            _urgent = false;
+        }
+        else
+            result = append((const char *)nullptr);
+        xSemaphoreGiveRecursive(_lock);
+        return result;
+    }
+
+    bool SegmentAppender::append(const char *message)
+    {
+        xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+        if (!_ready)
+            _ready = open();
+        bool result = _ready;
+        if (result && message)
+        {
+            auto capacity = _pageSize - sizeof(Header);
+            auto len = strlen(message);
+            // the page is the unit of commit, so lines that fit in a page are not split, longer ones span several pages
+            if (_len && _len + len + 1 > capacity)
+                result = write();
+            for (size_t i = 0; i <= len && result; i++)
+            {
+                if (_len == capacity && !(result = write()))
+                    break;
+                if (!_len)
+                    _started = millis();
+                _page[sizeof(Header) + _len++] = i < len ? message[i] : '\n';
+            }
+        }
+        if (result && _len && (_len == _pageSize - sizeof(Header) || _urgent || millis() - _started >= _commitDelay))
+            result = write();
+        xSemaphoreGiveRecursive(_lock);
+        return result;
+    }
+
+    bool SegmentAppender::commit()
+    {
+        xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+        auto result = !_len || write();
+        xSemaphoreGiveRecursive(_lock);
+        return result;
+    }
+
+    String SegmentAppender::segmentName(uint8_t i)
+    {
+        String name;
+        name.reserve(strlen(_name) + 1 + 3 + 1);
+        name = _name;
+        name.concat('.');
+        name.concat(i);
+        return name;
+    }
+
+    bool SegmentAppender::prepare(uint8_t i)
+    {
+        auto name = segmentName(i);
+        auto size = _pagesPerSegment * _pageSize;
+        if (_fs.exists(name))
+        {
+            auto f = _fs.open(name, "r");
+            if (f && f.size() == size)
+                return true;
+        }
+        // preallocate the segment once, so that writing the log never changes its size
+        auto f = _fs.open(name, "w");
+        if (!f)
+            return false;
+        memset(_page, 0xFF, _pageSize);
+        bool result = true;
+        for (uint32_t p = 0; p < _pagesPerSegment && result; p++)
+            result = f.write(_page, _pageSize) == _pageSize;
+        f.close();
+        return result;
+    }
+
+    bool SegmentAppender::readHeader(File &f, uint32_t page, Header &h, uint8_t *buf)
+    {
+        if (!f.seek(page * _pageSize) || f.read(buf, _pageSize) != _pageSize)
+            return false;
+        memcpy(&h, buf, sizeof(Header));
+        if (h.magic != SegmentMagic || h.len > _pageSize - sizeof(Header))
+            return false;
+        // a page torn by power loss fails the check
+        auto crc = crc16(0xFFFF, (const uint8_t *)&h.seq, sizeof(h.seq) + sizeof(h.len));
+        return crc16(crc, buf + sizeof(Header), h.len) == h.crc;
+    }
+
+    bool SegmentAppender::open()
+    {
+        if (!_page)
+            _page = (uint8_t *)malloc(_pageSize);
+        if (!_page)
+            return false;
+        for (uint8_t i = 0; i < _segments; i++)
+            if (!prepare(i))
+                return false;
+        // the segment with the highest sequence number in the first page is the one being written
+        Header h;
+        uint32_t newest = 0;
+        for (uint8_t i = 0; i < _segments; i++)
+        {
+            auto f = _fs.open(segmentName(i), "r");
+            if (f && readHeader(f, 0, h, _page) && h.seq >= newest)
+            {
+                newest = h.seq;
+                _segment = i;
+            }
+        }
+        if (newest)
+        {
+            // the first valid page that doesn't continue the sequence is either torn, or left from the previous round
+            auto f = _fs.open(segmentName(_segment), "r");
+            _pageIndex = 1;
+            while (_pageIndex < _pagesPerSegment && readHeader(f, _pageIndex, h, _page) && h.seq == newest + 1)
+            {
+                newest++;
+                _pageIndex++;
+            }
+            _seq = newest + 1;
+            if (_pageIndex == _pagesPerSegment)
+            {
+                _pageIndex = 0;
+                _segment = (_segment + 1) % _segments;
+            }
+        }
+        _len = 0;
+        _file = _fs.open(segmentName(_segment), "r+");
+        return (bool)_file;
+    }
+
+    bool SegmentAppender::write()
+    {
+        Header h;
+        h.magic = SegmentMagic;
+        h.seq = _seq;
+        h.len = _len;
+        h.crc = crc16(crc16(0xFFFF, (const uint8_t *)&h.seq, sizeof(h.seq) + sizeof(h.len)), _page + sizeof(Header), _len);
+        memcpy(_page, &h, sizeof(Header));
+        memset(_page + sizeof(Header) + _len, 0xFF, _pageSize - sizeof(Header) - _len);
+        if (!_file || !_file.seek(_pageIndex * _pageSize) || _file.write(_page, _pageSize) != _pageSize)
+            return false;
+        _file.flush();
+        _len = 0;
+        _seq++;
+        if (++_pageIndex == _pagesPerSegment)
+        {
+            _file.close();
+            _pageIndex = 0;
+            _segment = (_segment + 1) % _segments;
+            _file = _fs.open(segmentName(_segment), "r+");
+        }
+        return true;
+    }
+
+    void SegmentAppender::read(Reader reader, void *arg)
+    {
+        if (!reader)
+            return;
+        xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+        if (!_ready)
+            _ready = open();
+        auto buf = (uint8_t *)malloc(_pageSize);
+        if (_ready && buf)
+        {
+            // the oldest pages are the ones past the write position in the current segment, left from the previous round,
+            // then the segments that follow, and finally the beginning of the current segment
+            Header h;
+            for (uint8_t n = 0; n <= _segments; n++)
+            {
+                auto i = (_segment + n) % _segments;
+                auto first = n ? 0 : _pageIndex;
+                auto last = n < _segments ? _pagesPerSegment : _pageIndex;
+                auto f = _fs.open(segmentName(i), "r");
+                uint32_t seq = 0;
+                for (auto p = first; p < last && f && readHeader(f, p, h, buf); p++)
+                {
+                    if (p > first && h.seq != seq + 1)
+                        break;
+                    seq = h.seq;
+                    reader((const char *)buf + sizeof(Header), h.len, arg);
+                }
+            }
+        }
+        free(buf);
+        xSemaphoreGiveRecursive(_lock);
+    }
+
+} // namespace esp32m
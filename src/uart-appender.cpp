@@ -0,0 +1,119 @@
+#include <string.h>
+
+#include "uart-appender.hpp"
+
+namespace esp32m
+{
+
+    UARTAppender::UARTAppender(uart_port_t port, size_t bufsize, Overflow overflow)
+        : _port(port), _overflow(overflow), _lock(xSemaphoreCreateMutex()), _stopped(xSemaphoreCreateBinary())
+    {
+        if (!uart_is_driver_installed(port))
+            uart_driver_install(port, 256, 0, 0, nullptr, 0);
+        _buf = xRingbufferCreate(bufsize, RINGBUF_TYPE_NOSPLIT);
+        xTaskCreate([](void *self) { ((UARTAppender *)self)->run(); }, "esp32m::log-uart", 2048, this, tskIDLE_PRIORITY + 1, &_task);
+    }
+
+    UARTAppender::~UARTAppender()
+    {
+        // the task may be holding the lock in the middle of a line, it's not deleted but asked to finish and exit
+        if (_task)
+        {
+            _stop = true;
+            xTaskNotifyGive(_task);
+            xSemaphoreTake(_stopped, portMAX_DELAY);
+        }
+        if (_buf)
+            vRingbufferDelete(_buf);
+        vSemaphoreDelete(_stopped);
+        vSemaphoreDelete(_lock);
+    }
+
+    bool UARTAppender::append(const LogMessage *message)
+    {
+        auto str = formatter()(message);
+        if (!str)
+            return true;
+        auto result = write(str, message->level());
+        logFree(str);
+        return result;
+    }
+
+    bool UARTAppender::append(const char *message)
+    {
+        return !message || write(message, LogLevel::Info);
+    }
+
+    bool UARTAppender::write(const char *message, LogLevel level)
+    {
+        auto len = strlen(message);
+        void *item = nullptr;
+        // errors don't wait for room even in the Block mode, they have the synchronous fallback
+        bool block = _overflow == Overflow::Block && level > LogLevel::Error;
+        if (_buf && xRingbufferSendAcquire(_buf, &item, len + 1, block ? portMAX_DELAY : 0))
+        {
+            memcpy(item, message, len);
+            ((char *)item)[len] = '\n';
+            _pending += len + 1;
+            xRingbufferSendComplete(_buf, item);
+            xTaskNotifyGive(_task);
+            return true;
+        }
+        if (level <= LogLevel::Error)
+        {
+            // synchronous fallback: errors must not be lost to a full buffer.
+            // The lines buffered before go first, the task can't take the next one while we hold the lock
+            xSemaphoreTake(_lock, portMAX_DELAY);
+            while (writeNext())
+                ;
+            uart_write_bytes(_port, message, len);
+            uart_write_bytes(_port, "\n", 1);
+            xSemaphoreGive(_lock);
+            return true;
+        }
+        _dropped++;
+        return false;
+    }
+
+    size_t UARTAppender::pending()
+    {
+        size_t result = _pending;
+        // the last line may still be in the driver or the FIFO
+        if (!result && uart_wait_tx_done(_port, 0) != ESP_OK)
+            result = 1;
+        return result;
+    }
+
+    bool UARTAppender::writeNext()
+    {
+        size_t size;
+        auto item = _buf ? xRingbufferReceive(_buf, &size, 0) : nullptr;
+        if (!item)
+            return false;
+        // blocks the caller only, the driver refills the FIFO from the TX interrupt
+        uart_write_bytes(_port, item, size);
+        vRingbufferReturnItem(_buf, item);
+        _pending -= size;
+        return true;
+    }
+
+    void UARTAppender::run()
+    {
+        for (;;)
+        {
+            // the line is taken and written under the lock, so that the synchronous fallback can't overtake it
+            xSemaphoreTake(_lock, portMAX_DELAY);
+            auto written = writeNext();
+            xSemaphoreGive(_lock);
+            if (written)
+                continue;
+            if (_stop)
+                break;
+            // every buffered line is notified, so a line added after writeNext() found the buffer empty wakes us up
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        xSemaphoreGive(_stopped);
+        vTaskDelete(nullptr);
+    }
+
+} // namespace esp32m
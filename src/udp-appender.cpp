@@ -1,12 +1,16 @@
+#include <errno.h>
 #include <string.h>
+#include <esp32-hal.h>
+#include <esp_system.h>
 #include <WiFi.h>
 
 #include "udp-appender.hpp"
+#include "log-wire.hpp"
 
 namespace esp32m
 {
 
-UDPAppender::UDPAppender(const char* ipaddr, uint16_t port) : _fd(-1)
+UDPAppender::UDPAppender(const char* ipaddr, uint16_t port) : _lock(xSemaphoreCreateRecursiveMutex()), _fd(-1)
 {
   memset(&_addr, 0, sizeof(_addr));
   _addr.sin_family = AF_INET;
@@ -16,7 +20,7 @@ UDPAppender::UDPAppender(const char* ipaddr, uint16_t port) : _fd(-1)
   }
   _format = port == 514 ? Format::Syslog : Format::Text;
   if (_addr.sin_addr.s_addr == 0)
-    WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) {
+    _wifiEvent = WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) {
     switch (event)
     {
       case ARDUINO_EVENT_WIFI_STA_GOT_IP:
@@ -31,8 +35,23 @@ UDPAppender::UDPAppender(const char* ipaddr, uint16_t port) : _fd(-1)
   });
 }
 
+UDPAppender::UDPAppender(Format format) : _lock(xSemaphoreCreateRecursiveMutex()), _fd(-1)
+{
+  memset(&_addr, 0, sizeof(_addr));
+  _format = format;
+}
+
 UDPAppender::~UDPAppender()
 {
+  if (_wifiEvent) {
+    WiFi.removeEvent(_wifiEvent);
+  }
+  if (_frameLen && _fd >= 0) {
+    sendFrame();
+  }
+  free(_frame);
+  free(_names);
+  vSemaphoreDelete(_lock);
   if (_fd >= 0)
   {
     shutdown(_fd, 2);
@@ -43,15 +62,11 @@ UDPAppender::~UDPAppender()
 
 const uint8_t SyslogSeverity[] = {5, 5, 3, 4, 6, 7, 7};
 
-bool UDPAppender::append(const LogMessage* message)
+bool UDPAppender::ready()
 {
   if (!WiFi.isConnected() || !_addr.sin_addr.s_addr) {
     return false;
   }
-  if (!message) {
-    return true;
-  }
-  static char eol = '\n';
   if (_fd < 0)
   {
     struct timeval send_timeout = {1, 0};
@@ -63,32 +78,83 @@ bool UDPAppender::append(const LogMessage* message)
       return false;
     }
   }
+  return true;
+}
+
+const size_t MaxSegments = LogSegments::MaxCount + 1;
+
+/**
+ * Fills @p msg with up to @c MaxSegments segments
+ */
+void gather(struct msghdr& msg, struct iovec* iov, const LogSegment* segments, size_t count)
+{
+  memset(&msg, 0, sizeof(msg));
+  if (count > MaxSegments) {
+    count = MaxSegments;
+  }
+  for (size_t i = 0; i < count; i++) {
+    iov[i].iov_base = (void*)segments[i].data;
+    iov[i].iov_len = segments[i].len;
+  }
+  msg.msg_iov = iov;
+  msg.msg_iovlen = count;
+}
+
+bool UDPAppender::transmit(const LogSegment* segments, size_t count)
+{
+  if (!segments) {
+    return true;
+  }
+  struct msghdr msg;
+  struct iovec iov[MaxSegments];
+  gather(msg, iov, segments, count);
+  msg.msg_name = &_addr;
+  msg.msg_namelen = sizeof(_addr);
+  return sendmsg(_fd, &msg, 0) >= 0;
+}
+
+bool UDPAppender::append(const LogMessage* message)
+{
+  if (!ready()) {
+    return false;
+  }
+  if (!message) {
+    auto result = transmit((const LogSegment*)nullptr, 0);
+    if (_format != Format::Binary) {
+      return result;
+    }
+  }
+  static char eol = '\n';
   switch (_format)
   {
+    case Format::Binary:
+      return appendBinary(message);
     case Format::Text:
     {
       auto formatter = Logging::formatter();
+      if (LogSegments::supports(formatter)) {
+        // the line goes out in one datagram straight from the message, without rendering it into a buffer first
+        LogSegments segments;
+        if (!segments.render(message)) {
+          return true;
+        }
+        LogSegment parts[MaxSegments];
+        memcpy(parts, segments.segments(), segments.count() * sizeof(LogSegment));
+        parts[segments.count()] = {&eol, sizeof(eol)};
+        return transmit(parts, segments.count() + 1);
+      }
       auto msg = formatter(message);
       if (!msg) {
         return true;
       }
-      auto len = strlen(msg);
-      auto mptr = msg;
-      while (len)
-      {
-        auto result = sendto(_fd, mptr, len, 0, (struct sockaddr*)&_addr, sizeof(_addr));
-        if (result < 0)
-        {
-          free(msg);
-          return false;
-        }
-        len -= result;
-        mptr += result;
-      }
-      free(msg);
-      return sendto(_fd, &eol, sizeof(eol), 0, (struct sockaddr*)&_addr, sizeof(_addr)) == sizeof(eol);
+      // the line and its end go out in the same datagram
+      LogSegment parts[] = {{msg, strlen(msg)}, {&eol, sizeof(eol)}};
+      auto result = transmit(parts, 2);
+      logFree(msg);
+      return result;
     }
     case Format::Syslog:
+    {
       // https://tools.ietf.org/html/rfc5424
       int pri = 3 /*system daemons*/ * 8 + SyslogSeverity[message->level()];
       char strftime_buf[4 /* YEAR */ + 1 /* - */ + 2 /* MONTH */ + 1 /* - */ + 2 /* DAY */ + 1 /* T */ + 2 /* HOUR */ + 1 /* : */ + 2 /* MINUTE */ + 1 /* : */ + 2 /* SECOND */ + 1 /*NULL*/];
@@ -106,17 +172,400 @@ bool UDPAppender::append(const LogMessage* message)
       strftime(strftime_buf, sizeof(strftime_buf), "%FT%T", &timeinfo);
       const char* hostname = WiFi.getHostname();
       const char* name = message->name();
-      auto ms = 1 /* < */ + 3 /* PRIVAL */ + 1 /* > */ + 1 /* version */ + 1 /* SP */ + strlen(strftime_buf) + 1 /* . */ + 4 /* MS */ + 1 /* Z */ + 1 /* SP */ + strlen(hostname) + 1 /* SP */ + strlen(name) + 1 /* SP */ + 1 + /* PROCID */ +1 /*SP*/ + 1 + /* MSGID */ +1 /* SP */ + 1 + /* STRUCTURED-DATA */ +1 /* SP */ + message->message_size() + 1 /*NULL*/;
-      char* buf = (char*)malloc(ms);
+      // task, core and span go to STRUCTURED-DATA as [ctx@32473 task="name" core="0" span="1"], structured fields as [fields@32473 key="value" ...]
+      static const char ctxid[] = "[ctx@32473 ";
+      static const char sdid[] = "[fields@32473 ";
+      auto cl = message->renderContext(nullptr, 0, LogMessage::FieldsFormat::SyslogParams);
+      auto fl = message->fields_size() ? message->renderFields(nullptr, 0, LogMessage::FieldsFormat::SyslogParams) : 0;
+      auto sdl = sizeof(ctxid) - 1 + cl + 1 /* ] */ + (fl ? sizeof(sdid) - 1 + fl + 1 /* ] */ : 0);
+      auto ms = 1 /* < */ + 3 /* PRIVAL */ + 1 /* > */ + 1 /* version */ + 1 /* SP */ + strlen(strftime_buf) + 1 /* . */ + 4 /* MS */ + 1 /* Z */ + 1 /* SP */ + strlen(hostname) + 1 /* SP */ + strlen(name) + 1 /* SP */ + 1 + /* PROCID */ +1 /*SP*/ + 1 + /* MSGID */ +1 /* SP */ + sdl + /* STRUCTURED-DATA */ +1 /* SP */ + message->message_size() + 1 /*NULL*/;
+      char* buf = (char*)logAlloc(ms);
       if (!buf) {
         return true;
       }
-      sprintf(buf, "<%d>1 %s.%04dZ %s %s - - - %s", pri, strftime_buf, (int)(stamp % 1000), hostname, name, message->message());
-      auto result = sendto(_fd, buf, strlen(buf), 0, (struct sockaddr*)&_addr, sizeof(_addr));
-      free(buf);
-      return (result >= 0);
+      auto len = sprintf(buf, "<%d>1 %s.%04dZ %s %s - - ", pri, strftime_buf, (int)(stamp % 1000), hostname, name);
+      memcpy(buf + len, ctxid, sizeof(ctxid) - 1);
+      len += sizeof(ctxid) - 1;
+      len += message->renderContext(buf + len, cl + 1, LogMessage::FieldsFormat::SyslogParams);
+      buf[len++] = ']';
+      if (fl) {
+        memcpy(buf + len, sdid, sizeof(sdid) - 1);
+        len += sizeof(sdid) - 1;
+        len += message->renderFields(buf + len, fl + 1, LogMessage::FieldsFormat::SyslogParams);
+        buf[len++] = ']';
+      }
+      len += sprintf(buf + len, " %s", message->message());
+      auto result = transmit(buf, len);
+      logFree(buf);
+      return result;
+    }
+    case Format::Json:
+    {
+      auto len = message->toJson(nullptr, 0);
+      char* buf = (char*)logAlloc(len + 1);
+      if (!buf) {
+        return true;
+      }
+      message->toJson(buf, len + 1);
+      auto result = transmit(buf, len);
+      logFree(buf);
+      return result;
+    }
+  }
+  return true;
+}
+
+const size_t FrameSize = 1400; // fits into the ethernet MTU along with IP and UDP headers
+const uint32_t FrameDelayMs = 200;
+const uint32_t DictionaryPeriodMs = 10000;
+const size_t NameSlots = 128;
+const size_t NameProbes = 8;
+const size_t NameMaxLen = 64;
+
+uint32_t nameHash(const char* name)
+{
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  while (*name) {
+    h ^= (uint8_t)*name++;
+    h *= 16777619u;
+  }
+  return h ? h : 1;
+}
+
+size_t nameLen(const char* name)
+{
+  auto len = strlen(name);
+  return len > NameMaxLen ? NameMaxLen : len;
+}
+
+uint16_t UDPAppender::nameId(const char* name, bool& define, uint16_t pinned)
+{
+  define = false;
+  if (!name) {
+    return logwire::NoName;
+  }
+  auto h = nameHash(name);
+  auto now = millis();
+  // open addressing with a short probe, the least recently defined slot is taken over when all of them are busy
+  size_t victim = NameSlots;
+  for (size_t i = 0; i < NameProbes; i++) {
+    auto id = (h + i) % NameSlots;
+    auto& slot = _names[id];
+    if (slot.hash == h) {
+      define = !slot.defined || now - slot.sent >= DictionaryPeriodMs;
+      return id;
+    }
+    // the other name of the message being encoded keeps its slot
+    if (id == pinned) {
+      continue;
+    }
+    if (!slot.hash) {
+      victim = id;
+      break;
+    }
+    if (victim == NameSlots || now - slot.sent > now - _names[victim].sent) {
+      victim = id;
+    }
+  }
+  _names[victim].hash = h;
+  _names[victim].defined = false;
+  define = true;
+  return victim;
+}
+
+size_t UDPAppender::writeName(uint16_t id, const char* name)
+{
+  auto len = nameLen(name);
+  logwire::NameRecord r;
+  r.header.type = logwire::RecordType::Name;
+  r.header.length = sizeof(r) + len;
+  r.id = id;
+  memcpy(_frame + _frameLen, &r, sizeof(r));
+  memcpy(_frame + _frameLen + sizeof(r), name, len);
+  _frameLen += sizeof(r) + len;
+  _names[id].defined = true;
+  _names[id].sent = millis();
+  return sizeof(r) + len;
+}
+
+bool UDPAppender::sendFrame()
+{
+  logwire::FrameHeader h;
+  h.magic = logwire::Magic;
+  h.version = logwire::Version;
+  h.flags = 0;
+  h.length = _frameLen;
+  h.count = _frameCount;
+  h.session = _session;
+  h.seq = _seq - _frameCount;
+  memcpy(_frame, &h, sizeof(h));
+  if (!transmit(_frame, _frameLen)) {
+    return false;
+  }
+  _frameLen = 0;
+  _frameCount = 0;
+  return true;
+}
+
+bool UDPAppender::appendBinary(const LogMessage* message)
+{
+  xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+  if (!_frame) {
+    _frame = (uint8_t*)malloc(FrameSize);
+    _names = (NameSlot*)calloc(NameSlots, sizeof(NameSlot));
+    _session = esp_random();
+  }
+  bool result = _frame && _names;
+  bool added = false;
+  if (result && message) {
+    auto name = message->name();
+    auto task = message->task();
+    bool defineName, defineTask;
+    auto nid = nameId(name, defineName, logwire::NoName);
+    auto tid = nameId(task, defineTask, nid);
+    auto ml = message->message_size() - 1;
+    auto fl = message->fields_size();
+    auto defs = (defineName ? sizeof(logwire::NameRecord) + nameLen(name) : 0) + (defineTask ? sizeof(logwire::NameRecord) + nameLen(task) : 0);
+    auto fixed = sizeof(logwire::FrameHeader) + defs + sizeof(logwire::MessageRecord) + fl;
+    // the message that doesn't fit into the empty frame is truncated
+    if (fixed + ml > FrameSize) {
+      ml = FrameSize - fixed;
+    }
+    if (_frameLen && _frameLen + fixed - sizeof(logwire::FrameHeader) + ml > FrameSize) {
+      result = sendFrame();
+    }
+    if (result) {
+      if (!_frameLen) {
+        _frameLen = sizeof(logwire::FrameHeader);
+        _frameStarted = millis();
+      }
+      if (defineName) {
+        writeName(nid, name);
+      }
+      if (defineTask) {
+        writeName(tid, task);
+      }
+      logwire::MessageRecord r;
+      r.header.type = logwire::RecordType::Message;
+      r.header.length = sizeof(r) + ml + fl;
+      r.stamp = message->stamp();
+      r.span = message->span();
+      r.name = nid;
+      r.task = tid;
+      r.level = message->level();
+      r.core = message->core();
+      r.messageLength = ml;
+      memcpy(_frame + _frameLen, &r, sizeof(r));
+      memcpy(_frame + _frameLen + sizeof(r), message->message(), ml);
+      memcpy(_frame + _frameLen + sizeof(r) + ml, message->fields(), fl);
+      _frameLen += r.header.length;
+      _frameCount++;
+      _seq++;
+      added = true;
+    }
+  }
+  // errors are sent right away, they may be followed by the reset.
+  // Once the message is in the frame it's accepted, a frame that fails to send is kept and sent later
+  if (result && _frameLen && ((message && message->level() <= LogLevel::Error) || millis() - _frameStarted >= FrameDelayMs)) {
+    result = sendFrame() || added;
+  }
+  xSemaphoreGiveRecursive(_lock);
+  return result;
+}
+
+MultiUDPAppender::MultiUDPAppender(Format format) : UDPAppender(format)
+{
+  for (auto& d : _destinations) {
+    d.fd = -1;
+    d.retry = nullptr;
+    d.retryLen = 0;
+  }
+  _linkUp = WiFi.isConnected();
+  _wifiEvent = WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) {
+    switch (event)
+    {
+      case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        _reopen = true;
+        _linkUp = true;
+        break;
+      case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+      case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        _linkUp = false;
+        break;
+      default:
+        break;
+    }
+  });
+}
+
+MultiUDPAppender::~MultiUDPAppender()
+{
+  // the events must not reach the destinations being closed
+  if (_wifiEvent) {
+    WiFi.removeEvent(_wifiEvent);
+    _wifiEvent = 0;
+  }
+  xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+  if (UDPAppender::pending()) {
+    sendFrame();
+  }
+  for (uint8_t i = 0; i < _count; i++) {
+    close(_destinations[i]);
+    free(_destinations[i].retry);
+  }
+  xSemaphoreGiveRecursive(_lock);
+}
+
+bool MultiUDPAppender::addDestination(const char* ipaddr, uint16_t port)
+{
+  if (!ipaddr) {
+    return false;
+  }
+  xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+  bool result = _count < LOGGING_UDP_DESTINATIONS;
+  if (result) {
+    auto& d = _destinations[_count];
+    memset(&d.addr, 0, sizeof(d.addr));
+    d.addr.sin_family = AF_INET;
+    d.addr.sin_port = htons(port);
+    result = inet_aton(ipaddr, &d.addr.sin_addr.s_addr);
+    if (result) {
+      _count++;
+    }
+  }
+  xSemaphoreGiveRecursive(_lock);
+  return result;
+}
+
+bool MultiUDPAppender::open(Destination& d)
+{
+  d.fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (d.fd < 0) {
+    return false;
+  }
+  fcntl(d.fd, F_SETFL, fcntl(d.fd, F_GETFL, 0) | O_NONBLOCK);
+  if (connect(d.fd, (struct sockaddr*)&d.addr, sizeof(d.addr)) < 0) {
+    close(d);
+    return false;
   }
   return true;
 }
 
+void MultiUDPAppender::close(Destination& d)
+{
+  if (d.fd >= 0) {
+    ::close(d.fd);
+    d.fd = -1;
+  }
+}
+
+bool wouldBlock()
+{
+  return errno == EWOULDBLOCK || errno == EAGAIN || errno == ENOMEM;
+}
+
+int sendConnected(int fd, const void* data, size_t len)
+{
+  auto result = send(fd, data, len, 0);
+  // ICMP port unreachable from the previous datagram is reported by this send, the datagram itself is not sent
+  if (result < 0 && errno == ECONNREFUSED) {
+    result = send(fd, data, len, 0);
+  }
+  return result;
+}
+
+int sendConnected(int fd, const LogSegment* segments, size_t count)
+{
+  struct msghdr msg;
+  struct iovec iov[MaxSegments];
+  gather(msg, iov, segments, count);
+  auto result = sendmsg(fd, &msg, 0);
+  if (result < 0 && errno == ECONNREFUSED) {
+    result = sendmsg(fd, &msg, 0);
+  }
+  return result;
+}
+
+bool MultiUDPAppender::keep(Destination& d, const LogSegment* segments, size_t count)
+{
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++) {
+    len += segments[i].len;
+  }
+  uint16_t l = len;
+  if (!d.retry) {
+    d.retry = (uint8_t*)malloc(LOGGING_UDP_RETRY_SIZE);
+  }
+  if (!d.retry || d.retryLen + sizeof(l) + len > LOGGING_UDP_RETRY_SIZE) {
+    return false;
+  }
+  memcpy(d.retry + d.retryLen, &l, sizeof(l));
+  d.retryLen += sizeof(l);
+  for (size_t i = 0; i < count; i++) {
+    memcpy(d.retry + d.retryLen, segments[i].data, segments[i].len);
+    d.retryLen += segments[i].len;
+  }
+  return true;
+}
+
+bool MultiUDPAppender::flushRetry(Destination& d)
+{
+  size_t pos = 0;
+  while (pos < d.retryLen) {
+    uint16_t l;
+    memcpy(&l, d.retry + pos, sizeof(l));
+    // datagrams that failed for other reasons are dropped, as they would be without the buffer
+    if (sendConnected(d.fd, d.retry + pos + sizeof(l), l) < 0 && wouldBlock()) {
+      break;
+    }
+    pos += sizeof(l) + l;
+  }
+  if (pos) {
+    memmove(d.retry, d.retry + pos, d.retryLen - pos);
+    d.retryLen -= pos;
+  }
+  return !d.retryLen;
+}
+
+bool MultiUDPAppender::transmit(const LogSegment* segments, size_t count)
+{
+  xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+  if (_reopen) {
+    _reopen = false;
+    for (uint8_t i = 0; i < _count; i++) {
+      close(_destinations[i]);
+    }
+  }
+  bool result = false;
+  for (uint8_t i = 0; i < _count; i++) {
+    auto& d = _destinations[i];
+    if (d.fd < 0 && !open(d)) {
+      continue;
+    }
+    // new datagrams wait behind the ones being retried, to keep the order
+    if (!flushRetry(d)) {
+      result |= segments && keep(d, segments, count);
+      continue;
+    }
+    if (!segments || sendConnected(d.fd, segments, count) >= 0) {
+      result = true;
+    }
+    else if (wouldBlock()) {
+      result |= keep(d, segments, count);
+    }
+  }
+  xSemaphoreGiveRecursive(_lock);
+  return result || !segments;
+}
+
+size_t MultiUDPAppender::pending()
+{
+  size_t result = UDPAppender::pending();
+  for (uint8_t i = 0; i < _count; i++) {
+    result += _destinations[i].retryLen;
+  }
+  return result;
+}
+
 } // namespace esp32m
\ No newline at end of file
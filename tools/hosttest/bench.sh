@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# Builds and runs the host micro-benchmarks of the library on Linux, against the platform stubs in stubs/
+#
+# Usage:
+#   tools/hosttest/bench.sh           run all benchmarks
+#   tools/hosttest/bench.sh format    run only the benchmarks with "format" in the name
+#
+# Every bench_*.cpp names the library sources it links with in a "// sources:" line, and may add compiler flags in a "// flags:" line,
+# like the tests. Benchmarks are built with optimizations and without sanitizers, into tools/hosttest/build/bench, and print CSV.
+#
+cd "$(dirname "$0")" || exit 1
+ROOT=../..
+BUILD=build/bench
+CXX=${CXX:-g++}
+FLAGS="-std=gnu++11 -O2 -g -Wall -Wno-sign-compare -Wno-unused-variable -Wno-unused-function -Istubs -I. -I$ROOT/include"
+mkdir -p $BUILD
+
+$CXX $FLAGS -c stubs/stubs.cpp -o $BUILD/stubs.o || exit 1
+failed=0
+for b in bench_*.cpp; do
+    name=${b%.cpp}
+    case "$name" in *"$1"*) ;; *) continue ;; esac
+    sources=$(sed -n 's|^// sources:||p' "$b" | head -n 1)
+    extra=$(sed -n 's|^// flags:||p' "$b" | head -n 1)
+    objs=""
+    for s in $sources; do
+        objs="$objs $ROOT/src/$s"
+    done
+    if ! $CXX $FLAGS $extra "$b" $objs $BUILD/stubs.o -lpthread -o $BUILD/$name; then
+        echo "FAIL $name (build)"
+        failed=1
+        continue
+    fi
+    echo "# $name"
+    $BUILD/$name || failed=1
+done
+exit $failed
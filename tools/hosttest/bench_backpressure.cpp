@@ -0,0 +1,81 @@
+// sources: logging.cpp
+/**
+ * Work saved by the adaptive backpressure while the pipeline is saturated: an appender that fails every append,
+ * and a task logging 100 debug messages with a few arguments for every warning, with backpressure off and on.
+ * Every message that reaches the appender was formatted, the ones suppressed by the lowered level were not.
+ * Time is the CPU time of the logging task, after the pipeline had a second to saturate.
+ * Prints CSV: backpressure, calls, messages formatted, CPU ns per call
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct FailingAppender : LogAppender
+{
+    std::atomic<uint32_t> count{0};
+    bool append(const LogMessage *message)
+    {
+        if (!message)
+            return true;
+        count.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+};
+
+int64_t cpuNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @return Number of logf() calls
+ */
+uint32_t logRounds(Logger &logger, int rounds)
+{
+    uint32_t calls = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < 100; i++, calls++)
+            logger.logf(LogLevel::Debug, "sample %d: adc=%u raw=%08x filtered=%d.%02d state=%s", i, r * 7 + i, r ^ i, i % 50, r % 100, i & 1 ? "up" : "down");
+        logger.logf(LogLevel::Warning, "round %d: sensor timeout", r);
+        calls++;
+    }
+    return calls;
+}
+
+void measure(uint8_t steps, Logger &logger, FailingAppender &appender)
+{
+    const int Rounds = 5000;
+    Logging::setBackpressure(steps);
+    // saturate for a second first, the governor evaluates the pipeline over windows
+    for (auto started = std::chrono::steady_clock::now(); std::chrono::steady_clock::now() - started < std::chrono::seconds(1);)
+        logRounds(logger, 10);
+    appender.count = 0;
+    auto start = cpuNs();
+    auto calls = logRounds(logger, Rounds);
+    auto ns = cpuNs() - start;
+    printf("%u,%u,%u,%.1f\n", steps, calls, appender.count.load(), (double)ns / calls);
+}
+
+int main()
+{
+    FailingAppender appender;
+    Logging::addAppender(&appender);
+    SimpleLoggable loggable("load");
+    auto &logger = loggable.logger();
+    Logging::setLevel(LogLevel::Debug);
+    printf("backpressure,calls,formatted,cpu_ns_per_call\n");
+    measure(0, logger, appender);
+    measure(2, logger, appender);
+    Logging::setBackpressure(0);
+    Logging::removeAppender(&appender);
+    return 0;
+}
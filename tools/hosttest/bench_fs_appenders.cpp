@@ -0,0 +1,58 @@
+// sources: logging.cpp fs_appender.cpp segment-appender.cpp
+/**
+ * Sustained writing of the same lines by FSAppender and SegmentAppender, both keeping 4 files of 16K, on the in-memory file system.
+ * Besides the time per line, the file system operations are counted: on a flash file system every write that grows a file
+ * and every flush update the metadata, and a rename rewrites the directory, which is what wears the flash and takes the time there.
+ * Prints CSV: appender, lines, ns per line, opens, writes, grows, flushes, renames, removes, bytes written
+ */
+#include <stdio.h>
+
+#include <chrono>
+
+#include "fs-appender.hpp"
+#include "hosttest.hpp"
+#include "logging.hpp"
+#include "segment-appender.hpp"
+
+using namespace esp32m;
+
+void measure(const char *name, LogAppender &appender, Logger &logger, int lines)
+{
+    hosttest::files.clear();
+    Logging::addAppender(&appender);
+    // files are created and preallocated before measuring
+    logger.logf(LogLevel::Info, "start");
+    hosttest::fsStats = {};
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lines; i++)
+        logger.logf(LogLevel::Info, "sensor %d: temperature %d.%dC, humidity %d%%", i & 7, 20 + i % 5, i % 10, 40 + i % 20);
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    Logging::removeAppender(&appender);
+    auto &s = hosttest::fsStats;
+    printf("%s,%d,%.0f,%u,%u,%u,%u,%u,%u,%llu\n", name, lines, (double)ns / lines, s.opens, s.writes, s.grows, s.flushes, s.renames, s.removes,
+           (unsigned long long)s.bytes);
+}
+
+int main()
+{
+    const int Lines = 50000;
+    FS fs;
+    SimpleLoggable loggable("bench");
+    auto &logger = loggable.logger();
+    printf("appender,lines,ns_per_line,opens,writes,grows,flushes,renames,removes,bytes\n");
+    {
+        FSAppender appender(fs, "/fs.log", 4, 16384);
+        measure("FSAppender", appender, logger, Lines);
+        appender.close();
+    }
+    // pages are written when full, the commit delay is left to its default. The default page, and a page of a flash sector
+    {
+        SegmentAppender appender(fs, "/seg", 4, 16384, 256);
+        measure("SegmentAppender/256", appender, logger, Lines);
+    }
+    {
+        SegmentAppender appender(fs, "/seg", 4, 16384, 4096);
+        measure("SegmentAppender/4096", appender, logger, Lines);
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+// sources: logging.cpp
+// flags: -std=gnu++17
+/**
+ * Time per message of LogFormat against Logger::logf(...) rendering the same messages: integers only, a mix with a float
+ * and strings, and a message below the logger level, which both should drop before formatting.
+ * The appender only keeps the last text, so that the numbers are about formatting and dispatch.
+ * Prints CSV: case, api, messages, ns per message
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+#include "log-format.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct LastAppender : LogAppender
+{
+    char last[128] = {};
+    bool append(const LogMessage *message)
+    {
+        if (message)
+            strncpy(last, message->message(), sizeof(last) - 1);
+        return true;
+    }
+};
+
+template <typename F>
+void measure(const char *name, const char *api, int messages, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++)
+        f(i);
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    printf("%s,%s,%d,%.1f\n", name, api, messages, (double)ns / messages);
+}
+
+int main()
+{
+    const int Messages = 500000;
+    LastAppender last;
+    Logging::addAppender(&last);
+    SimpleLoggable loggable("bench");
+    auto &logger = loggable.logger();
+    logger.setLevel(LogLevel::Info);
+    const char *names[] = {"pump", "fan", "heater", "valve"};
+
+    // same text from both, checked before measuring
+    std::string expected;
+    logger.logf(LogLevel::Info, "id %d count %u delta %lld", -7, 42u, -123456789012LL);
+    expected = last.last;
+    LogFormat::log(logger, LogLevel::Info, FMT("id {} count {} delta {}"), -7, 42u, -123456789012LL);
+    if (expected != last.last)
+        printf("# integers differ: \"%s\" and \"%s\"\n", expected.c_str(), last.last);
+    logger.logf(LogLevel::Info, "%s: temp %g state %s", names[1], 21.5, "on");
+    expected = last.last;
+    LogFormat::log(logger, LogLevel::Info, FMT("{}: temp {} state {}"), names[1], 21.5, "on");
+    if (expected != last.last)
+        printf("# mixed differ: \"%s\" and \"%s\"\n", expected.c_str(), last.last);
+
+    printf("case,api,messages,ns_per_message\n");
+    measure("integers", "logf", Messages, [&](int i) { logger.logf(LogLevel::Info, "id %d count %u delta %lld", i, (unsigned)i * 3, (long long)i * -1000003); });
+    measure("integers", "LogFormat", Messages, [&](int i) {
+        LogFormat::log(logger, LogLevel::Info, FMT("id {} count {} delta {}"), i, (unsigned)i * 3, (long long)i * -1000003);
+    });
+    measure("mixed", "logf", Messages, [&](int i) { logger.logf(LogLevel::Info, "%s: temp %g state %s", names[i & 3], 20 + (i & 15) * 0.5, i & 1 ? "on" : "off"); });
+    measure("mixed", "LogFormat", Messages, [&](int i) {
+        LogFormat::log(logger, LogLevel::Info, FMT("{}: temp {} state {}"), names[i & 3], 20 + (i & 15) * 0.5, i & 1 ? "on" : "off");
+    });
+    measure("disabled", "logf", Messages, [&](int i) { logger.logf(LogLevel::Debug, "id %d count %u delta %lld", i, (unsigned)i * 3, (long long)i * -1000003); });
+    measure("disabled", "LogFormat", Messages, [&](int i) {
+        LogFormat::log(logger, LogLevel::Debug, FMT("id {} count {} delta {}"), i, (unsigned)i * 3, (long long)i * -1000003);
+    });
+    Logging::removeAppender(&last);
+    return 0;
+}
@@ -0,0 +1,149 @@
+// sources: logging.cpp
+/**
+ * Characters per second through the UART hook, printed by 1 to 8 tasks at once, with the per-task line buffers of the library,
+ * and with the previous implementation, kept here as the baseline: one buffer for all tasks and its mutex taken for every character.
+ * Prints CSV: hook, tasks, chars, chars per second, lines logged
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+namespace esp32m
+{
+    LogLevel detectLevel(const char **mptr);
+}
+
+using namespace esp32m;
+
+/**
+ * SerialHook::hookImpl(...) before the per-task buffers. The recursion guard is per thread here, the shared one made
+ * the other tasks drop their characters while one was in the hook, which would make the baseline look faster than it was
+ */
+class LockedHook
+{
+public:
+    LockedHook(size_t bufsize)
+    {
+        _lock = xSemaphoreCreateMutex();
+        _serialBuf = (char *)malloc(_serialBufLen = bufsize);
+    }
+    ~LockedHook()
+    {
+        free(_serialBuf);
+        vSemaphoreDelete(_lock);
+    }
+    static LockedHook *instance;
+    static void hook(char c)
+    {
+        auto h = instance;
+        if (!h || _recursion)
+            return;
+        h->hookImpl(c);
+    }
+
+private:
+    void hookImpl(char c)
+    {
+        _recursion++;
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        auto b = _serialBuf;
+        auto bl = _serialBufLen;
+        if (b && bl)
+        {
+            if (c == '\n' || _serialBufPtr >= bl - 1)
+            {
+                b[_serialBufPtr] = 0;
+                _serialBufPtr = 0;
+                const char **mptr = (const char **)&b;
+                auto level = detectLevel(mptr);
+                xSemaphoreGive(_lock);
+                Logging::system().log(level, *mptr);
+                xSemaphoreTake(_lock, portMAX_DELAY);
+            }
+            if (c != '\n' && c != '\r')
+                b[_serialBufPtr++] = c;
+        }
+        xSemaphoreGive(_lock);
+        _recursion--;
+    }
+    SemaphoreHandle_t _lock;
+    char *_serialBuf;
+    size_t _serialBufLen;
+    int _serialBufPtr = 0;
+    static thread_local uint8_t _recursion;
+};
+
+LockedHook *LockedHook::instance = nullptr;
+thread_local uint8_t LockedHook::_recursion = 0;
+
+struct CountingAppender : LogAppender
+{
+    std::atomic<uint32_t> count{0};
+    bool append(const LogMessage *message)
+    {
+        if (message)
+            count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+};
+
+/**
+ * Every task prints @p lines lines of 63 characters and a newline through @p putc
+ */
+void run(const char *name, void (*putc)(char), int tasks, int lines, CountingAppender &counter)
+{
+    static const char line[] = "[I] sensor: temperature 21.5C, humidity 40%, pressure 1013hPa..\n";
+    counter.count = 0;
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < tasks; t++)
+        threads.emplace_back([&] {
+            ready++;
+            while (!go)
+                ;
+            for (int i = 0; i < lines; i++)
+                for (auto p = line; *p; p++)
+                    putc(*p);
+        });
+    while (ready < tasks)
+        ;
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (auto &t : threads)
+        t.join();
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    uint64_t chars = (uint64_t)tasks * lines * (sizeof(line) - 1);
+    printf("%s,%d,%llu,%.0f,%u\n", name, tasks, (unsigned long long)chars, chars * 1e6 / us, counter.count.load());
+}
+
+int main()
+{
+    const int Lines = 20000;
+    CountingAppender counter;
+    Logging::addAppender(&counter);
+    printf("hook,tasks,chars,chars_per_s,lines\n");
+    for (int tasks : {1, 2, 4, 8})
+    {
+        LockedHook::instance = new LockedHook(128);
+        run("locked", LockedHook::hook, tasks, Lines, counter);
+        delete LockedHook::instance;
+        LockedHook::instance = nullptr;
+    }
+    Logging::hookUartLogger(128);
+    for (int tasks : {1, 2, 4, 8})
+        run("per-task", hosttest::putc1, tasks, Lines, counter);
+    Logging::hookUartLogger(0);
+    Logging::removeAppender(&counter);
+    return 0;
+}
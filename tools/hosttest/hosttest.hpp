@@ -0,0 +1,112 @@
+#pragma once
+
+/**
+ * Helpers shared by the host tests, see run.sh
+ */
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+struct esp_mqtt_client;
+
+namespace hosttest
+{
+    /**
+     * Emulated flash of the partition returned by esp_partition_find_first(...), the tests set it up
+     */
+    extern uint8_t *flash;
+    extern size_t flashSize;
+    extern uint32_t flashErasedSectors;
+    /**
+     * Hook installed by ets_install_putc1(...), tests call it to emulate the ROM printing characters
+     */
+    extern void (*putc1)(char);
+    /**
+     * Set by a test to make other tasks run at a race window of the library, see LOGGING_POOL_RACE_WINDOW() in logging.cpp
+     */
+    extern void (*raceHook)();
+    inline void raceWindow()
+    {
+        if (raceHook)
+            raceHook();
+    }
+    /**
+     * Function installed by esp_log_set_vprintf(...), tests call it to emulate ESP-IDF logging
+     */
+    extern int (*logVprintf)(const char *, va_list);
+    /**
+     * @return Everything written to UART since the previous call
+     */
+    std::string takeUartOutput();
+    /**
+     * Every uart_write_bytes(...) takes this long, to emulate a slow line
+     */
+    extern uint32_t uartWriteDelayMs;
+
+    /**
+     * Contents of the files of the emulated file system, by name
+     */
+    extern std::map<std::string, std::string> files;
+    /**
+     * Bytes the file system may still write, to emulate power loss: writes are cut short once it's exhausted, and files can't be opened.
+     * Negative is unlimited.
+     */
+    extern long fsWriteBudget;
+    /**
+     * Operations done on the emulated file system, writes that extend a file are counted as growing it,
+     * they update the file size in the metadata on a real flash file system
+     */
+    struct FsStats
+    {
+        uint32_t opens, writes, grows, flushes, renames, removes;
+        uint64_t bytes;
+    };
+    extern FsStats fsStats;
+    /**
+     * The only MQTT client, esp_mqtt_client_publish(...) records payloads to @c mqttPublished and subscriptions to @c mqttSubscribed.
+     * The next @c mqttFailPublishes publishes fail.
+     */
+    extern esp_mqtt_client *const mqttClient;
+    extern std::vector<std::string> mqttPublished;
+    extern std::vector<std::string> mqttSubscribed;
+    extern int mqttFailPublishes;
+    /**
+     * Sends the event to the handler registered with esp_mqtt_client_register_event(...), if any
+     */
+    void mqttEvent(int id, const char *topic = nullptr, const char *data = nullptr);
+
+    /**
+     * Reported by WiFi.isConnected(), events are not sent when it changes, see @c wifiEvent(...)
+     */
+    extern std::atomic<bool> wifiConnected;
+    /**
+     * Sends the event to the handlers registered with WiFi.onEvent(...)
+     */
+    void wifiEvent(int id);
+    /**
+     * Sends on connected sockets whose peer is on this port fail with EWOULDBLOCK, 0 for none
+     */
+    extern std::atomic<int> udpBlockedPort;
+
+    extern std::atomic<int> failures;
+    /**
+     * @return Exit code of the test: 0 if all checks passed
+     */
+    int result();
+} // namespace hosttest
+
+#define CHECK(cond)                                                                  \
+    do                                                                               \
+    {                                                                                \
+        if (!(cond))                                                                 \
+        {                                                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            hosttest::failures++;                                                    \
+        }                                                                            \
+    } while (0)
@@ -0,0 +1,497 @@
+// sources: logging.cpp udp-appender.cpp
+/**
+ * Load generator for the appenders on the host, the counterpart of examples/loadgen, see loadgen.sh.
+ * Tasks call Logger::logf(...) at the combined rate given by --rate, in bursts, with levels and sizes drawn from a seeded
+ * pseudo-random sequence, so that every run generates exactly the same messages.
+ * The probe appender, registered after the sinks, sees every message once the sinks are done with it
+ * and records the end-to-end latency from the logf() call.
+ * Sinks:
+ *  - null: no sink, just the probe
+ *  - file: lines written to a file on tmpfs (/dev/shm, or --file)
+ *  - udp, udp-binary: UDPAppender in the Text or Binary mode, sending to a receiver on the loopback interface
+ * The results are written to --out as CSV, or JSON with --json, in the same layout as the device example prints them.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "logging.hpp"
+#include "udp-appender.hpp"
+
+using namespace esp32m;
+
+struct Options
+{
+    std::string sinks = "null";
+    int tasks = 4;
+    // messages per second, all tasks together
+    int rate = 2000;
+    int durationMs = 10000;
+    // queue size, 0 to dispatch messages right in the logging tasks
+    int queue = 4096;
+    int seed = 1;
+    // number of messages in a burst is uniformly distributed between 1 and 2*burst-1
+    int burst = 8;
+    // payload size is uniformly distributed between these
+    int sizeMin = 16;
+    int sizeMax = 128;
+    int sampleMs = 100;
+    bool json = false;
+    std::string file = "/dev/shm/esp32m-loadgen.log";
+    std::string out;
+};
+
+Options options;
+const LogLevel Levels[] = {LogLevel::Error, LogLevel::Warning, LogLevel::Info, LogLevel::Debug};
+const char *LevelNames[] = {"error", "warning", "info", "debug"};
+// relative weights of error, warning, info and debug messages
+const uint8_t Weights[] = {1, 4, 35, 60};
+
+/**
+ * Log-linear histogram in the spirit of HdrHistogram: 8 linear sub-buckets in every power of 2
+ */
+class Histogram
+{
+public:
+    static const int SubBits = 3;
+    static const int Sub = 1 << SubBits;
+    static const int Buckets = (32 - SubBits + 1) * Sub;
+    void record(uint32_t value)
+    {
+        _counts[index(value)].fetch_add(1, std::memory_order_relaxed);
+        auto max = _max.load(std::memory_order_relaxed);
+        while (value > max && !_max.compare_exchange_weak(max, value))
+            ;
+    }
+    uint32_t count(int i) const { return _counts[i].load(std::memory_order_relaxed); }
+    uint32_t max() const { return _max; }
+    static uint32_t lower(int i)
+    {
+        if (i < Sub)
+            return i;
+        int m = i / Sub + SubBits - 1;
+        return (uint32_t)(Sub + i % Sub) << (m - SubBits);
+    }
+    uint32_t percentile(double p) const
+    {
+        uint64_t total = 0;
+        for (int i = 0; i < Buckets; i++)
+            total += count(i);
+        uint64_t rank = total * p / 100, seen = 0;
+        for (int i = 0; i < Buckets; i++)
+            if ((seen += count(i)) > rank)
+                return lower(i);
+        return _max;
+    }
+
+private:
+    std::atomic<uint32_t> _counts[Buckets] = {};
+    std::atomic<uint32_t> _max{0};
+    static int index(uint32_t v)
+    {
+        if (v < Sub)
+            return v;
+        int m = 31 - __builtin_clz(v);
+        return (m - SubBits + 1) * Sub + ((v >> (m - SubBits)) & (Sub - 1));
+    }
+};
+
+struct Sample
+{
+    uint32_t ms;
+    uint32_t pending;
+    uint32_t generated;
+    uint32_t received;
+};
+
+Histogram latency;
+std::atomic<uint32_t> generated[4];
+std::atomic<uint32_t> received[4];
+std::vector<Sample> samples;
+std::vector<char> payload;
+int64_t started;
+std::atomic<int> running{0};
+
+int levelIndex(LogLevel level)
+{
+    for (int i = 0; i < 4; i++)
+        if (Levels[i] == level)
+            return i;
+    return 3;
+}
+
+/**
+ * Receives every message after the sinks, the message starts with the time it was logged at
+ */
+class Probe : public LogAppender
+{
+protected:
+    bool append(const LogMessage *message)
+    {
+        if (!message || strncmp(message->name(), "load.", 5))
+            return true;
+        auto now = esp_timer_get_time();
+        auto sent = strtoll(message->message(), nullptr, 10);
+        latency.record(now - sent);
+        received[levelIndex(message->level())]++;
+        return true;
+    }
+};
+
+/**
+ * Lines of text in a file, one write() per message
+ */
+class FileSink : public FormattingAppender
+{
+public:
+    FileSink(const char *path)
+    {
+        _fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    }
+    ~FileSink()
+    {
+        if (_fd >= 0)
+            ::close(_fd);
+    }
+    bool ok() const { return _fd >= 0; }
+    uint64_t bytes() const { return _bytes; }
+
+protected:
+    bool append(const char *message)
+    {
+        struct iovec iov[2] = {{(void *)message, strlen(message)}, {(void *)"\n", 1}};
+        auto written = writev(_fd, iov, 2);
+        if (written <= 0)
+            return false;
+        _bytes += written;
+        return true;
+    }
+
+private:
+    int _fd;
+    std::atomic<uint64_t> _bytes{0};
+};
+
+/**
+ * Loopback collector of the UDP sinks, counts what arrives
+ */
+class Receiver
+{
+public:
+    Receiver()
+    {
+        _fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int size = 4 << 20;
+        setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        struct timeval timeout = {0, 100000};
+        setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        socklen_t len = sizeof(addr);
+        if (bind(_fd, (struct sockaddr *)&addr, sizeof(addr)) || getsockname(_fd, (struct sockaddr *)&addr, &len))
+        {
+            ::close(_fd);
+            _fd = -1;
+            return;
+        }
+        _port = ntohs(addr.sin_port);
+        _thread = std::thread([this] {
+            char buf[65536];
+            while (!_stop)
+            {
+                auto n = recv(_fd, buf, sizeof(buf), 0);
+                if (n < 0)
+                    continue;
+                _datagrams++;
+                _bytes += n;
+            }
+        });
+    }
+    ~Receiver()
+    {
+        _stop = true;
+        if (_thread.joinable())
+            _thread.join();
+        if (_fd >= 0)
+            ::close(_fd);
+    }
+    uint16_t port() const { return _port; }
+    uint64_t datagrams() const { return _datagrams; }
+    uint64_t bytes() const { return _bytes; }
+
+private:
+    int _fd;
+    uint16_t _port = 0;
+    std::thread _thread;
+    std::atomic<bool> _stop{false};
+    std::atomic<uint64_t> _datagrams{0}, _bytes{0};
+};
+
+/**
+ * xorshift32, the same sequence for the same seed on every run
+ */
+uint32_t next(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+void generate(void *arg)
+{
+    auto index = (uint32_t)(uintptr_t)arg;
+    char name[16];
+    snprintf(name, sizeof(name), "load.%u", index);
+    SimpleLoggable loggable(name);
+    auto &logger = loggable.logger();
+    uint32_t state = options.seed * 2654435761u + index + 1;
+    uint32_t weights = 0;
+    for (auto w : Weights)
+        weights += w;
+    auto end = started + options.durationMs * 1000LL;
+    auto due = started;
+    while (esp_timer_get_time() < end)
+    {
+        auto burst = 1 + next(state) % (2 * options.burst - 1);
+        for (uint32_t i = 0; i < burst; i++)
+        {
+            auto w = next(state) % weights;
+            int l = 0;
+            while (w >= Weights[l])
+                w -= Weights[l++];
+            int size = options.sizeMin + next(state) % (options.sizeMax - options.sizeMin + 1);
+            logger.logf(Levels[l], "%lld %.*s", (long long)esp_timer_get_time(), size, payload.data());
+            generated[l]++;
+        }
+        // every task keeps its share of the rate on average, regardless of how long logging took
+        due += burst * 1000000LL * options.tasks / options.rate;
+        auto wait = (due - esp_timer_get_time()) / 1000;
+        if (wait > 0)
+            vTaskDelay(pdMS_TO_TICKS(wait));
+    }
+    running--;
+    vTaskDelete(nullptr);
+}
+
+uint32_t total(std::atomic<uint32_t> *counters)
+{
+    uint32_t result = 0;
+    for (int i = 0; i < 4; i++)
+        result += counters[i];
+    return result;
+}
+
+bool hasSink(const char *sink)
+{
+    auto sinks = options.sinks.c_str();
+    auto len = strlen(sink);
+    for (auto p = sinks; (p = strstr(p, sink)); p += len)
+        if ((p == sinks || p[-1] == ',') && (!p[len] || p[len] == ','))
+            return true;
+    return false;
+}
+
+void report(FILE *f, uint64_t fileBytes, uint64_t datagrams, uint64_t udpBytes)
+{
+    const double Percentiles[] = {50, 90, 99, 99.9, 100};
+    auto &o = options;
+    auto g = total(generated), r = total(received);
+    auto dropped = g ? 100.0 * (g - r) / g : 0;
+    if (o.json)
+    {
+        fprintf(f, "{\"sinks\":\"%s\",\"tasks\":%d,\"rate\":%d,\"duration_ms\":%d,\"queue\":%d,\"seed\":%d,", o.sinks.c_str(), o.tasks, o.rate, o.durationMs, o.queue, o.seed);
+        fprintf(f, "\"generated\":%u,\"received\":%u,\"dropped_pct\":%.3f,", g, r, dropped);
+        fprintf(f, "\"file_bytes\":%llu,\"udp_datagrams\":%llu,\"udp_bytes\":%llu,\"levels\":{", (unsigned long long)fileBytes, (unsigned long long)datagrams, (unsigned long long)udpBytes);
+        for (int i = 0; i < 4; i++)
+            fprintf(f, "%s\"%s\":[%u,%u]", i ? "," : "", LevelNames[i], (uint32_t)generated[i], (uint32_t)received[i]);
+        fprintf(f, "},\"latency_us\":{");
+        for (auto p : Percentiles)
+            fprintf(f, "%s\"p%g\":%u", p == Percentiles[0] ? "" : ",", p, p < 100 ? latency.percentile(p) : latency.max());
+        fprintf(f, "},\"histogram\":[");
+        bool first = true;
+        for (int i = 0; i < Histogram::Buckets; i++)
+            if (latency.count(i))
+            {
+                fprintf(f, "%s[%u,%u]", first ? "" : ",", Histogram::lower(i), latency.count(i));
+                first = false;
+            }
+        fprintf(f, "],\"occupancy\":[");
+        for (size_t i = 0; i < samples.size(); i++)
+            fprintf(f, "%s[%u,%u,%u,%u]", i ? "," : "", samples[i].ms, samples[i].pending, samples[i].generated, samples[i].received);
+        fprintf(f, "]}\n");
+        return;
+    }
+    fprintf(f, "# summary\n");
+    fprintf(f, "sinks,tasks,rate,duration_ms,queue,seed,generated,received,dropped_pct,file_bytes,udp_datagrams,udp_bytes\n");
+    fprintf(f, "%s,%d,%d,%d,%d,%d,%u,%u,%.3f,%llu,%llu,%llu\n", o.sinks.c_str(), o.tasks, o.rate, o.durationMs, o.queue, o.seed, g, r, dropped,
+            (unsigned long long)fileBytes, (unsigned long long)datagrams, (unsigned long long)udpBytes);
+    fprintf(f, "# levels\n");
+    fprintf(f, "level,generated,received\n");
+    for (int i = 0; i < 4; i++)
+        fprintf(f, "%s,%u,%u\n", LevelNames[i], (uint32_t)generated[i], (uint32_t)received[i]);
+    fprintf(f, "# latency_us\n");
+    fprintf(f, "percentile,value\n");
+    for (auto p : Percentiles)
+        fprintf(f, "%g,%u\n", p, p < 100 ? latency.percentile(p) : latency.max());
+    fprintf(f, "# histogram\n");
+    fprintf(f, "lower_us,count\n");
+    for (int i = 0; i < Histogram::Buckets; i++)
+        if (latency.count(i))
+            fprintf(f, "%u,%u\n", Histogram::lower(i), latency.count(i));
+    fprintf(f, "# occupancy\n");
+    fprintf(f, "ms,pending_bytes,generated,received\n");
+    for (auto &s : samples)
+        fprintf(f, "%u,%u,%u,%u\n", s.ms, s.pending, s.generated, s.received);
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: loadgen [--sinks null,file,udp,udp-binary] [--tasks N] [--rate N] [--duration-ms N] [--queue N] [--seed N]\n"
+                    "               [--burst N] [--size-min N] [--size-max N] [--sample-ms N] [--file PATH] [--json] [--out PATH]\n");
+    exit(2);
+}
+
+void parse(int argc, char **argv)
+{
+    auto &o = options;
+    struct
+    {
+        const char *name;
+        int *value;
+    } ints[] = {{"--tasks", &o.tasks}, {"--rate", &o.rate}, {"--duration-ms", &o.durationMs}, {"--queue", &o.queue}, {"--seed", &o.seed},
+                {"--burst", &o.burst}, {"--size-min", &o.sizeMin}, {"--size-max", &o.sizeMax}, {"--sample-ms", &o.sampleMs}};
+    for (int i = 1; i < argc; i++)
+    {
+        auto arg = argv[i];
+        if (!strcmp(arg, "--json"))
+        {
+            o.json = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            usage();
+        auto value = argv[++i];
+        if (!strcmp(arg, "--sinks"))
+            o.sinks = value;
+        else if (!strcmp(arg, "--file"))
+            o.file = value;
+        else if (!strcmp(arg, "--out"))
+            o.out = value;
+        else
+        {
+            bool found = false;
+            for (auto &opt : ints)
+                if (!strcmp(arg, opt.name))
+                {
+                    *opt.value = atoi(value);
+                    found = true;
+                }
+            if (!found)
+                usage();
+        }
+    }
+    if (o.tasks < 1 || o.rate < 1 || o.burst < 1 || o.sampleMs < 1 || o.sizeMin < 0 || o.sizeMax < o.sizeMin)
+        usage();
+    if (o.out.empty())
+        o.out = o.json ? "loadgen.json" : "loadgen.csv";
+}
+
+int main(int argc, char **argv)
+{
+    parse(argc, argv);
+    FileSink *file = nullptr;
+    if (hasSink("file"))
+    {
+        file = new FileSink(options.file.c_str());
+        if (!file->ok())
+        {
+            fprintf(stderr, "can't open %s\n", options.file.c_str());
+            return 1;
+        }
+        Logging::addAppender(file);
+    }
+    Receiver *receiver = nullptr;
+    if (hasSink("udp") || hasSink("udp-binary"))
+    {
+        receiver = new Receiver();
+        if (!receiver->port())
+        {
+            fprintf(stderr, "can't bind the loopback receiver\n");
+            return 1;
+        }
+    }
+    UDPAppender *udp = nullptr, *udpBinary = nullptr;
+    if (hasSink("udp"))
+    {
+        udp = new UDPAppender("127.0.0.1", receiver->port());
+        udp->setMode(UDPAppender::Text);
+        Logging::addAppender(udp);
+    }
+    if (hasSink("udp-binary"))
+    {
+        udpBinary = new UDPAppender("127.0.0.1", receiver->port());
+        udpBinary->setMode(UDPAppender::Binary);
+        Logging::addAppender(udpBinary);
+    }
+    // the probe goes last, so that it sees the messages after the sinks have recorded them
+    Probe probe;
+    Logging::addAppender(&probe);
+    Logging::setLevel(LogLevel::Debug);
+    payload.assign(options.sizeMax + 1, 'x');
+    if (options.queue)
+        Logging::useQueue(options.queue);
+    started = esp_timer_get_time();
+    running = options.tasks;
+    for (int i = 0; i < options.tasks; i++)
+        xTaskCreate(generate, "loadgen", 4096, (void *)(uintptr_t)i, 1, nullptr);
+    for (;;)
+    {
+        Sample s;
+        s.ms = (esp_timer_get_time() - started) / 1000;
+        s.pending = Logging::pending();
+        s.generated = total(generated);
+        s.received = total(received);
+        samples.push_back(s);
+        if (s.ms >= options.durationMs)
+            break;
+        vTaskDelay(pdMS_TO_TICKS(options.sampleMs));
+    }
+    while (running)
+        vTaskDelay(1);
+    // whatever is still queued is counted as received once it gets through
+    Logging::flush(5000);
+    Logging::useQueue(0);
+    if (receiver)
+    {
+        // binary frames go out once they are 200ms old, then wait for the datagrams in flight
+        vTaskDelay(pdMS_TO_TICKS(250));
+        Logging::flush(1000);
+        vTaskDelay(pdMS_TO_TICKS(200));
+    }
+    auto out = fopen(options.out.c_str(), "w");
+    if (!out)
+    {
+        fprintf(stderr, "can't write %s\n", options.out.c_str());
+        return 1;
+    }
+    report(out, file ? file->bytes() : 0, receiver ? receiver->datagrams() : 0, receiver ? receiver->bytes() : 0);
+    fclose(out);
+    fprintf(stderr, "%s: generated %u, received %u\n", options.out.c_str(), total(generated), total(received));
+    return 0;
+}
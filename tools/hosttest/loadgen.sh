@@ -0,0 +1,23 @@
+#!/bin/sh
+#
+# Builds the host load generator (loadgen.cpp) with optimizations and without sanitizers, and runs it with the given options
+#
+# Usage:
+#   tools/hosttest/loadgen.sh --sinks file,udp --rate 20000 --json --out /tmp/load.json
+#
+# Relative --out and --file paths are relative to the current directory.
+#
+DIR=$(cd "$(dirname "$0")" && pwd) || exit 1
+ROOT=$DIR/../..
+BUILD=$DIR/build/loadgen
+CXX=${CXX:-g++}
+FLAGS="-std=gnu++11 -O2 -g -Wall -Wno-sign-compare -Wno-unused-variable -Wno-unused-function -I$DIR/stubs -I$DIR -I$ROOT/include"
+mkdir -p $BUILD
+
+sources=$(sed -n 's|^// sources:||p' "$DIR/loadgen.cpp" | head -n 1)
+objs=""
+for s in $sources; do
+    objs="$objs $ROOT/src/$s"
+done
+$CXX $FLAGS "$DIR/loadgen.cpp" $objs "$DIR/stubs/stubs.cpp" -lpthread -o $BUILD/loadgen || exit 1
+exec $BUILD/loadgen "$@"
@@ -0,0 +1,82 @@
+// sources: logging.cpp
+/**
+ * Queue producer scaling on the host, see ringbench.sh.
+ * --threads tasks log --messages errors each as fast as they can into a queue large enough to never make them wait,
+ * while the queue task drains it into an appender that only counts. Built with portNUM_PROCESSORS=1 every task pushes
+ * into the same ring under the same lock, with portNUM_PROCESSORS=8 every task gets a ring of its own, the way
+ * the tasks of different cores do on the chip.
+ * Prints one CSV line: rings, threads, messages, producer time, enqueue rate, time to drain
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct CountingAppender : LogAppender
+{
+    std::atomic<uint32_t> count{0};
+    bool append(const LogMessage *message)
+    {
+        if (message)
+            count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    int threads = 4, messages = 20000;
+    for (int i = 1; i + 1 < argc; i += 2)
+        if (!strcmp(argv[i], "--threads"))
+            threads = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--messages"))
+            messages = atoi(argv[i + 1]);
+    CountingAppender counter;
+    Logging::addAppender(&counter);
+    // errors get 3/8 of the queue, enough for every message with room to spare
+    Logging::useQueue(threads * messages * 256);
+    SimpleLoggable loggable("bench");
+    auto &logger = loggable.logger();
+
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; t++)
+        producers.emplace_back([&] {
+            // takes the next core before the clock starts
+            xPortGetCoreID();
+            ready++;
+            while (!go)
+                ;
+            for (int i = 0; i < messages; i++)
+                logger.logf(LogLevel::Error, "message %d", i);
+        });
+    while (ready < threads)
+        ;
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (auto &p : producers)
+        p.join();
+    auto produced = std::chrono::steady_clock::now();
+    uint32_t total = threads * messages;
+    while (counter.count < total)
+        std::this_thread::yield();
+    auto drained = std::chrono::steady_clock::now();
+
+    auto us = [&](std::chrono::steady_clock::time_point t) { return std::chrono::duration_cast<std::chrono::microseconds>(t - start).count(); };
+    printf("%d,%d,%u,%lld,%.0f,%lld\n", portNUM_PROCESSORS, threads, total, (long long)us(produced), total * 1e6 / us(produced), (long long)us(drained));
+    Logging::useQueue(0);
+    Logging::removeAppender(&counter);
+    return 0;
+}
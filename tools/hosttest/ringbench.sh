@@ -0,0 +1,31 @@
+#!/bin/sh
+#
+# Measures how the queue producers scale from 1 to 8 threads with a single ring shared by all of them,
+# and with a ring per thread, the host counterpart of a ring per core (ringbench.cpp).
+# Prints CSV: rings, threads, messages, producer time in us, messages per second, time to drain in us
+#
+# Usage:
+#   tools/hosttest/ringbench.sh [messages per thread]
+#
+DIR=$(cd "$(dirname "$0")" && pwd) || exit 1
+ROOT=$DIR/../..
+BUILD=$DIR/build/ringbench
+CXX=${CXX:-g++}
+FLAGS="-std=gnu++11 -O2 -g -Wall -Wno-sign-compare -Wno-unused-variable -Wno-unused-function -I$DIR/stubs -I$DIR -I$ROOT/include"
+MESSAGES=${1:-20000}
+mkdir -p $BUILD
+
+sources=$(sed -n 's|^// sources:||p' "$DIR/ringbench.cpp" | head -n 1)
+objs=""
+for s in $sources; do
+    objs="$objs $ROOT/src/$s"
+done
+for rings in 1 8; do
+    $CXX $FLAGS -DportNUM_PROCESSORS=$rings "$DIR/ringbench.cpp" $objs "$DIR/stubs/stubs.cpp" -lpthread -o $BUILD/ringbench-$rings || exit 1
+done
+echo "rings,threads,messages,produce_us,msgs_per_s,drain_us"
+for rings in 1 8; do
+    for threads in 1 2 4 8; do
+        $BUILD/ringbench-$rings --threads $threads --messages $MESSAGES || exit 1
+    done
+done
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# Builds and runs the host tests of the library on Linux, against the platform stubs in stubs/
+#
+# Usage:
+#   tools/hosttest/run.sh           syntax-check all library sources, then run all tests
+#   tools/hosttest/run.sh queue     run only the tests with "queue" in the name
+#
+# Every test_*.cpp names the library sources it links with in a "// sources:" line, and may add compiler flags in a "// flags:" line.
+# Tests are built with the address and undefined behavior sanitizers, into tools/hosttest/build.
+#
+cd "$(dirname "$0")" || exit 1
+ROOT=../..
+BUILD=build
+CXX=${CXX:-g++}
+FLAGS="-std=gnu++11 -g -O1 -Wall -Wno-sign-compare -Wno-unused-variable -Wno-unused-function -Istubs -I. -I$ROOT/include"
+SANITIZE="-fsanitize=address,undefined -fno-omit-frame-pointer"
+export ASAN_OPTIONS=detect_leaks=0
+mkdir -p $BUILD
+
+failed=0
+if [ -z "$1" ]; then
+    for f in $ROOT/src/*.cpp; do
+        $CXX $FLAGS -fsyntax-only "$f" || failed=1
+    done
+fi
+$CXX $FLAGS $SANITIZE -c stubs/stubs.cpp -o $BUILD/stubs.o || exit 1
+
+for t in test_*.cpp; do
+    name=${t%.cpp}
+    case "$name" in *"$1"*) ;; *) continue ;; esac
+    sources=$(sed -n 's|^// sources:||p' "$t" | head -n 1)
+    extra=$(sed -n 's|^// flags:||p' "$t" | head -n 1)
+    objs=""
+    for s in $sources; do
+        objs="$objs $ROOT/src/$s"
+    done
+    if ! $CXX $FLAGS $extra $SANITIZE "$t" $objs $BUILD/stubs.o -lpthread -o $BUILD/$name; then
+        echo "FAIL $name (build)"
+        failed=1
+        continue
+    fi
+    if timeout 120 $BUILD/$name; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        failed=1
+    fi
+done
+exit $failed
@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include "freertos/semphr.h"
+struct String : std::string { String(){} String(const char*s):std::string(s){} String(const std::string&s):std::string(s){} void reserve(size_t n){std::string::reserve(n);} int lastIndexOf(char c) const {auto p=rfind(c);return p==npos?-1:(int)p;} String substring(size_t a) const {return substr(a);} String substring(size_t a,size_t b) const {return substr(a,b-a);} void concat(char c){push_back(c);} void concat(int i){append(std::to_string(i));} void concat(const String&s){append(s);} const char*c_str()const{return std::string::c_str();} operator const char*() const {return c_str();} };
+enum SeekMode { SeekSet, SeekCur, SeekEnd };
+struct File { std::string *data = nullptr; size_t pos = 0; bool appending = false; operator bool() const; size_t size(); size_t println(const char*); size_t write(const uint8_t*, size_t); size_t write(uint8_t); size_t read(uint8_t*, size_t); bool seek(uint32_t, SeekMode = SeekSet); size_t position(); void flush(); void close(); };
+struct FS { File open(const char*, const char* = "r"); bool exists(const char*); bool remove(const char*); bool rename(const char*, const char*); };
@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+typedef enum { ARDUINO_EVENT_WIFI_STA_GOT_IP, ARDUINO_EVENT_WIFI_STA_LOST_IP, ARDUINO_EVENT_WIFI_STA_DISCONNECTED } arduino_event_id_t;
+typedef struct {} arduino_event_info_t;
+struct IPAddress { operator uint32_t() const; };
+typedef size_t wifi_event_id_t;
+struct WiFiClass { void begin(const char*, const char*); bool isConnected(); IPAddress gatewayIP(); const char *getHostname(); wifi_event_id_t onEvent(std::function<void(arduino_event_id_t, arduino_event_info_t)>); void removeEvent(wifi_event_id_t); };
+extern WiFiClass WiFi;
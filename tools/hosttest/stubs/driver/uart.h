@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "../freertos/FreeRTOS.h"
+typedef int uart_port_t;
+typedef int esp_err_t;
+typedef void *QueueHandle_t;
+#define ESP_OK 0
+esp_err_t uart_driver_install(uart_port_t, int, int, int, QueueHandle_t *, int);
+bool uart_is_driver_installed(uart_port_t);
+int uart_write_bytes(uart_port_t, const void *, size_t);
+esp_err_t uart_wait_tx_done(uart_port_t, TickType_t);
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+unsigned long millis();
+void yield();
+int ets_printf(const char *fmt, ...);
+void ets_install_putc1(void (*)(char));
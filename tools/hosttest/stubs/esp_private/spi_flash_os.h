@@ -0,0 +1,6 @@
+#pragma once
+#include <esp_partition.h>
+typedef struct { void (*start)(void); void (*end)(void); } spi_flash_guard_funcs_t;
+extern const spi_flash_guard_funcs_t g_flash_guard_no_os_ops;
+void spi_flash_guard_set(const spi_flash_guard_funcs_t *funcs);
+esp_err_t esp_flash_app_disable_protect(bool disable);
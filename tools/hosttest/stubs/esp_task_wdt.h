@@ -0,0 +1,6 @@
+#pragma once
+#include "freertos/task.h"
+typedef int esp_err_t;
+esp_err_t esp_task_wdt_add(TaskHandle_t);
+esp_err_t esp_task_wdt_delete(TaskHandle_t);
+esp_err_t esp_task_wdt_reset();
@@ -0,0 +1,14 @@
+#pragma once
+#include "FreeRTOS.h"
+typedef void *RingbufHandle_t;
+typedef enum { RINGBUF_TYPE_NOSPLIT, RINGBUF_TYPE_ALLOWSPLIT, RINGBUF_TYPE_BYTEBUF } RingbufferType_t;
+RingbufHandle_t xRingbufferCreate(size_t, RingbufferType_t);
+BaseType_t xRingbufferSend(RingbufHandle_t, const void *, size_t, TickType_t);
+void *xRingbufferReceive(RingbufHandle_t, size_t *, TickType_t);
+void *xRingbufferReceiveUpTo(RingbufHandle_t, size_t *, TickType_t, size_t);
+void vRingbufferReturnItem(RingbufHandle_t, void *);
+void vRingbufferDelete(RingbufHandle_t);
+size_t xRingbufferGetCurFreeSize(RingbufHandle_t);
+size_t xRingbufferGetMaxItemSize(RingbufHandle_t);
+BaseType_t xRingbufferSendAcquire(RingbufHandle_t, void **, size_t, TickType_t);
+BaseType_t xRingbufferSendComplete(RingbufHandle_t, void *);
@@ -0,0 +1,9 @@
+#pragma once
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/uio.h>
+#define inet_aton(cp, addr) inet_aton(cp, (struct in_addr *)(addr))
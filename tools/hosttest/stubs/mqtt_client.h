@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+typedef int esp_err_t;
+typedef const char *esp_event_base_t;
+typedef enum { MQTT_EVENT_ANY=-1, MQTT_EVENT_ERROR=0, MQTT_EVENT_CONNECTED, MQTT_EVENT_DISCONNECTED, MQTT_EVENT_SUBSCRIBED, MQTT_EVENT_UNSUBSCRIBED, MQTT_EVENT_PUBLISHED, MQTT_EVENT_DATA } esp_mqtt_event_id_t;
+typedef struct esp_mqtt_event_t { esp_mqtt_event_id_t event_id; esp_mqtt_client_handle_t client; char *data; int data_len; int total_data_len; int current_data_offset; char *topic; int topic_len; int msg_id; } *esp_mqtt_event_handle_t;
+typedef void (*esp_event_handler_t)(void*, esp_event_base_t, int32_t, void*);
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t, const char *, const char *, int, int, int);
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t, const char *, int);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t, esp_mqtt_event_id_t, esp_event_handler_t, void *);
+esp_err_t esp_mqtt_client_unregister_event(esp_mqtt_client_handle_t, esp_mqtt_event_id_t, esp_event_handler_t);
@@ -0,0 +1,3 @@
+#pragma once
+#include <stdint.h>
+void ets_write_char_uart(char c);
@@ -0,0 +1,697 @@
+/**
+ * Host implementations of the ESP-IDF and Arduino functions used by the library, just enough to run it on Linux:
+ * tasks are threads, critical sections spin on their mux, flash is a RAM buffer, UART output is collected in a string.
+ * A plain (non-recursive) mutex taken twice by the same task aborts the test instead of hanging, like a deadlock on the chip would.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/ringbuf.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "driver/uart.h"
+#include "esp_private/spi_flash_os.h"
+#include "esp32-hal.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "rom/uart.h"
+#include "WiFi.h"
+#include "FS.h"
+#include "mqtt_client.h"
+
+#include "../hosttest.hpp"
+
+namespace hosttest
+{
+    uint8_t *flash = nullptr;
+    size_t flashSize = 0;
+    uint32_t flashErasedSectors = 0;
+    void (*raceHook)() = nullptr;
+    std::mutex uartLock;
+    std::string uartOutput;
+    uint32_t uartWriteDelayMs = 0;
+    void (*putc1)(char) = nullptr;
+    int (*logVprintf)(const char *, va_list) = vprintf;
+    std::atomic<int> failures{0};
+
+    int result()
+    {
+        if (failures)
+            fprintf(stderr, "%d checks failed\n", failures.load());
+        return failures ? 1 : 0;
+    }
+
+    std::string takeUartOutput()
+    {
+        std::lock_guard<std::mutex> guard(uartLock);
+        std::string result;
+        result.swap(uartOutput);
+        return result;
+    }
+} // namespace hosttest
+
+using namespace hosttest;
+
+struct Task
+{
+    std::string name;
+    std::mutex lock;
+    std::condition_variable cv;
+    uint32_t notifications = 0;
+};
+
+static thread_local Task *currentTask = nullptr;
+
+static Task *self()
+{
+    if (!currentTask)
+    {
+        currentTask = new Task();
+        currentTask->name = "main";
+    }
+    return currentTask;
+}
+
+// a spinlock per mux like on the chip, so that critical sections on different muxes don't serialize each other
+static std::atomic<uint32_t> nextOwner(1);
+static thread_local uint32_t owner = 0;
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    if (!owner)
+        owner = nextOwner++;
+    if (__atomic_load_n(&mux->owner, __ATOMIC_RELAXED) == owner)
+    {
+        mux->count++;
+        return;
+    }
+    uint32_t free = 0;
+    while (!__atomic_compare_exchange_n(&mux->owner, &free, owner, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        free = 0;
+        std::this_thread::yield();
+    }
+    mux->count = 1;
+}
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    if (--mux->count == 0)
+        __atomic_store_n(&mux->owner, 0, __ATOMIC_RELEASE);
+}
+// threads are spread over the cores in the order they first ask
+static std::atomic<int> nextCore(0);
+BaseType_t xPortGetCoreID()
+{
+    static thread_local int core = nextCore++ % portNUM_PROCESSORS;
+    return core;
+}
+BaseType_t xPortInIsrContext() { return 0; }
+
+BaseType_t xTaskCreate(TaskFunction_t f, const char *name, uint32_t, void *arg, UBaseType_t, TaskHandle_t *handle)
+{
+    auto task = new Task();
+    task->name = name;
+    if (handle)
+        *handle = task;
+    std::thread([=]() {
+        currentTask = task;
+        f(arg);
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t f, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle, BaseType_t)
+{
+    return xTaskCreate(f, name, stack, arg, priority, handle);
+}
+
+// threads can't be killed, a task deleting itself just returns from its function
+void vTaskDelete(TaskHandle_t) {}
+void vTaskDelay(TickType_t ticks) { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
+TickType_t xTaskGetTickCount() { return esp_timer_get_time() / 1000; }
+
+void vTaskDelayUntil(TickType_t *wake, TickType_t ticks)
+{
+    auto now = xTaskGetTickCount();
+    *wake += ticks;
+    if (*wake > now)
+        vTaskDelay(*wake - now);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return self(); }
+char *pcTaskGetName(TaskHandle_t t) { return (char *)((Task *)(t ? t : self()))->name.c_str(); }
+char *pcTaskGetTaskName(TaskHandle_t t) { return pcTaskGetName(t); }
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    auto task = self();
+    std::unique_lock<std::mutex> guard(task->lock);
+    task->cv.wait_for(guard, std::chrono::milliseconds(ticks == portMAX_DELAY ? 100000000 : ticks), [task] { return task->notifications > 0; });
+    auto result = task->notifications;
+    if (result)
+        task->notifications = clear ? 0 : result - 1;
+    return result;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t t)
+{
+    auto task = (Task *)t;
+    if (!task)
+        return pdFALSE;
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        task->notifications++;
+    }
+    task->cv.notify_all();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t t, BaseType_t *) { xTaskNotifyGive(t); }
+
+struct Semaphore
+{
+    Semaphore(bool binary, bool recursive) : binary(binary), recursive(recursive) {}
+    bool binary, recursive;
+    std::thread::id owner;
+    std::recursive_mutex mutex;
+    std::mutex lock;
+    std::condition_variable cv;
+    int count = 0;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new Semaphore(false, false); }
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return new Semaphore(false, true); }
+SemaphoreHandle_t xSemaphoreCreateBinary() { return new Semaphore(true, false); }
+void vSemaphoreDelete(SemaphoreHandle_t s) { delete (Semaphore *)s; }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t h, TickType_t ticks)
+{
+    auto s = (Semaphore *)h;
+    if (!s->binary)
+    {
+        if (!s->recursive && s->owner == std::this_thread::get_id())
+        {
+            fprintf(stderr, "deadlock: mutex taken twice by the same task\n");
+            abort();
+        }
+        if (ticks == portMAX_DELAY)
+            s->mutex.lock();
+        else
+        {
+            auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks);
+            while (!s->mutex.try_lock())
+            {
+                if (std::chrono::steady_clock::now() >= until)
+                    return pdFALSE;
+                std::this_thread::yield();
+            }
+        }
+        if (!s->recursive)
+            s->owner = std::this_thread::get_id();
+        return pdTRUE;
+    }
+    std::unique_lock<std::mutex> guard(s->lock);
+    if (!s->cv.wait_for(guard, std::chrono::milliseconds(ticks == portMAX_DELAY ? 100000000 : ticks), [s] { return s->count > 0; }))
+        return pdFALSE;
+    s->count = 0;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t h)
+{
+    auto s = (Semaphore *)h;
+    if (!s->binary)
+    {
+        if (!s->recursive)
+            s->owner = std::thread::id();
+        s->mutex.unlock();
+        return pdTRUE;
+    }
+    {
+        std::lock_guard<std::mutex> guard(s->lock);
+        s->count = 1;
+    }
+    s->cv.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t s, TickType_t ticks) { return xSemaphoreTake(s, ticks); }
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t s) { return xSemaphoreGive(s); }
+
+/**
+ * No-split ring buffer: every item costs its size plus an 8 bytes header, like on the chip
+ */
+struct Ring
+{
+    static const size_t Header = 8;
+    size_t capacity, used = 0;
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::vector<uint8_t> *> items;
+    std::map<void *, std::vector<uint8_t> *> received;
+};
+
+RingbufHandle_t xRingbufferCreate(size_t size, RingbufferType_t)
+{
+    auto r = new Ring();
+    r->capacity = size;
+    return r;
+}
+
+void vRingbufferDelete(RingbufHandle_t h) { delete (Ring *)h; }
+
+BaseType_t xRingbufferSendAcquire(RingbufHandle_t h, void **item, size_t size, TickType_t ticks)
+{
+    auto r = (Ring *)h;
+    std::unique_lock<std::mutex> guard(r->lock);
+    if (!r->cv.wait_for(guard, std::chrono::milliseconds(ticks == portMAX_DELAY ? 100000000 : ticks), [r, size] { return r->used + size + Ring::Header <= r->capacity; }))
+        return pdFALSE;
+    auto v = new std::vector<uint8_t>(size);
+    r->items.push_back(v);
+    r->used += size + Ring::Header;
+    *item = v->data();
+    return pdTRUE;
+}
+
+BaseType_t xRingbufferSendComplete(RingbufHandle_t h, void *)
+{
+    ((Ring *)h)->cv.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xRingbufferSend(RingbufHandle_t h, const void *data, size_t size, TickType_t ticks)
+{
+    void *item;
+    if (!xRingbufferSendAcquire(h, &item, size, ticks))
+        return pdFALSE;
+    memcpy(item, data, size);
+    return xRingbufferSendComplete(h, item);
+}
+
+void *xRingbufferReceive(RingbufHandle_t h, size_t *size, TickType_t ticks)
+{
+    auto r = (Ring *)h;
+    std::unique_lock<std::mutex> guard(r->lock);
+    if (!r->cv.wait_for(guard, std::chrono::milliseconds(ticks == portMAX_DELAY ? 100000000 : ticks), [r] { return !r->items.empty(); }))
+        return nullptr;
+    auto v = r->items.front();
+    r->items.pop_front();
+    r->received[v->data()] = v;
+    *size = v->size();
+    return v->data();
+}
+
+void *xRingbufferReceiveUpTo(RingbufHandle_t h, size_t *size, TickType_t ticks, size_t)
+{
+    return xRingbufferReceive(h, size, ticks);
+}
+
+void vRingbufferReturnItem(RingbufHandle_t h, void *item)
+{
+    auto r = (Ring *)h;
+    {
+        std::lock_guard<std::mutex> guard(r->lock);
+        auto it = r->received.find(item);
+        if (it == r->received.end())
+            return;
+        r->used -= it->second->size() + Ring::Header;
+        delete it->second;
+        r->received.erase(it);
+    }
+    r->cv.notify_all();
+}
+
+size_t xRingbufferGetCurFreeSize(RingbufHandle_t h)
+{
+    auto r = (Ring *)h;
+    std::lock_guard<std::mutex> guard(r->lock);
+    return r->capacity - r->used;
+}
+
+size_t xRingbufferGetMaxItemSize(RingbufHandle_t h) { return ((Ring *)h)->capacity - Ring::Header; }
+
+int64_t esp_timer_get_time()
+{
+    static auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() + 1000;
+}
+
+struct esp_timer
+{
+    esp_timer_create_args_t args;
+    std::mutex lock;
+    std::condition_variable cv;
+    // esp_timer_get_time() when the timer fires, 0 if it's not armed
+    int64_t due = 0;
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    auto timer = new esp_timer();
+    timer->args = *args;
+    *handle = timer;
+    std::thread([timer]() {
+        currentTask = new Task();
+        currentTask->name = "esp_timer";
+        std::unique_lock<std::mutex> guard(timer->lock);
+        for (;;)
+        {
+            if (!timer->due)
+                timer->cv.wait(guard);
+            else if (esp_timer_get_time() < timer->due)
+                timer->cv.wait_for(guard, std::chrono::microseconds(timer->due - esp_timer_get_time()));
+            else
+            {
+                timer->due = 0;
+                guard.unlock();
+                timer->args.callback(timer->args.arg);
+                guard.lock();
+            }
+        }
+    }).detach();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+    std::lock_guard<std::mutex> guard(timer->lock);
+    if (timer->due)
+        return ESP_ERR_INVALID_STATE;
+    timer->due = esp_timer_get_time() + timeoutUs;
+    timer->cv.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::mutex> guard(timer->lock);
+    if (!timer->due)
+        return ESP_ERR_INVALID_STATE;
+    timer->due = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_add(TaskHandle_t) { return ESP_OK; }
+esp_err_t esp_task_wdt_delete(TaskHandle_t) { return ESP_OK; }
+esp_err_t esp_task_wdt_reset() { return ESP_OK; }
+unsigned long millis() { return esp_timer_get_time() / 1000; }
+void yield() { std::this_thread::yield(); }
+esp_cpu_ccount_t esp_cpu_get_ccount() { return (esp_cpu_ccount_t)(esp_timer_get_time() * 240); }
+uint32_t esp_random() { return (uint32_t)rand(); }
+
+int ets_printf(const char *fmt, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    int result = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    std::lock_guard<std::mutex> guard(uartLock);
+    uartOutput += buf;
+    return result;
+}
+
+void ets_install_putc1(void (*f)(char)) { putc1 = f; }
+
+void ets_write_char_uart(char c)
+{
+    std::lock_guard<std::mutex> guard(uartLock);
+    uartOutput += c;
+}
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func)
+{
+    auto prev = logVprintf;
+    logVprintf = func;
+    return prev;
+}
+
+bool uart_is_driver_installed(uart_port_t) { return true; }
+esp_err_t uart_driver_install(uart_port_t, int, int, int, QueueHandle_t *, int) { return ESP_OK; }
+esp_err_t uart_wait_tx_done(uart_port_t, TickType_t) { return ESP_OK; }
+
+int uart_write_bytes(uart_port_t, const void *data, size_t size)
+{
+    if (uartWriteDelayMs)
+        vTaskDelay(uartWriteDelayMs);
+    std::lock_guard<std::mutex> guard(uartLock);
+    uartOutput.append((const char *)data, size);
+    return size;
+}
+
+static esp_partition_t partition = {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, 0, 0, "host"};
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t, esp_partition_subtype_t, const char *)
+{
+    partition.size = flashSize;
+    return flash ? &partition : nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *, size_t offset, void *data, size_t size)
+{
+    if (offset + size > flashSize)
+        return ESP_FAIL;
+    memcpy(data, flash + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *, size_t offset, const void *data, size_t size)
+{
+    if (offset + size > flashSize)
+        return ESP_FAIL;
+    // programming only clears bits, like NOR flash
+    for (size_t i = 0; i < size; i++)
+        flash[offset + i] &= ((const uint8_t *)data)[i];
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *, size_t offset, size_t size)
+{
+    if (offset % 4096 || size % 4096 || offset + size > flashSize)
+        return ESP_FAIL;
+    memset(flash + offset, 0xFF, size);
+    flashErasedSectors += size / 4096;
+    return ESP_OK;
+}
+
+const spi_flash_guard_funcs_t g_flash_guard_no_os_ops = {nullptr, nullptr};
+void spi_flash_guard_set(const spi_flash_guard_funcs_t *) {}
+esp_err_t esp_flash_app_disable_protect(bool) { return ESP_OK; }
+
+WiFiClass WiFi;
+IPAddress::operator uint32_t() const { return 0x0100007F; }
+void WiFiClass::begin(const char *, const char *) {}
+bool WiFiClass::isConnected() { return wifiConnected; }
+IPAddress WiFiClass::gatewayIP() { return IPAddress(); }
+const char *WiFiClass::getHostname() { return "host"; }
+static std::mutex wifiLock;
+static std::map<wifi_event_id_t, std::function<void(arduino_event_id_t, arduino_event_info_t)>> wifiHandlers;
+static wifi_event_id_t wifiNextId = 1;
+wifi_event_id_t WiFiClass::onEvent(std::function<void(arduino_event_id_t, arduino_event_info_t)> handler)
+{
+    std::lock_guard<std::mutex> guard(wifiLock);
+    wifiHandlers[wifiNextId] = handler;
+    return wifiNextId++;
+}
+void WiFiClass::removeEvent(wifi_event_id_t id)
+{
+    std::lock_guard<std::mutex> guard(wifiLock);
+    wifiHandlers.erase(id);
+}
+
+namespace hosttest
+{
+    std::atomic<bool> wifiConnected(true);
+    void wifiEvent(int id)
+    {
+        std::lock_guard<std::mutex> guard(wifiLock);
+        arduino_event_info_t info;
+        for (auto &h : wifiHandlers)
+            h.second((arduino_event_id_t)id, info);
+    }
+    std::atomic<int> udpBlockedPort(0);
+}
+
+// sends on connected sockets fail with EWOULDBLOCK while their peer's port is hosttest::udpBlockedPort, as if the socket buffer was full
+static bool udpBlocked(int fd)
+{
+    auto port = hosttest::udpBlockedPort.load();
+    if (!port)
+        return false;
+    struct sockaddr_in peer;
+    socklen_t len = sizeof(peer);
+    if (getpeername(fd, (struct sockaddr *)&peer, &len) || peer.sin_family != AF_INET || ntohs(peer.sin_port) != port)
+        return false;
+    errno = EWOULDBLOCK;
+    return true;
+}
+extern "C" ssize_t send(int fd, const void *buf, size_t len, int flags)
+{
+    if (udpBlocked(fd))
+        return -1;
+    return syscall(SYS_sendto, fd, buf, len, flags, nullptr, 0);
+}
+extern "C" ssize_t sendmsg(int fd, const struct msghdr *msg, int flags)
+{
+    if (udpBlocked(fd))
+        return -1;
+    return syscall(SYS_sendmsg, fd, msg, flags);
+}
+
+namespace hosttest
+{
+    std::map<std::string, std::string> files;
+    long fsWriteBudget = -1;
+    FsStats fsStats = {};
+}
+File::operator bool() const { return data != nullptr; }
+size_t File::size() { return data ? data->size() : 0; }
+size_t File::println(const char *s) { return write((const uint8_t *)s, strlen(s)) + write((const uint8_t *)"\r\n", 2); }
+size_t File::write(const uint8_t *buf, size_t size)
+{
+    if (!data)
+        return 0;
+    if (appending)
+        pos = data->size();
+    if (fsWriteBudget >= 0)
+    {
+        size = std::min(size, (size_t)fsWriteBudget);
+        fsWriteBudget -= size;
+    }
+    hosttest::fsStats.writes++;
+    hosttest::fsStats.bytes += size;
+    if (data->size() < pos + size)
+    {
+        hosttest::fsStats.grows++;
+        data->resize(pos + size);
+    }
+    memcpy(&(*data)[pos], buf, size);
+    pos += size;
+    return size;
+}
+size_t File::write(uint8_t c) { return write(&c, 1); }
+size_t File::read(uint8_t *buf, size_t size)
+{
+    if (!data || pos >= data->size())
+        return 0;
+    size = std::min(size, data->size() - pos);
+    memcpy(buf, data->data() + pos, size);
+    pos += size;
+    return size;
+}
+bool File::seek(uint32_t offset, SeekMode mode)
+{
+    if (!data)
+        return false;
+    pos = mode == SeekSet ? offset : (mode == SeekCur ? pos + offset : data->size() + offset);
+    return true;
+}
+size_t File::position() { return pos; }
+void File::flush() { hosttest::fsStats.flushes++; }
+void File::close() { data = nullptr; }
+File FS::open(const char *name, const char *mode)
+{
+    File f;
+    if (!fsWriteBudget || (*mode == 'r' && !exists(name)))
+        return f;
+    hosttest::fsStats.opens++;
+    f.data = &hosttest::files[name];
+    if (*mode == 'w')
+        f.data->clear();
+    f.appending = *mode == 'a';
+    f.pos = f.appending ? f.data->size() : 0;
+    return f;
+}
+bool FS::exists(const char *name) { return hosttest::files.count(name) != 0; }
+bool FS::remove(const char *name)
+{
+    hosttest::fsStats.removes++;
+    return hosttest::files.erase(name) != 0;
+}
+bool FS::rename(const char *from, const char *to)
+{
+    auto it = hosttest::files.find(from);
+    if (it == hosttest::files.end())
+        return false;
+    hosttest::fsStats.renames++;
+    hosttest::files[to] = it->second;
+    hosttest::files.erase(it);
+    return true;
+}
+
+struct esp_mqtt_client
+{
+    esp_event_handler_t handler;
+    void *arg;
+};
+namespace hosttest
+{
+    esp_mqtt_client client = {};
+    esp_mqtt_client *const mqttClient = &client;
+    std::vector<std::string> mqttPublished;
+    std::vector<std::string> mqttSubscribed;
+    int mqttFailPublishes = 0;
+    void mqttEvent(int id, const char *topic, const char *data)
+    {
+        if (!client.handler)
+            return;
+        esp_mqtt_event_t event = {};
+        event.event_id = (esp_mqtt_event_id_t)id;
+        event.client = &client;
+        event.topic = (char *)topic;
+        event.topic_len = topic ? strlen(topic) : 0;
+        event.data = (char *)data;
+        event.data_len = event.total_data_len = data ? strlen(data) : 0;
+        client.handler(client.arg, "MQTT_EVENTS", id, &event);
+    }
+}
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t, const char *, const char *data, int len, int, int)
+{
+    if (mqttFailPublishes)
+    {
+        mqttFailPublishes--;
+        return -1;
+    }
+    mqttPublished.push_back(std::string(data, len ? len : strlen(data)));
+    return 0;
+}
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t, const char *topic, int)
+{
+    mqttSubscribed.push_back(topic);
+    return 0;
+}
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t c, esp_mqtt_event_id_t, esp_event_handler_t handler, void *arg)
+{
+    c->handler = handler;
+    c->arg = arg;
+    return 0;
+}
+esp_err_t esp_mqtt_client_unregister_event(esp_mqtt_client_handle_t c, esp_mqtt_event_id_t, esp_event_handler_t)
+{
+    c->handler = nullptr;
+    return 0;
+}
@@ -0,0 +1,69 @@
+// sources: logging.cpp
+/**
+ * Appenders added and removed while other tasks are logging: the ones that stay get every message,
+ * and a removed appender is never called once removeAppender() returns
+ */
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct CountingAppender final : LogAppender
+{
+    std::atomic<int> count{0};
+    std::atomic<bool> removed{false};
+    std::atomic<int> afterRemoval{0};
+    // keeps the loggers in the snapshot for a while
+    bool slow = false;
+    bool append(const LogMessage *message)
+    {
+        if (slow)
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        if (removed)
+            afterRemoval++;
+        if (message)
+            count++;
+        return true;
+    }
+};
+
+int main()
+{
+    CountingAppender persistent;
+    persistent.slow = true;
+    Logging::addAppender(&persistent);
+
+    const int Tasks = 8, Messages = 5000;
+    std::vector<std::thread> tasks;
+    for (int t = 0; t < Tasks; t++)
+        tasks.emplace_back([] {
+            SimpleLoggable loggable("churn");
+            for (int i = 0; i < Messages; i++)
+                loggable.logger().logf(LogLevel::Info, "message %d", i);
+        });
+
+    int late = 0;
+    for (int i = 0; i < 300; i++)
+    {
+        auto a = new CountingAppender();
+        Logging::addAppender(a);
+        std::this_thread::yield();
+        Logging::removeAppender(a);
+        a->removed = true;
+        std::this_thread::yield();
+        late += a->afterRemoval;
+        // a snapshot still holding it would be caught by the address sanitizer
+        delete a;
+    }
+    for (auto &t : tasks)
+        t.join();
+    CHECK(late == 0);
+    CHECK(persistent.count == Tasks * Messages);
+    Logging::removeAppender(&persistent);
+    return hosttest::result();
+}
@@ -0,0 +1,111 @@
+// sources: logging.cpp
+/**
+ * Adaptive backpressure driven by an appender that fails: verbosity is lowered step by step while the appends fail,
+ * errors still pass, and the level is restored once the pipeline stays calm
+ */
+#include <stdio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct FlakyAppender : LogAppender
+{
+    std::mutex lock;
+    std::vector<std::string> lines;
+    std::atomic<bool> failing{false};
+    bool append(const LogMessage *message)
+    {
+        if (!message)
+            return true;
+        std::lock_guard<std::mutex> guard(lock);
+        lines.push_back(message->message());
+        return !failing;
+    }
+    size_t count(const std::string &prefix)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t result = 0;
+        for (auto &l : lines)
+            if (!l.compare(0, prefix.size(), prefix))
+                result++;
+        return result;
+    }
+};
+
+int64_t nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Logs debug and info messages for @p ms, suppressed messages are not the pressure, so it takes both to lower the level twice
+ */
+void logFor(Logger &logger, uint32_t ms)
+{
+    for (auto started = nowMs(); nowMs() - started < ms;)
+    {
+        logger.log(LogLevel::Debug, "sample");
+        logger.log(LogLevel::Info, "summary");
+        usleep(1000);
+    }
+}
+
+int main()
+{
+    FlakyAppender flaky;
+    Logging::addAppender(&flaky);
+    SimpleLoggable loggable("load");
+    auto &logger = loggable.logger();
+    Logging::setLevel(LogLevel::Debug);
+    Logging::setBackpressure(2);
+
+    // every append fails, two steps down from debug leave warnings and errors
+    flaky.failing = true;
+    logFor(logger, 500);
+    CHECK(flaky.count("log pipeline saturated") == 1);
+    flaky.lines.clear();
+    logger.log(LogLevel::Debug, "debug while saturated");
+    logger.log(LogLevel::Info, "info while saturated");
+    logger.log(LogLevel::Error, "error while saturated");
+    CHECK(flaky.count("debug while saturated") == 0);
+    CHECK(flaky.count("info while saturated") == 0);
+    CHECK(flaky.count("error while saturated") == 1);
+
+    // a step back every 2 seconds without pressure
+    flaky.failing = false;
+    logFor(logger, 2500);
+    logger.log(LogLevel::Info, "info after one step");
+    CHECK(flaky.count("info after one step") == 1);
+    CHECK(flaky.count("log pipeline recovered") == 0);
+    logFor(logger, 2000);
+    CHECK(flaky.count("log pipeline recovered, verbosity restored") == 1);
+    unsigned suppressed = 0;
+    {
+        std::lock_guard<std::mutex> guard(flaky.lock);
+        for (auto &l : flaky.lines)
+            sscanf(l.c_str(), "log pipeline recovered, verbosity restored, %u messages suppressed", &suppressed);
+    }
+    CHECK(suppressed > 100);
+    flaky.lines.clear();
+    logger.log(LogLevel::Debug, "debug again");
+    CHECK(flaky.count("debug again") == 1);
+
+    // disabled, failures don't matter
+    Logging::setBackpressure(0);
+    flaky.failing = true;
+    logFor(logger, 300);
+    CHECK(flaky.count("log pipeline saturated") == 0);
+    flaky.failing = false;
+
+    Logging::removeAppender(&flaky);
+    return hosttest::result();
+}
@@ -0,0 +1,146 @@
+// sources: logging.cpp
+// flags: -include hosttest.hpp -DLOGGING_POOL_RACE_WINDOW()=hosttest::raceWindow()
+/**
+ * Log buffer pool: tasks taking and returning blocks of tiny pools all at once never get a block someone else holds,
+ * exhausted size classes fall back to the heap and count it, and the usage statistics add up once everything is returned
+ */
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+const size_t Classes = 4;
+
+/**
+ * Fills the buffer with a pattern of the owner, so that a block handed out twice is caught when it's checked
+ */
+void fill(void *ptr, size_t size, uint8_t owner, uint8_t round)
+{
+    auto p = (uint8_t *)ptr;
+    for (size_t i = 0; i < size; i++)
+        p[i] = owner ^ round ^ (uint8_t)i;
+}
+
+bool intact(const void *ptr, size_t size, uint8_t owner, uint8_t round)
+{
+    auto p = (const uint8_t *)ptr;
+    for (size_t i = 0; i < size; i++)
+        if (p[i] != (uint8_t)(owner ^ round ^ (uint8_t)i))
+            return false;
+    return true;
+}
+
+int main()
+{
+    // 1024 bytes a class: 16 blocks of 64, 8 of 128, 4 of 256, 2 of 512
+    CHECK(Logging::usePool(4096));
+    CHECK(!Logging::usePool(4096));
+    LogPoolStats stats[Classes];
+    CHECK(Logging::poolStats(stats, Classes) == Classes);
+    for (size_t i = 0; i < Classes; i++)
+    {
+        CHECK(stats[i].blockSize == 64u << i);
+        CHECK(stats[i].blocks == 16u >> i);
+        CHECK(stats[i].used == 0 && stats[i].peak == 0 && stats[i].fallbacks == 0);
+    }
+
+    // the 64-byte class exhausted: the next ones come from the heap, and go back there
+    {
+        std::vector<void *> blocks;
+        for (int i = 0; i < 16; i++)
+            blocks.push_back(logAlloc(40));
+        Logging::poolStats(stats, Classes);
+        CHECK(stats[0].used == 16 && stats[0].peak == 16 && stats[0].fallbacks == 0);
+        auto heap = logAlloc(40);
+        auto large = logAlloc(1000);
+        CHECK(heap && large);
+        Logging::poolStats(stats, Classes);
+        CHECK(stats[0].used == 16 && stats[0].fallbacks == 1);
+        // too large for any class isn't a fallback
+        CHECK(stats[3].fallbacks == 0);
+        // a heap block released into the pool, or a pool block into the heap, would be caught by the sanitizer
+        logFree(heap);
+        logFree(large);
+        for (auto b : blocks)
+            logFree(b);
+        Logging::poolStats(stats, Classes);
+        CHECK(stats[0].used == 0 && stats[0].peak == 16);
+        // all of them are back
+        for (int i = 0; i < 16; i++)
+            blocks[i] = logAlloc(64);
+        Logging::poolStats(stats, Classes);
+        CHECK(stats[0].used == 16 && stats[0].fallbacks == 1);
+        for (auto b : blocks)
+            logFree(b);
+    }
+
+    // many tasks on pools a little too small for them, now and then pausing between reading the link of the top block and swapping the head:
+    // a block popped while other tasks take it, and return it on top again, must not be handed out twice (ABA)
+    {
+        hosttest::raceHook = [] {
+            static thread_local unsigned n = 0;
+            if (++n % 64 == 0)
+                usleep(300);
+        };
+        const int Tasks = 8, Rounds = 100000;
+        std::atomic<int> corrupted(0);
+        std::vector<std::thread> tasks;
+        for (int t = 0; t < Tasks; t++)
+            tasks.emplace_back([&, t] {
+                struct Held
+                {
+                    void *ptr;
+                    size_t size;
+                    uint8_t round;
+                } held[2] = {};
+                uint32_t random = t * 2654435761u + 1;
+                for (int r = 0; r < Rounds; r++)
+                {
+                    random = random * 1103515245 + 12345;
+                    auto &h = held[(random >> 8) & 1];
+                    if (h.ptr)
+                    {
+                        if (!intact(h.ptr, h.size, t, h.round))
+                            corrupted++;
+                        logFree(h.ptr);
+                        h.ptr = nullptr;
+                    }
+                    // any of the classes alike, now and then too large for all of them
+                    auto c = (random >> 16) % 9;
+                    h.size = c == 8 ? 600 : (32u << c / 2) + 1 + (random >> 20) % (32u << c / 2);
+                    h.round = r;
+                    h.ptr = logAlloc(h.size);
+                    fill(h.ptr, h.size, t, h.round);
+                }
+                for (auto &h : held)
+                    if (h.ptr)
+                    {
+                        if (!intact(h.ptr, h.size, t, h.round))
+                            corrupted++;
+                        logFree(h.ptr);
+                    }
+            });
+        for (auto &t : tasks)
+            t.join();
+        hosttest::raceHook = nullptr;
+        CHECK(corrupted == 0);
+        Logging::poolStats(stats, Classes);
+        for (size_t i = 0; i < Classes; i++)
+        {
+            CHECK(stats[i].used == 0);
+            CHECK(stats[i].peak <= stats[i].blocks);
+        }
+        // 16 buffers held at a time, spread over the classes, don't always fit the smaller pools
+        CHECK(stats[2].peak == stats[2].blocks && stats[2].fallbacks > 0);
+        CHECK(stats[3].peak == stats[3].blocks && stats[3].fallbacks > 0);
+    }
+    return hosttest::result();
+}
@@ -0,0 +1,90 @@
+// sources: logging.cpp
+/**
+ * ESP-IDF messages passed through the installed hook, in the one-call and two-call forms, from several tasks logging with new tags
+ */
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct CaptureAppender : LogAppender
+{
+    std::mutex lock;
+    std::vector<std::string> lines;
+    bool append(const LogMessage *message)
+    {
+        if (!message)
+            return true;
+        std::lock_guard<std::mutex> guard(lock);
+        lines.push_back(std::string(1, "N-EWIDV"[(int)message->level()]) + " " + message->name() + ": " + message->message());
+        return true;
+    }
+    size_t count(const std::string &line)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t result = 0;
+        for (auto &l : lines)
+            if (l == line)
+                result++;
+        return result;
+    }
+};
+
+/**
+ * Calls the hook the way esp_log_write(...) does
+ */
+void espLog(const char *format, ...)
+{
+    va_list arg;
+    va_start(arg, format);
+    hosttest::logVprintf(format, arg);
+    va_end(arg);
+}
+
+int main()
+{
+    CaptureAppender capture;
+    Logging::addAppender(&capture);
+    Logging::hookEsp32Logger();
+
+    // header and body in one format, colored
+    espLog("\033[0;32mI (%u) %s: connected to %s\033[0m\n", 120u, "wifi", "home");
+    CHECK(capture.count("I wifi: connected to home") == 1);
+    // header and body written by two calls
+    espLog("%c (%d) %s:", 'W', 130, "nvs");
+    espLog("partition %s is full\n", "nvs");
+    CHECK(capture.count("W nvs: partition nvs is full") == 1);
+    // no header
+    espLog("plain text\n");
+    CHECK(capture.lines.size() == 3);
+
+    // the first message of every tag creates its logger
+    const int Tasks = 4, Tags = 24;
+    std::vector<std::thread> tasks;
+    for (int t = 0; t < Tasks; t++)
+        tasks.emplace_back([t] {
+            for (int i = 0; i < Tags; i++)
+            {
+                auto tag = "tag" + std::to_string((i + t * 5) % Tags);
+                espLog("E (%u) %s: error %d\n", 200u, tag.c_str(), t);
+            }
+        });
+    for (auto &t : tasks)
+        t.join();
+    for (int i = 0; i < Tags; i++)
+        for (int t = 0; t < Tasks; t++)
+            CHECK(capture.count("E tag" + std::to_string(i) + ": error " + std::to_string(t)) == 1);
+
+    Logging::hookEsp32Logger(false);
+    CHECK(hosttest::logVprintf == vprintf);
+    Logging::removeAppender(&capture);
+    return hosttest::result();
+}
@@ -0,0 +1,204 @@
+// sources: logging.cpp
+/**
+ * Structured fields of LogRecord: the typed binary encoding, key=value, syslog and JSON renderings
+ * with their quoting and escaping, snprintf-like truncation of the renderings, fields dropped whole once the record
+ * is full, and records below the level never reaching the appenders
+ */
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct Captured
+{
+    std::string text;
+    std::vector<uint8_t> fields;
+    std::string kv, syslog, json, object, line;
+};
+
+struct CaptureAppender : LogAppender
+{
+    std::vector<Captured> messages;
+    bool append(const LogMessage *message)
+    {
+        if (!message)
+            return true;
+        Captured c;
+        c.text = message->message();
+        c.fields.assign(message->fields(), message->fields() + message->fields_size());
+        char buf[512];
+        message->renderFields(buf, sizeof(buf), LogMessage::FieldsFormat::KeyValue);
+        c.kv = buf;
+        message->renderFields(buf, sizeof(buf), LogMessage::FieldsFormat::SyslogParams);
+        c.syslog = buf;
+        message->renderFields(buf, sizeof(buf), LogMessage::FieldsFormat::Json);
+        c.json = buf;
+        message->toJson(buf, sizeof(buf));
+        c.object = buf;
+        LogSegments segments;
+        if (segments.render(message))
+        {
+            auto line = segments.join();
+            c.line = line;
+            logFree(line);
+        }
+        messages.push_back(c);
+        // the renderings behave like snprintf(): the full length is returned whatever the buffer size, the text is cut and terminated
+        for (auto format : {LogMessage::FieldsFormat::KeyValue, LogMessage::FieldsFormat::SyslogParams, LogMessage::FieldsFormat::Json})
+        {
+            auto full = message->renderFields(nullptr, 0, format);
+            message->renderFields(buf, sizeof(buf), format);
+            if (full != strlen(buf))
+                truncation++;
+            char small[8];
+            if (message->renderFields(small, sizeof(small), format) != full || strncmp(small, buf, sizeof(small) - 1) || strlen(small) != std::min(full, sizeof(small) - 1))
+                truncation++;
+        }
+        auto full = message->toJson(nullptr, 0);
+        char small[16];
+        if (message->toJson(small, sizeof(small)) != full || strlen(small) != std::min(full, sizeof(small) - 1) || c.object.compare(0, strlen(small), small))
+            truncation++;
+        return true;
+    }
+    int truncation = 0;
+    Captured &last() { return messages.back(); }
+};
+
+int main()
+{
+    CaptureAppender capture;
+    Logging::addAppender(&capture);
+    SimpleLoggable loggable("fields");
+    auto &logger = loggable.logger();
+    logger.setLevel(LogLevel::Info);
+
+    // the binary layout: type, key length, key, [string length], little-endian value
+    logger.info("layout").kv("id", 42).kv("s", "ab");
+    const std::vector<uint8_t> layout = {
+        (uint8_t)LogFieldType::Int, 2, 'i', 'd', 42, 0, 0, 0,
+        (uint8_t)LogFieldType::String, 1, 's', 2, 'a', 'b',
+    };
+    CHECK(capture.last().fields == layout);
+
+    // every type, with the narrowest encoding for integers that fit 32 bits
+    logger.info("types")
+        .kv("b", true)
+        .kv("i", -5)
+        .kv("u", 7u)
+        .kv("i64", -5000000000LL)
+        .kv("u64", 5000000000ULL)
+        .kv("big", 4000000000ULL)
+        .kv("f", 21.5f)
+        .kv("d", 0.1)
+        .kv("s", "pump");
+    {
+        struct Expected
+        {
+            LogFieldType type;
+            const char *key;
+            size_t size;
+        } expected[] = {
+            {LogFieldType::Bool, "b", 1},     {LogFieldType::Int, "i", 4},    {LogFieldType::UInt, "u", 4},
+            {LogFieldType::Int64, "i64", 8},  {LogFieldType::UInt64, "u64", 8}, {LogFieldType::UInt, "big", 4},
+            {LogFieldType::Float, "f", 4},    {LogFieldType::Double, "d", 8}, {LogFieldType::String, "s", 4},
+        };
+        auto &f = capture.last().fields;
+        size_t offset = 0;
+        for (auto &e : expected)
+        {
+            CHECK(offset + 2 <= f.size() && f[offset] == (uint8_t)e.type && f[offset + 1] == strlen(e.key));
+            CHECK(!memcmp(&f[offset + 2], e.key, strlen(e.key)));
+            offset += 2 + strlen(e.key) + (e.type == LogFieldType::String ? 1 : 0) + e.size;
+        }
+        CHECK(offset == f.size());
+    }
+    CHECK(capture.last().kv == "b=true i=-5 u=7 i64=-5000000000 u64=5000000000 big=4000000000 f=21.5 d=0.1 s=pump");
+    CHECK(capture.last().json == "\"b\":true,\"i\":-5,\"u\":7,\"i64\":-5000000000,\"u64\":5000000000,\"big\":4000000000,\"f\":21.5,\"d\":0.1,\"s\":\"pump\"");
+    CHECK(capture.last().syslog == "b=\"true\" i=\"-5\" u=\"7\" i64=\"-5000000000\" u64=\"5000000000\" big=\"4000000000\" f=\"21.5\" d=\"0.1\" s=\"pump\"");
+    // the default text line has the fields after the message, before the context
+    CHECK(capture.last().line.find("fields  types b=true i=-5 ") != std::string::npos);
+    CHECK(capture.last().line.find(" s=pump task=") != std::string::npos);
+    // and the JSON object has them as "f"
+    auto &object = capture.last().object;
+    CHECK(object.find("\"n\":\"fields\",\"m\":\"types\",") != std::string::npos);
+    CHECK(object.size() > 2 && object.compare(object.size() - 2, 2, "}}") == 0);
+    CHECK(object.find(",\"f\":{\"b\":true,\"i\":-5,") != std::string::npos);
+
+    // extremes survive the round trip
+    logger.info("extremes").kv("min", (long long)INT64_MIN).kv("max", (unsigned long long)UINT64_MAX).kv("i32", (long long)INT32_MIN);
+    CHECK(capture.last().kv == "min=-9223372036854775808 max=18446744073709551615 i32=-2147483648");
+    CHECK(capture.last().fields[0] == (uint8_t)LogFieldType::Int64);
+    CHECK(capture.last().fields[capture.last().fields.size() - 4 - 3 - 2] == (uint8_t)LogFieldType::Int);
+
+    // quoting: in key=value only when needed, always in syslog with '"', '\' and ']' escaped, JSON escapes control characters too
+    logger.info("quoting").kv("plain", "a-b").kv("space", "a b").kv("q", "say \"hi\"").kv("eq", "a=b").kv("br", "x]\\");
+    CHECK(capture.last().kv == "plain=a-b space=\"a b\" q=\"say \\\"hi\\\"\" eq=\"a=b\" br=x]\\");
+    CHECK(capture.last().syslog == "plain=\"a-b\" space=\"a b\" q=\"say \\\"hi\\\"\" eq=\"a=b\" br=\"x\\]\\\\\"");
+    logger.info("escaping").kv("k\"ey", "line\nnext\ttab\r\x01 \"q\" \\");
+    CHECK(capture.last().json == "\"k\\\"ey\":\"line\\nnext\\ttab\\r\\u0001 \\\"q\\\" \\\\\"");
+    // non-finite numbers are null in JSON, as they are in key=value
+    logger.info("nan").kv("n", NAN).kv("inf", (double)INFINITY);
+    CHECK(capture.last().json == "\"n\":null,\"inf\":null");
+    CHECK(capture.last().kv == "n=nan inf=inf");
+
+    // the record holds LOGGING_RECORD_FIELDS_SIZE bytes of fields: one that doesn't fit is dropped whole,
+    // a smaller one after it still gets in
+    {
+        std::string s40(40, 'x'), s60(60, 'y');
+        // 2 + 2 + 1 + 40 = 45 bytes each
+        logger.info("full").kv("s1", s40.c_str()).kv("s2", s60.c_str()).kv("s3", s40.c_str()).kv("id", 1);
+        auto &c = capture.last();
+        CHECK(c.fields.size() <= LOGGING_RECORD_FIELDS_SIZE);
+        CHECK(c.kv == "s1=" + s40 + " s3=" + s40);
+        CHECK(c.fields.size() == 90);
+        // 6 bytes left: an int needs 2 + 1 + 4, a bool 2 + 1 + 1
+        logger.info("fits").kv("s1", s40.c_str()).kv("s3", s40.c_str()).kv("a", 1).kv("b", true);
+        CHECK(capture.last().kv == "s1=" + s40 + " s3=" + s40 + " b=true");
+        CHECK(capture.last().fields.size() == 94);
+    }
+    // strings are cut to 255 bytes, the length is a byte
+    {
+        std::string s300(300, 'z');
+        uint8_t buf[400];
+        size_t used = 0;
+        CHECK(LogRecord::encode(buf, sizeof(buf), used, "k", LogFieldType::String, s300.c_str(), 255));
+        CHECK(used == 2 + 1 + 1 + 255);
+        // the record cuts long strings itself, here it doesn't fit the record at all
+        logger.info("long").kv("k", s300.c_str());
+        CHECK(capture.last().fields.empty());
+    }
+    // encode() into a caller's buffer: no room, no key, nothing changes
+    {
+        uint8_t buf[8];
+        size_t used = 0;
+        int32_t v = 1;
+        CHECK(LogRecord::encode(buf, sizeof(buf), used, "ab", LogFieldType::Int, &v, sizeof(v)));
+        CHECK(used == 8);
+        CHECK(!LogRecord::encode(buf, sizeof(buf), used, "c", LogFieldType::Bool, "\1", 1));
+        CHECK(used == 8);
+        used = 0;
+        CHECK(!LogRecord::encode(buf, sizeof(buf), used, nullptr, LogFieldType::Bool, "\1", 1));
+        CHECK(used == 0);
+    }
+
+    // below the level: nothing is sent, and the fields are not even encoded
+    auto count = capture.messages.size();
+    logger.debug("hidden").kv("x", 1).kv("s", "text");
+    CHECK(capture.messages.size() == count);
+    // no fields, no "f" in JSON, nothing between the message and the context
+    logger.info("bare");
+    CHECK(capture.last().fields.empty() && capture.last().kv.empty() && capture.last().json.empty());
+    CHECK(capture.last().object.find("\"f\"") == std::string::npos);
+    CHECK(capture.last().line.find("fields  bare task=") != std::string::npos);
+
+    CHECK(capture.truncation == 0);
+    Logging::removeAppender(&capture);
+    return hosttest::result();
+}
@@ -0,0 +1,37 @@
+// sources: logging.cpp fs_appender.cpp
+/**
+ * Lines written by FSAppender from the segments of the default formatter end with "\r\n", like the ones written with println()
+ */
+#include <string>
+
+#include "hosttest.hpp"
+#include "fs-appender.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+int main()
+{
+    FS fs;
+    FSAppender appender(fs, "/test.log");
+    Logging::addAppender(&appender);
+    SimpleLoggable loggable("fs");
+    loggable.logger().log(LogLevel::Info, "first");
+    loggable.logger().log(LogLevel::Info, "second");
+    Logging::removeAppender(&appender);
+
+    auto &text = hosttest::files["/test.log"];
+    auto first = text.find("fs  first");
+    CHECK(first != std::string::npos && text.find("fs  second", first) != std::string::npos);
+    CHECK(text.size() > 2 && text.compare(text.size() - 2, 2, "\r\n") == 0);
+    // no bare newlines
+    size_t lines = 0;
+    for (size_t i = 0; i < text.size(); i++)
+        if (text[i] == '\n')
+        {
+            CHECK(i > 0 && text[i - 1] == '\r');
+            lines++;
+        }
+    CHECK(lines == 2);
+    return hosttest::result();
+}
@@ -0,0 +1,117 @@
+// sources: logging.cpp history-appender.cpp
+/**
+ * HistoryAppender filled many times over: filtered queries return the most recent matching messages oldest first,
+ * whether they follow the level chains or the logger shard chain, and a visitor may log while the query runs
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "history-appender.hpp"
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct Logged
+{
+    int index;
+    LogLevel level;
+    std::string name;
+    std::string text;
+};
+
+std::vector<std::string> collect(HistoryAppender &history, LogLevel level, const char *name, size_t max)
+{
+    std::vector<std::string> result;
+    history.query(level, name, max, [](const LogMessage *message, void *arg) {
+        ((std::vector<std::string> *)arg)->push_back(message->message());
+        return true;
+    }, &result);
+    return result;
+}
+
+/**
+ * @return Texts of the last @p max messages in @p kept matching the filter, oldest first
+ */
+std::vector<std::string> expect(const std::vector<Logged> &kept, LogLevel level, const char *name, size_t max)
+{
+    std::vector<std::string> result;
+    for (auto it = kept.rbegin(); it != kept.rend() && result.size() < max; it++)
+        if (it->level <= level && (!name || it->name == name))
+            result.insert(result.begin(), it->text);
+    return result;
+}
+
+int main()
+{
+    HistoryAppender history(4096);
+    Logging::addAppender(&history);
+    Logging::setLevel(LogLevel::Verbose);
+    // a busy logger, and a few quiet ones whose records are spread thinly over the ring
+    const char *names[] = {"busy", "mqtt", "wifi", "sensor"};
+    SimpleLoggable busy(names[0]), mqtt(names[1]), wifi(names[2]), sensor(names[3]);
+    SimpleLoggable *loggables[] = {&busy, &mqtt, &wifi, &sensor};
+    const LogLevel levels[] = {LogLevel::Error, LogLevel::Warning, LogLevel::Info, LogLevel::Debug, LogLevel::Verbose};
+
+    std::vector<Logged> logged;
+    for (int i = 0; i < 2000; i++)
+    {
+        // every 7th message is from one of the quiet loggers, every 13th is an error
+        int n = i % 7 ? 0 : 1 + (i / 7) % 3;
+        auto level = i % 13 ? levels[1 + i % 4] : LogLevel::Error;
+        char text[64];
+        snprintf(text, sizeof(text), "message %d", i);
+        loggables[n]->logger().log(level, text);
+        logged.push_back({i, level, names[n], text});
+    }
+
+    // the ring holds the most recent messages only
+    auto all = collect(history, LogLevel::Verbose, nullptr, 10000);
+    CHECK(all.size() == history.count());
+    CHECK(all.size() > 20 && all.size() < 200);
+    std::vector<Logged> kept(logged.end() - all.size(), logged.end());
+    CHECK(all == expect(kept, LogLevel::Verbose, nullptr, 10000));
+
+    // by level: the chains of the included levels merged by sequence
+    CHECK(collect(history, LogLevel::Error, nullptr, 10000) == expect(kept, LogLevel::Error, nullptr, 10000));
+    CHECK(collect(history, LogLevel::Warning, nullptr, 10000) == expect(kept, LogLevel::Warning, nullptr, 10000));
+    CHECK(collect(history, LogLevel::Info, nullptr, 5) == expect(kept, LogLevel::Info, nullptr, 5));
+    // by logger: a quiet logger has fewer records than the levels, its shard chain is followed
+    for (int n = 1; n < 4; n++)
+    {
+        auto found = collect(history, LogLevel::Verbose, names[n], 10000);
+        CHECK(!found.empty());
+        CHECK(found == expect(kept, LogLevel::Verbose, names[n], 10000));
+        CHECK(collect(history, LogLevel::Debug, names[n], 3) == expect(kept, LogLevel::Debug, names[n], 3));
+    }
+    // errors are fewer than the busy logger's records, the error chain is followed and filtered by name
+    CHECK(collect(history, LogLevel::Error, "busy", 10000) == expect(kept, LogLevel::Error, "busy", 10000));
+    CHECK(collect(history, LogLevel::Verbose, "nobody", 10000).empty());
+
+    // the visitor logs to the same appender, the messages it adds may evict the ones still to be visited
+    struct Replay
+    {
+        Logger *logger;
+        std::vector<int> seen;
+    } replay = {&loggables[0]->logger(), {}};
+    auto visited = history.query(LogLevel::Verbose, nullptr, 10000, [](const LogMessage *message, void *arg) {
+        auto r = (Replay *)arg;
+        int index;
+        if (sscanf(message->message(), "message %d", &index) == 1)
+            r->seen.push_back(index);
+        r->logger->logf(LogLevel::Info, "replayed %s, padding the ring to push the old messages out", message->message());
+        return true;
+    }, &replay);
+    CHECK(visited == replay.seen.size());
+    CHECK(visited > 0 && visited <= all.size());
+    // oldest first, the messages evicted before their turn are skipped
+    for (size_t i = 1; i < replay.seen.size(); i++)
+        CHECK(replay.seen[i] > replay.seen[i - 1]);
+    CHECK(replay.seen.front() == kept.front().index);
+
+    Logging::removeAppender(&history);
+    return hosttest::result();
+}
@@ -0,0 +1,120 @@
+// sources: logging.cpp
+/**
+ * Logging from interrupt handlers: records formatted later by the next task that logs or by the queue task,
+ * the level check, overflow of the slots, and interrupts on both cores racing with the tasks
+ */
+#include <stdio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct CaptureAppender : LogAppender
+{
+    std::mutex lock;
+    std::vector<std::string> lines;
+    bool append(const LogMessage *message)
+    {
+        if (!message)
+            return true;
+        std::lock_guard<std::mutex> guard(lock);
+        lines.push_back(message->message());
+        return true;
+    }
+    size_t count(const std::string &prefix)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t result = 0;
+        for (auto &l : lines)
+            if (!l.compare(0, prefix.size(), prefix))
+                result++;
+        return result;
+    }
+};
+
+int main()
+{
+    CaptureAppender capture;
+    Logging::addAppender(&capture);
+    SimpleLoggable loggable("isr");
+    auto &logger = loggable.logger();
+    Logging::setLevel(LogLevel::Info);
+
+    // formatted by the next regular log call, before its own message
+    logger.isr(LogLevel::Warning, "adc %d channel %u", -5, 3);
+    logger.isr(LogLevel::Debug, "below the level %d", 1);
+    CHECK(capture.lines.empty());
+    logger.log(LogLevel::Info, "task");
+    CHECK(capture.lines.size() == 2);
+    if (capture.lines.size() == 2)
+    {
+        CHECK(capture.lines[0] == "adc -5 channel 3");
+        CHECK(capture.lines[1] == "task");
+    }
+
+    // more records than slots, the rest is counted
+    capture.lines.clear();
+    for (int i = 0; i < LOGGING_ISR_SLOTS + 8; i++)
+        logger.isr(LogLevel::Info, "burst %d", i);
+    CHECK(Logging::pending() == 0);
+    CHECK(capture.count("burst ") == LOGGING_ISR_SLOTS);
+    CHECK(capture.count("ISR log slots overflow, dropped 8 messages") == 1);
+
+    // interrupts on both cores while tasks are logging and formatting their records
+    capture.lines.clear();
+    const int Interrupts = 2, PerInterrupt = 2000;
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> tasks;
+    for (int t = 0; t < 2; t++)
+        tasks.emplace_back([&] {
+            while (!stop)
+                logger.log(LogLevel::Info, "from task");
+        });
+    std::vector<std::thread> interrupts;
+    for (int t = 0; t < Interrupts; t++)
+        interrupts.emplace_back([&logger] {
+            for (int i = 0; i < PerInterrupt; i++)
+            {
+                logger.isr(LogLevel::Info, "irq %d", i);
+                if (i % 16 == 0)
+                    usleep(50);
+            }
+        });
+    for (auto &t : interrupts)
+        t.join();
+    stop = true;
+    for (auto &t : tasks)
+        t.join();
+    Logging::pending();
+    size_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> guard(capture.lock);
+        for (auto &l : capture.lines)
+        {
+            unsigned n;
+            if (sscanf(l.c_str(), "ISR log slots overflow, dropped %u messages", &n) == 1)
+                dropped += n;
+        }
+    }
+    CHECK(capture.count("irq ") + dropped == Interrupts * PerInterrupt);
+
+    // the queue task formats them without waiting for a task to log
+    capture.lines.clear();
+    Logging::useQueue(4096);
+    logger.isr(LogLevel::Error, "from the queue %d", 42);
+    for (int i = 0; i < 100 && !capture.count("from the queue"); i++)
+        usleep(10000);
+    CHECK(capture.count("from the queue 42") == 1);
+    Logging::useQueue(0);
+
+    Logging::removeAppender(&capture);
+    return hosttest::result();
+}
@@ -0,0 +1,56 @@
+// sources: logging.cpp
+// flags: -DLOGGING_LEVEL_RULES=4
+/**
+ * Hierarchical level rules, and configureLevels() leaving the rules intact when the list can't be applied
+ */
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct CountingAppender : LogAppender
+{
+    int count = 0;
+    bool append(const LogMessage *message)
+    {
+        if (message)
+            count++;
+        return true;
+    }
+} counter;
+
+bool passes(Loggable &loggable, LogLevel level)
+{
+    auto before = counter.count;
+    loggable.logger().log(level, "test");
+    return counter.count > before;
+}
+
+int main()
+{
+    Logging::addAppender(&counter);
+    SimpleLoggable wifi("wifi"), sta("wifi.sta"), mqtt("mqtt"), other("other");
+    Logging::setLevel(LogLevel::Info);
+
+    CHECK(Logging::configureLevels("wifi.*=debug, wifi.sta=error, mqtt=v"));
+    CHECK(passes(wifi, LogLevel::Debug));
+    CHECK(!passes(sta, LogLevel::Warning));
+    CHECK(passes(sta, LogLevel::Error));
+    CHECK(passes(mqtt, LogLevel::Verbose));
+    CHECK(passes(other, LogLevel::Info));
+    CHECK(!passes(other, LogLevel::Debug));
+
+    // malformed
+    CHECK(!Logging::configureLevels("wifi=debug,mqtt"));
+    // more patterns than rules
+    CHECK(!Logging::configureLevels("a=e,b=e,c=e,d=e,e=e,*=none"));
+    CHECK(passes(wifi, LogLevel::Debug));
+    CHECK(passes(mqtt, LogLevel::Verbose));
+    CHECK(passes(other, LogLevel::Info));
+
+    CHECK(Logging::configureLevels("*=warning"));
+    CHECK(!passes(wifi, LogLevel::Info));
+    CHECK(passes(wifi, LogLevel::Warning));
+    CHECK(!passes(mqtt, LogLevel::Info));
+    return hosttest::result();
+}
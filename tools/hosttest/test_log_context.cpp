@@ -0,0 +1,208 @@
+// sources: logging.cpp
+// flags: -DLOGGING_TASKS=4
+/**
+ * Context of the messages: the task and core they were logged on and the trace span they were logged in are captured,
+ * nested spans restore the outer one, spans are per task, and the context appears in the text and JSON renderings.
+ * Tasks beyond LOGGING_TASKS log without a name
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct Captured
+{
+    std::string text, task, line, json;
+    int core;
+    uint32_t span;
+};
+
+struct CaptureAppender : LogAppender
+{
+    std::mutex lock;
+    std::vector<Captured> messages;
+    bool append(const LogMessage *message)
+    {
+        if (!message)
+            return true;
+        Captured c;
+        c.text = message->message();
+        c.task = message->task() ? message->task() : "";
+        c.core = message->core();
+        c.span = message->span();
+        LogSegments segments;
+        if (segments.render(message))
+        {
+            auto line = segments.join();
+            c.line = line;
+            logFree(line);
+        }
+        char json[256];
+        message->toJson(json, sizeof(json));
+        c.json = json;
+        std::lock_guard<std::mutex> guard(lock);
+        messages.push_back(c);
+        return true;
+    }
+    Captured find(const std::string &text)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto &m : messages)
+            if (m.text == text)
+                return m;
+        return Captured{"", "", "", "", -1, 0};
+    }
+};
+
+bool endsWith(const std::string &s, const std::string &suffix)
+{
+    return s.size() >= suffix.size() && !s.compare(s.size() - suffix.size(), suffix.size(), suffix);
+}
+
+bool contains(const std::string &s, const std::string &part)
+{
+    return s.find(part) != std::string::npos;
+}
+
+CaptureAppender capture;
+SimpleLoggable loggable("ctx");
+std::atomic<int> done(0);
+// core each worker ran on, as the stubs assigned it
+std::atomic<int> cores[4];
+
+/**
+ * Logs without a span, in its own span and in a nested one, then checks its span is gone
+ */
+void worker(void *arg)
+{
+    auto n = (int)(intptr_t)arg;
+    cores[n - 1] = xPortGetCoreID();
+    char text[32];
+    snprintf(text, sizeof(text), "worker %d plain", n);
+    loggable.logger().log(LogLevel::Info, text);
+    {
+        LogSpan span(1000 + n);
+        snprintf(text, sizeof(text), "worker %d in span", n);
+        loggable.logger().log(LogLevel::Info, text);
+        // let the others open their spans meanwhile, each task has its own
+        vTaskDelay(20);
+        snprintf(text, sizeof(text), "worker %d still in span", n);
+        loggable.logger().log(LogLevel::Info, text);
+    }
+    if (LogSpan::current())
+        snprintf(text, sizeof(text), "worker %d span left open", n);
+    else
+        snprintf(text, sizeof(text), "worker %d span closed", n);
+    loggable.logger().log(LogLevel::Info, text);
+    done++;
+    vTaskDelete(nullptr);
+}
+
+int main()
+{
+    Logging::addAppender(&capture);
+    auto &logger = loggable.logger();
+
+    // the main task takes the first of the 4 task slots
+    logger.log(LogLevel::Info, "main plain");
+    auto m = capture.find("main plain");
+    CHECK(m.task == "main");
+    CHECK(m.core == xPortGetCoreID());
+    CHECK(m.span == 0);
+    CHECK(endsWith(m.line, "ctx  main plain task=main core=" + std::to_string(m.core)));
+    CHECK(endsWith(m.json, ",\"m\":\"main plain\",\"task\":\"main\",\"core\":" + std::to_string(m.core) + "}"));
+
+    // nested spans: the inner one is in effect while it lives, then the outer one is back
+    {
+        LogSpan outer(77);
+        CHECK(LogSpan::current() == 77);
+        logger.log(LogLevel::Info, "outer");
+        uint32_t innerId;
+        {
+            LogSpan inner;
+            innerId = inner.id();
+            CHECK(innerId != 0 && innerId != 77);
+            CHECK(LogSpan::current() == innerId);
+            logger.log(LogLevel::Info, "inner");
+            {
+                LogSpan innermost(5);
+                logger.log(LogLevel::Info, "innermost");
+            }
+            logger.log(LogLevel::Info, "inner again");
+        }
+        logger.log(LogLevel::Info, "outer again");
+        CHECK(capture.find("outer").span == 77);
+        CHECK(capture.find("inner").span == innerId);
+        CHECK(capture.find("innermost").span == 5);
+        CHECK(capture.find("inner again").span == innerId);
+        CHECK(capture.find("outer again").span == 77);
+        auto o = capture.find("outer again");
+        CHECK(endsWith(o.line, "outer again task=main core=" + std::to_string(o.core) + " span=77"));
+        CHECK(endsWith(o.json, "\"task\":\"main\",\"core\":" + std::to_string(o.core) + ",\"span\":77}"));
+        // a fresh span gets a fresh ID
+        LogSpan another;
+        CHECK(another.id() != innerId);
+    }
+    CHECK(LogSpan::current() == 0);
+    logger.log(LogLevel::Info, "no span");
+    CHECK(capture.find("no span").span == 0);
+    CHECK(!contains(capture.find("no span").line, "span="));
+    CHECK(!contains(capture.find("no span").json, "\"span\""));
+
+    // tasks with names: the first three get the remaining slots, the fourth logs without a name
+    const char *names[] = {"worker-1", "worker-2", "worker-3", "worker-4"};
+    for (int n = 1; n <= 4; n++)
+    {
+        xTaskCreate(worker, names[n - 1], 4096, (void *)(intptr_t)n, 1, nullptr);
+        // one after another, so that the slots are taken in order
+        while (!capture.find("worker " + std::to_string(n) + " plain").text.size())
+            vTaskDelay(1);
+    }
+    while (done < 4)
+        vTaskDelay(1);
+    for (int n = 1; n <= 4; n++)
+    {
+        auto prefix = "worker " + std::to_string(n);
+        auto plain = capture.find(prefix + " plain");
+        auto inSpan = capture.find(prefix + " in span");
+        auto still = capture.find(prefix + " still in span");
+        CHECK(plain.core == cores[n - 1]);
+        CHECK(plain.span == 0);
+        CHECK(inSpan.span == (uint32_t)(1000 + n));
+        CHECK(still.span == (uint32_t)(1000 + n));
+        CHECK(capture.find(prefix + " span closed").text.size());
+        auto core = std::to_string(cores[n - 1]);
+        if (n < 4)
+        {
+            CHECK(plain.task == names[n - 1]);
+            CHECK(still.task == names[n - 1]);
+            CHECK(endsWith(still.line, " task=" + std::string(names[n - 1]) + " core=" + core + " span=" + std::to_string(1000 + n)));
+            CHECK(contains(still.json, "\"task\":\"" + std::string(names[n - 1]) + "\",\"core\":" + core + ",\"span\":"));
+        }
+        else
+        {
+            // no slot left, the name is omitted, core and span are still there
+            CHECK(plain.task.empty());
+            CHECK(endsWith(still.line, prefix + " still in span core=" + core + " span=1004"));
+            CHECK(!contains(still.json, "\"task\""));
+            CHECK(endsWith(still.json, "\"m\":\"worker 4 still in span\",\"core\":" + core + ",\"span\":1004}"));
+        }
+    }
+    // the spans of the workers didn't leak into this task
+    CHECK(LogSpan::current() == 0);
+
+    Logging::removeAppender(&capture);
+    return hosttest::result();
+}
@@ -0,0 +1,77 @@
+// sources: logging.cpp
+// flags: -std=gnu++17
+/**
+ * Messages rendered by LogFormat: every supported argument type, escaped braces, the widest integers,
+ * strings longer than the stack reserve, and the level check
+ */
+#include <stdint.h>
+
+#include <string>
+
+#include "hosttest.hpp"
+#include "log-format.hpp"
+
+using namespace esp32m;
+
+struct CaptureAppender : LogAppender
+{
+    std::string last;
+    int count = 0;
+    bool append(const LogMessage *message)
+    {
+        if (message)
+        {
+            last = message->message();
+            count++;
+        }
+        return true;
+    }
+};
+
+enum class Mode : uint8_t
+{
+    Idle = 3
+};
+
+struct Device : SimpleLoggable
+{
+    Device() : SimpleLoggable("device") {}
+    void report()
+    {
+        logFmtI("temp {} id {} {{x}} {} {} {} {} {}", 21.5f, -42, "str", true, 'c', Mode::Idle, (void *)0x1234);
+    }
+};
+
+int main()
+{
+    CaptureAppender capture;
+    Logging::addAppender(&capture);
+    Device device;
+    auto &logger = device.logger();
+
+    device.report();
+    CHECK(capture.last == "temp 21.5 id -42 {x} str true c 3 0x1234");
+
+    LogFormat::log(logger, LogLevel::Info, FMT("{} {}"), INT64_MIN, UINT64_MAX);
+    CHECK(capture.last == "-9223372036854775808 18446744073709551615");
+
+    const char *none = nullptr;
+    LogFormat::log(logger, LogLevel::Info, FMT("[{}]"), none);
+    CHECK(capture.last == "[(null)]");
+
+    // rendered on the heap
+    std::string text(300, 'x');
+    LogFormat::log(logger, LogLevel::Info, FMT("long {} end"), text.c_str());
+    CHECK(capture.last == "long " + text + " end");
+
+    LogFormat::log(logger, LogLevel::Info, FMT("no arguments"));
+    CHECK(capture.last == "no arguments");
+
+    auto count = capture.count;
+    Logging::setLevel(LogLevel::Info);
+    LogFormat::log(logger, LogLevel::Debug, FMT("hidden {}"), 1);
+    CHECK(capture.count == count);
+
+    Logging::removeAppender(&capture);
+    return hosttest::result();
+}
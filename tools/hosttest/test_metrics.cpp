@@ -0,0 +1,160 @@
+// sources: logging.cpp metrics.cpp
+/**
+ * Metrics updated from several threads while they are being reported: no update is lost or counted twice across the reports,
+ * and the records carry the period followed by the fields of the metrics, continued in the next record when they don't fit
+ */
+#include <string.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+
+using namespace esp32m;
+
+typedef std::vector<std::pair<std::string, int64_t>> Fields;
+
+struct CaptureAppender : LogAppender
+{
+    std::mutex lock;
+    std::vector<Fields> records;
+    bool append(const LogMessage *message)
+    {
+        if (!message || strcmp(message->name(), "metrics") || strcmp(message->message(), "metrics"))
+            return true;
+        Fields fields;
+        size_t offset = 0;
+        LogField f;
+        while (message->field(offset, f))
+            fields.emplace_back(std::string(f.key, f.keyLen), f.type == LogFieldType::Int ? f.asInt() : (int64_t)f.asUInt());
+        std::lock_guard<std::mutex> guard(lock);
+        records.push_back(fields);
+        return true;
+    }
+    /**
+     * @return Sum of the field over all records
+     */
+    int64_t total(const std::string &key)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        int64_t result = 0;
+        for (auto &r : records)
+            for (auto &f : r)
+                if (f.first == key)
+                    result += f.second;
+        return result;
+    }
+    /**
+     * @return Value of the field in the last record that has it, -1 if none
+     */
+    int64_t last(const std::string &key)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto r = records.rbegin(); r != records.rend(); r++)
+            for (auto &f : *r)
+                if (f.first == key)
+                    return f.second;
+        return -1;
+    }
+};
+
+int main()
+{
+    CaptureAppender capture;
+    Logging::addAppender(&capture);
+
+    // concurrent updates, reported while they are being made
+    {
+        const int Threads = 4, Updates = 100000;
+        Counter counter("events");
+        Gauge gauge("level");
+        Histogram histogram("lat", {10, 50, 100});
+        std::vector<std::thread> threads;
+        for (int t = 0; t < Threads; t++)
+            threads.emplace_back([&] {
+                for (int i = 0; i < Updates; i++)
+                {
+                    counter.inc();
+                    gauge.add(1);
+                    histogram.record(i % 200);
+                }
+            });
+        int reports = 0;
+        while (capture.total("events") + counter.value() < (int64_t)Threads * Updates || reports < 10)
+        {
+            Metrics::flush();
+            reports++;
+        }
+        for (auto &t : threads)
+            t.join();
+        Metrics::flush();
+        CHECK(capture.total("events") == Threads * Updates);
+        CHECK(capture.last("level") == Threads * Updates);
+        CHECK(capture.total("lat.count") == Threads * Updates);
+        // every thread records 0..199 in turn, 500 times
+        CHECK(capture.total("lat.sum") == (int64_t)Threads * 500 * (199 * 200 / 2));
+        CHECK(capture.total("lat.le10") == Threads * 500 * 11);
+        CHECK(capture.total("lat.le50") == Threads * 500 * 40);
+        CHECK(capture.total("lat.le100") == Threads * 500 * 50);
+        CHECK(capture.total("lat.inf") == Threads * 500 * 99);
+        CHECK(capture.last("lat.max") == 199);
+
+        // nothing happened since: the counter and the histogram are left out, the gauge is reported as is
+        capture.records.clear();
+        Metrics::flush();
+        CHECK(capture.records.size() == 1);
+        auto &r = capture.records[0];
+        CHECK(r.size() == 2 && r[0].first == "period" && r[1].first == "level" && r[1].second == Threads * Updates);
+    }
+
+    // the fields in the order the metrics were created, after the period
+    {
+        capture.records.clear();
+        Counter a("a");
+        Histogram h("h", {5});
+        a.inc(3);
+        h.record(2);
+        h.record(9);
+        Metrics::flush();
+        CHECK(capture.records.size() == 1);
+        Fields expected = {{"a", 3}, {"h.count", 2}, {"h.sum", 11}, {"h.max", 9}, {"h.le5", 1}, {"h.inf", 1}};
+        auto &r = capture.records[0];
+        CHECK(r.size() == expected.size() + 1 && r[0].first == "period");
+        CHECK(Fields(r.begin() + 1, r.end()) == expected);
+    }
+
+    // more than a record can take: the report continues in the next one, every record starts with the period
+    {
+        capture.records.clear();
+        std::vector<std::string> names;
+        std::vector<Counter *> counters;
+        for (int i = 0; i < 60; i++)
+            names.push_back("counter.number." + std::to_string(i));
+        for (auto &n : names)
+        {
+            counters.push_back(new Counter(n.c_str()));
+            counters.back()->inc(1);
+        }
+        Metrics::flush();
+        CHECK(capture.records.size() >= 2);
+        size_t reported = 0;
+        for (auto &r : capture.records)
+        {
+            CHECK(!r.empty() && r[0].first == "period");
+            reported += r.size() - 1;
+        }
+        CHECK(reported == names.size());
+        for (auto &n : names)
+            CHECK(capture.total(n) == 1);
+        for (auto c : counters)
+            delete c;
+    }
+
+    Logging::removeAppender(&capture);
+    return hosttest::result();
+}
@@ -0,0 +1,73 @@
+// sources: logging.cpp mqtt-appender.cpp
+/**
+ * MQTTAppender against the stub client: transient publish failures, the outbox across reconnects, JSON batches and the control topic
+ */
+#include <string>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+#include "mqtt-appender.hpp"
+
+using namespace esp32m;
+
+using hosttest::mqttPublished;
+
+bool published(size_t index, const char *text)
+{
+    return index < mqttPublished.size() && mqttPublished[index].find(text) != std::string::npos;
+}
+
+int main()
+{
+    {
+        MQTTAppender mqtt("log");
+        mqtt.init(hosttest::mqttClient);
+        Logging::addAppender(&mqtt);
+        SimpleLoggable loggable("mqtt");
+        auto &logger = loggable.logger();
+
+        // the client's outbox is full for a moment
+        hosttest::mqttFailPublishes = 1;
+        logger.log(LogLevel::Info, "lost");
+        logger.log(LogLevel::Info, "after failure");
+        CHECK(mqttPublished.size() == 1 && published(0, "after failure"));
+
+        // subscribed right away when set after init()
+        mqtt.setControlTopic("log/levels");
+        CHECK(hosttest::mqttSubscribed.size() == 1 && hosttest::mqttSubscribed[0] == "log/levels");
+        hosttest::mqttEvent(MQTT_EVENT_DATA, "log/levels", "*=warning");
+        mqttPublished.clear();
+        logger.log(LogLevel::Info, "filtered");
+        logger.log(LogLevel::Warning, "passed");
+        CHECK(mqttPublished.size() == 1 && published(0, "passed"));
+        CHECK(Logging::configureLevels("*=verbose"));
+
+        // kept while disconnected, a payload that can never fit doesn't push the others out
+        mqtt.setOutbox(256);
+        hosttest::mqttEvent(MQTT_EVENT_DISCONNECTED);
+        mqttPublished.clear();
+        logger.log(LogLevel::Info, "offline 1");
+        logger.log(LogLevel::Info, "offline 2");
+        logger.log(LogLevel::Info, std::string(300, 'x').c_str());
+        CHECK(mqttPublished.empty());
+        hosttest::mqttEvent(MQTT_EVENT_CONNECTED);
+        CHECK(hosttest::mqttSubscribed.size() == 2);
+        logger.log(LogLevel::Info, "online");
+        CHECK(mqttPublished.size() == 3 && published(0, "offline 1") && published(1, "offline 2") && published(2, "online"));
+        mqtt.setOutbox(0);
+
+        // a message larger than the batch is still an array
+        mqtt.setBatching(256, 100000, MQTTAppender::Format::Json);
+        mqttPublished.clear();
+        logger.log(LogLevel::Info, std::string(300, 'y').c_str());
+        CHECK(mqttPublished.size() == 1 && mqttPublished[0].front() == '[' && mqttPublished[0].back() == ']');
+        logger.log(LogLevel::Info, "one");
+        logger.log(LogLevel::Error, "two");
+        CHECK(mqttPublished.size() == 2 && published(1, "one") && published(1, "two") && mqttPublished[1].front() == '[');
+
+        Logging::removeAppender(&mqtt);
+    }
+    // no events for the destroyed appender
+    hosttest::mqttEvent(MQTT_EVENT_CONNECTED);
+    return hosttest::result();
+}
@@ -0,0 +1,152 @@
+// sources: logging.cpp udp-appender.cpp
+/**
+ * MultiUDPAppender sending to collectors on the loopback interface: every line reaches every destination in a single datagram,
+ * with the default formatter and with a custom one, a destination whose socket can't take more keeps the datagrams and sends them
+ * in order once it can, without holding the others back, and the sockets are reopened when WiFi gets an address again
+ */
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <WiFi.h>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+#include "udp-appender.hpp"
+
+using namespace esp32m;
+
+struct Receiver
+{
+    int fd;
+    uint16_t port;
+    // source port of the last datagram, tells the sockets of the appender apart
+    uint16_t from = 0;
+    Receiver()
+    {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+        getsockname(fd, (struct sockaddr *)&addr, &len);
+        port = ntohs(addr.sin_port);
+    }
+    ~Receiver() { close(fd); }
+    /**
+     * @return Datagrams that arrive until none comes for @p quietMs
+     */
+    std::vector<std::string> take(int quietMs = 100)
+    {
+        std::vector<std::string> result;
+        struct pollfd p = {fd, POLLIN, 0};
+        while (poll(&p, 1, quietMs) > 0)
+        {
+            char buf[2048];
+            struct sockaddr_in addr;
+            socklen_t len = sizeof(addr);
+            auto n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&addr, &len);
+            if (n < 0)
+                break;
+            from = ntohs(addr.sin_port);
+            result.emplace_back(buf, n);
+        }
+        return result;
+    }
+};
+
+/**
+ * @return @c true if every datagram is exactly one line, with the text of the corresponding message
+ */
+bool oneLineEach(const std::vector<std::string> &datagrams, const std::vector<std::string> &texts)
+{
+    if (datagrams.size() != texts.size())
+        return false;
+    for (size_t i = 0; i < texts.size(); i++)
+    {
+        auto &d = datagrams[i];
+        if (d.find(" " + texts[i]) == std::string::npos || d.find('\n') != d.size() - 1)
+            return false;
+    }
+    return true;
+}
+
+char *customFormatter(const LogMessage *message)
+{
+    auto result = (char *)logAlloc(strlen(message->message()) + 8);
+    if (result)
+        sprintf(result, "custom %s", message->message());
+    return result;
+}
+
+int main()
+{
+    SimpleLoggable loggable("udp");
+    auto &logger = loggable.logger();
+    Receiver a, b;
+    MultiUDPAppender multi(UDPAppender::Format::Text);
+    CHECK(multi.addDestination("127.0.0.1", a.port));
+    CHECK(multi.addDestination("127.0.0.1", b.port));
+    Logging::addAppender(&multi);
+
+    // the default formatter, the line is gathered from the segments of the message
+    std::vector<std::string> texts;
+    for (int i = 0; i < 5; i++)
+    {
+        texts.push_back("line " + std::to_string(i));
+        logger.log(LogLevel::Info, texts.back().c_str());
+    }
+    CHECK(oneLineEach(a.take(), texts));
+    CHECK(oneLineEach(b.take(), texts));
+
+    // a custom formatter renders the line into a buffer, it still goes out with its end in one datagram
+    Logging::setFormatter(customFormatter);
+    logger.log(LogLevel::Info, "formatted");
+    auto custom = a.take();
+    CHECK(custom.size() == 1 && custom[0] == "custom formatted\n");
+    custom = b.take();
+    CHECK(custom.size() == 1 && custom[0] == "custom formatted\n");
+    Logging::setFormatter(nullptr);
+
+    // b's socket is full: its datagrams wait in the retry buffer, a keeps getting them right away
+    hosttest::udpBlockedPort = b.port;
+    texts.clear();
+    for (int i = 0; i < 3; i++)
+    {
+        texts.push_back("held " + std::to_string(i));
+        logger.log(LogLevel::Info, texts.back().c_str());
+    }
+    CHECK(oneLineEach(a.take(), texts));
+    CHECK(b.take().empty());
+    CHECK(Logging::pending() > 0);
+    // once b can take datagrams again, the held ones go first
+    hosttest::udpBlockedPort = 0;
+    texts.push_back("after");
+    logger.log(LogLevel::Info, "after");
+    CHECK(oneLineEach(b.take(), texts));
+    CHECK(oneLineEach(a.take(), {"after"}));
+    CHECK(Logging::pending() == 0);
+
+    // the link goes down: nothing is sent, and the appender tells it can't record messages
+    hosttest::wifiEvent(ARDUINO_EVENT_WIFI_STA_LOST_IP);
+    logger.log(LogLevel::Info, "offline");
+    CHECK(a.take().empty());
+    CHECK(b.take().empty());
+
+    // with the new address, both sockets are opened anew
+    auto fromA = a.from, fromB = b.from;
+    hosttest::wifiEvent(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    logger.log(LogLevel::Info, "online");
+    CHECK(oneLineEach(a.take(), {"online"}));
+    CHECK(oneLineEach(b.take(), {"online"}));
+    CHECK(a.from != fromA);
+    CHECK(b.from != fromB);
+
+    Logging::removeAppender(&multi);
+    return hosttest::result();
+}
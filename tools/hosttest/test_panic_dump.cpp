@@ -0,0 +1,123 @@
+// sources: logging.cpp
+/**
+ * Logging::dumpPending() called from the SIGABRT handler of a forked process, the way the panic hook calls it on abort():
+ * the messages stuck in the queue, and those kept by a buffered appender that couldn't record them, must reach UART
+ * and the panic partition, and be replayed after the "reset".
+ */
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+const size_t FlashSize = 4 * 4096;
+const uint8_t Untouched = 0xA5;
+const int Dumped = 42;
+
+/**
+ * Never returns, so that the messages stay in the queue
+ */
+struct StuckAppender : LogAppender
+{
+    bool append(const LogMessage *message)
+    {
+        if (message)
+            pause();
+        return true;
+    }
+};
+
+/**
+ * Never ready, the buffered appender keeps everything
+ */
+struct OfflineAppender : LogAppender
+{
+    bool append(const LogMessage *message)
+    {
+        return false;
+    }
+};
+
+struct CaptureAppender : LogAppender
+{
+    std::vector<std::string> lines;
+    bool append(const LogMessage *message)
+    {
+        if (message)
+            lines.push_back(message->message());
+        return true;
+    }
+};
+
+void onAbort(int)
+{
+    Logging::dumpPending(20);
+    _exit(Dumped);
+}
+
+void crash()
+{
+    static StuckAppender stuck;
+    static OfflineAppender offline;
+    Logging::setLevel(LogLevel::Verbose);
+    SimpleLoggable loggable("crashy");
+    Logging::addBufferedAppender(&offline, 4096, false);
+    for (int i = 0; i < 10; i++)
+        loggable.logger().logf(LogLevel::Info, "buffered %d", i);
+    Logging::addAppender(&stuck);
+    Logging::useQueue(16384);
+    Logging::usePanicPartition("logdump");
+    signal(SIGABRT, onAbort);
+    for (int i = 0; i < 60; i++)
+        loggable.logger().logf(i % 3 == 0 ? LogLevel::Warning : (i % 3 == 1 ? LogLevel::Info : LogLevel::Debug), "message %d", i);
+    usleep(100000);
+    abort();
+}
+
+int main()
+{
+    hosttest::flash = (uint8_t *)mmap(nullptr, FlashSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    hosttest::flashSize = FlashSize;
+    memset(hosttest::flash, Untouched, FlashSize);
+
+    auto pid = fork();
+    if (!pid)
+        crash();
+    int status;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == Dumped);
+
+    // the dump is small, only the first sector is erased
+    CHECK(hosttest::flash[4096] == Untouched);
+    CHECK(hosttest::flash[FlashSize - 1] == Untouched);
+
+    CaptureAppender capture;
+    Logging::addAppender(&capture);
+    CHECK(Logging::usePanicPartition("logdump"));
+    // the buffered ones first: those logged before the queue, and the first one the stuck appender never returned from
+    CHECK(capture.lines.size() == 11 + 20);
+    if (capture.lines.size() == 11 + 20)
+    {
+        for (auto &line : capture.lines)
+            CHECK(line.find("before the crash:") == 0);
+        CHECK(capture.lines[0].find("crashy  buffered 0") != std::string::npos);
+        CHECK(capture.lines[9].find("crashy  buffered 9") != std::string::npos);
+        CHECK(capture.lines[10].find("crashy  message 0") != std::string::npos);
+        CHECK(capture.lines[11].find("crashy  message 40") != std::string::npos);
+        CHECK(capture.lines.back().find("crashy  message 59") != std::string::npos);
+    }
+    // the dump is replayed only once
+    capture.lines.clear();
+    CHECK(Logging::usePanicPartition("logdump"));
+    CHECK(capture.lines.empty());
+    Logging::removeAppender(&capture);
+    return hosttest::result();
+}
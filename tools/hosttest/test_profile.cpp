@@ -0,0 +1,57 @@
+// sources: logging.cpp
+// flags: -DLOGGING_PROFILE=1
+/**
+ * Call site profiler: sites whose text isn't a literal are reported under a fixed label,
+ * the report must not refer to buffers that are gone
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct CaptureAppender : LogAppender
+{
+    std::vector<std::string> lines;
+    bool append(const LogMessage *message)
+    {
+        if (message)
+            lines.push_back(message->message());
+        return true;
+    }
+    bool contains(const char *text) const
+    {
+        for (auto &l : lines)
+            if (l.find(text) != std::string::npos)
+                return true;
+        return false;
+    }
+};
+
+int main()
+{
+    CaptureAppender capture;
+    Logging::addAppender(&capture);
+    SimpleLoggable loggable("profiled");
+    auto &logger = loggable.logger();
+    for (int i = 0; i < 3; i++)
+    {
+        auto line = strdup("line assembled at runtime");
+        logger.log(LogLevel::Info, line);
+        free(line);
+    }
+    logger.logf(LogLevel::Info, "formatted %d", 1);
+
+    capture.lines.clear();
+    Logging::dumpProfile(10);
+    CHECK(capture.contains("\"log()\""));
+    CHECK(capture.contains("\"formatted %d\""));
+    CHECK(!capture.contains("assembled"));
+    Logging::removeAppender(&capture);
+    return hosttest::result();
+}
@@ -0,0 +1,200 @@
+// sources: logging.cpp
+/**
+ * Severity lanes and per-core rings of the queue: errors get through a verbose and debug storm in bounded time, messages too large for their lane
+ * bypass the queue, and messages logged one after another on different cores are recorded in that order
+ */
+#include <stdio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+int64_t nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct CaptureAppender : LogAppender
+{
+    std::mutex lock;
+    std::vector<std::string> lines;
+    std::atomic<int> errors{0}, others{0};
+    uint32_t delayUs = 0;
+    // when set, the time "error N" was logged, the appender records the worst delay until it gets the message
+    const std::atomic<int64_t> *errorStamps = nullptr;
+    std::atomic<int64_t> worstErrorUs{0};
+    bool append(const LogMessage *message)
+    {
+        if (!message)
+            return true;
+        if (delayUs)
+            usleep(delayUs);
+        int n;
+        if (errorStamps && message->level() == LogLevel::Error && sscanf(message->message(), "error %d", &n) == 1)
+        {
+            auto latency = nowUs() - errorStamps[n];
+            auto worst = worstErrorUs.load();
+            while (latency > worst && !worstErrorUs.compare_exchange_weak(worst, latency))
+                ;
+        }
+        (message->level() <= LogLevel::Error ? errors : others)++;
+        std::lock_guard<std::mutex> guard(lock);
+        lines.push_back(message->message());
+        return true;
+    }
+    size_t count(const std::string &line)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t result = 0;
+        for (auto &l : lines)
+            if (l == line)
+                result++;
+        return result;
+    }
+};
+
+/**
+ * Runs @p fn in a thread that the stubs map to @p core
+ */
+std::thread onCore(int core, std::function<void()> fn)
+{
+    struct Start
+    {
+        std::atomic<int> actual{-1};
+        std::atomic<bool> go{false};
+    };
+    for (;;)
+    {
+        // shared with the thread, which outlives this call
+        auto start = std::make_shared<Start>();
+        std::thread t([start, core, fn] {
+            start->actual = xPortGetCoreID();
+            while (!start->go)
+                std::this_thread::yield();
+            if (start->actual == core)
+                fn();
+        });
+        while (start->actual < 0)
+            std::this_thread::yield();
+        start->go = true;
+        if (start->actual == core)
+            return t;
+        t.join();
+    }
+}
+
+int main()
+{
+    SimpleLoggable loggable("lanes");
+    auto &logger = loggable.logger();
+    Logging::setLevel(LogLevel::Verbose);
+
+    // a slow appender and a verbose and debug storm: every error gets through, and soon.
+    // The appender takes 200us a message, an error waits for at most a few messages of the lower lanes,
+    // while in a single FIFO it would wait behind the whole backlog of the storm
+    {
+        const int Errors = 100;
+        std::atomic<int64_t> stamps[Errors];
+        CaptureAppender capture;
+        capture.delayUs = 200;
+        capture.errorStamps = stamps;
+        Logging::addAppender(&capture);
+        Logging::useQueue(131072);
+        std::atomic<bool> stop(false);
+        std::vector<std::thread> storm;
+        for (auto level : {LogLevel::Verbose, LogLevel::Debug})
+            storm.emplace_back([&, level] {
+                while (!stop)
+                    logger.log(level, "storm message with some padding");
+            });
+        int64_t worstLogUs = 0;
+        for (int i = 0; i < Errors; i++)
+        {
+            stamps[i] = nowUs();
+            logger.logf(LogLevel::Error, "error %d", i);
+            if (nowUs() - stamps[i] > worstLogUs)
+                worstLogUs = nowUs() - stamps[i];
+            usleep(5000);
+        }
+        stop = true;
+        for (auto &t : storm)
+            t.join();
+        Logging::flush(5000);
+        CHECK(capture.errors == Errors);
+        // a few ms with the lanes, over 100ms if errors queue behind the storm, the bounds leave room for a loaded host
+        CHECK(worstLogUs < 20000);
+        CHECK(capture.worstErrorUs < 30000);
+        Logging::useQueue(0);
+        Logging::removeAppender(&capture);
+    }
+
+    // too large for the lanes of the default queue, passed to the appenders by the logging task whatever the level
+    {
+        CaptureAppender capture;
+        Logging::addAppender(&capture);
+        Logging::useQueue();
+        std::string large(400, 'x');
+        logger.log(LogLevel::Error, large.c_str());
+        CHECK(capture.count(large) == 1);
+        auto started = nowUs();
+        logger.log(LogLevel::Info, large.c_str());
+        CHECK(nowUs() - started < 20000);
+        CHECK(capture.count(large) == 2);
+        logger.log(LogLevel::Debug, large.c_str());
+        CHECK(capture.count(large) == 3);
+        Logging::useQueue(0);
+        Logging::removeAppender(&capture);
+    }
+
+    // ping-pong between the cores
+    {
+        CaptureAppender capture;
+        Logging::addAppender(&capture);
+        Logging::useQueue(16384);
+        const int Messages = 200;
+        std::mutex lock;
+        std::condition_variable turn;
+        int next = 0;
+        auto player = [&](int core) {
+            return onCore(core, [&, core] {
+                for (;;)
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    turn.wait(guard, [&] { return next >= Messages || next % 2 == core; });
+                    if (next >= Messages)
+                        return;
+                    logger.logf(LogLevel::Info, "message %d", next);
+                    next++;
+                    turn.notify_all();
+                }
+            });
+        };
+        auto a = player(0), b = player(1);
+        a.join();
+        b.join();
+        Logging::flush(1000);
+        CHECK(capture.lines.size() == Messages);
+        int outOfOrder = 0;
+        for (int i = 0; i < (int)capture.lines.size(); i++)
+            if (capture.lines[i] != "message " + std::to_string(i))
+                outOfOrder++;
+        CHECK(outOfOrder == 0);
+        Logging::useQueue(0);
+        Logging::removeAppender(&capture);
+    }
+    return hosttest::result();
+}
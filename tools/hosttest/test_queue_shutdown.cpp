@@ -0,0 +1,115 @@
+// sources: logging.cpp
+/**
+ * Logging::flush() with the queue installed, removing the queue while an appender is stuck in append(),
+ * and removing it while tasks are waiting for room in a full queue
+ */
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+struct CountingAppender : LogAppender
+{
+    std::atomic<int> count{0};
+    // the first message takes this long to record
+    uint32_t stuckMs = 0;
+    // every message takes this long to record
+    uint32_t delayUs = 0;
+    bool append(const LogMessage *message)
+    {
+        if (!message)
+            return true;
+        if (!count++ && stuckMs)
+            usleep(stuckMs * 1000);
+        if (delayUs)
+            usleep(delayUs);
+        return true;
+    }
+};
+
+int64_t nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main()
+{
+    SimpleLoggable loggable("queue");
+    auto &logger = loggable.logger();
+
+    // flush() returns once everything is recorded
+    {
+        CountingAppender counting;
+        Logging::addAppender(&counting);
+        Logging::useQueue(16384);
+        for (int i = 0; i < 50; i++)
+            logger.logf(LogLevel::Info, "message %d", i);
+        CHECK(Logging::flush(1000) == 0);
+        CHECK(counting.count == 50);
+        Logging::useQueue(0);
+        Logging::removeAppender(&counting);
+    }
+
+    // the stuck appender delays the shutdown, but the rest of the queue is discarded
+    {
+        CountingAppender stuck;
+        stuck.stuckMs = 2000;
+        Logging::addAppender(&stuck);
+        Logging::useQueue(16384);
+        for (int i = 0; i < 20; i++)
+            logger.logf(LogLevel::Info, "message %d", i);
+        usleep(100000);
+        auto started = nowMs();
+        Logging::useQueue(0);
+        auto elapsed = nowMs() - started;
+        CHECK(elapsed >= 1500 && elapsed < 5000);
+        CHECK(stuck.count < 20);
+        // without the queue messages go straight to the appenders
+        auto before = stuck.count.load();
+        logger.log(LogLevel::Info, "direct");
+        CHECK(stuck.count == before + 1);
+        // the queue task released the appenders snapshot, so they can be changed
+        CountingAppender other;
+        Logging::addAppender(&other);
+        Logging::removeAppender(&other);
+        Logging::removeAppender(&stuck);
+    }
+
+    // the slow appender keeps the queue full, so producers wait for room while the queue is being removed
+    {
+        CountingAppender slow;
+        slow.delayUs = 50;
+        Logging::addAppender(&slow);
+        std::atomic<bool> stop{false};
+        std::atomic<int> logged{0};
+        std::vector<std::thread> tasks;
+        for (int t = 0; t < 4; t++)
+            tasks.emplace_back([&] {
+                while (!stop)
+                {
+                    logger.log(LogLevel::Info, "waiting for room");
+                    logged++;
+                }
+            });
+        for (int round = 0; round < 200; round++)
+        {
+            Logging::useQueue(512);
+            usleep(5000);
+            Logging::useQueue(0);
+        }
+        stop = true;
+        for (auto &t : tasks)
+            t.join();
+        CHECK(logged > 0);
+        CHECK(slow.count > 0);
+        Logging::removeAppender(&slow);
+    }
+    return hosttest::result();
+}
@@ -0,0 +1,132 @@
+// sources: logging.cpp
+/**
+ * Per-site rate limiting and collapsing of repeated messages, summaries of the loggers that went quiet,
+ * and call sites sharing a rate bucket
+ */
+#include <string.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+// summaries of quiet loggers come from the timer task
+struct CaptureAppender : LogAppender
+{
+    std::mutex lock;
+    std::vector<std::string> lines;
+    bool append(const LogMessage *message)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (message)
+            lines.push_back(message->message());
+        return true;
+    }
+    size_t size()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return lines.size();
+    }
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        lines.clear();
+    }
+    size_t count(const char *text)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t result = 0;
+        for (auto &l : lines)
+            if (l == text)
+                result++;
+        return result;
+    }
+};
+
+int main()
+{
+    CaptureAppender capture;
+    Logging::addAppender(&capture);
+    SimpleLoggable loggable("rate");
+    auto &logger = loggable.logger();
+
+    Logging::setRateLimit(3, 1);
+    for (int i = 0; i < 10; i++)
+        logger.logf(LogLevel::Info, "flood %d", i);
+    CHECK(capture.size() == 3);
+    // errors are never limited
+    for (int i = 0; i < 10; i++)
+        logger.logf(LogLevel::Error, "error %d", i);
+    CHECK(capture.size() == 13);
+
+    // log() calls sharing a line buffer are different sites when the text differs
+    capture.clear();
+    char line[32];
+    for (int i = 0; i < 10; i++)
+    {
+        strcpy(line, i % 2 ? "odd line" : "even line");
+        logger.log(LogLevel::Info, line);
+    }
+    CHECK(capture.count("odd line") == 3);
+    CHECK(capture.count("even line") == 3);
+    Logging::setRateLimit(0);
+
+    // the summary of the suppressed messages comes with the first different message
+    capture.clear();
+    Logging::setRepeatWindow(10000);
+    for (int i = 0; i < 5; i++)
+        logger.log(LogLevel::Info, "same");
+    logger.log(LogLevel::Info, "different");
+    CHECK(capture.size() == 3);
+    CHECK(capture.count("same") == 1);
+    CHECK(capture.count("last message repeated 4 times") == 1);
+
+    // the summary doesn't wait for the logger to log again
+    capture.clear();
+    Logging::setRepeatWindow(200);
+    for (int i = 0; i < 5; i++)
+        logger.log(LogLevel::Info, "then silence");
+    CHECK(capture.size() == 1);
+    usleep(500000);
+    CHECK(capture.count("last message repeated 4 times") == 1);
+    // the next identical message starts a new window, and isn't counted as repeated
+    logger.log(LogLevel::Info, "then silence");
+    CHECK(capture.count("then silence") == 2);
+    Logging::setRepeatWindow(0);
+    usleep(300000);
+    CHECK(capture.size() == 3);
+
+    // neither does the summary of the rate limited messages, it comes when the bucket has a token again
+    capture.clear();
+    Logging::setRateLimit(1, 10);
+    for (int i = 0; i < 5; i++)
+        logger.logf(LogLevel::Info, "burst %d", i);
+    CHECK(capture.size() == 1);
+    usleep(400000);
+    CHECK(capture.count("4 similar messages suppressed") == 1);
+    Logging::setRateLimit(0);
+
+    // formats 128 bytes apart share a bucket, taking turns doesn't give each of them a fresh burst
+    capture.clear();
+    static char formats[2][128] = {"alpha %d", "beta %d"};
+    Logging::setRateLimit(3, 1);
+    for (int i = 0; i < 20; i++)
+        logger.logf(LogLevel::Info, formats[i % 2], i);
+    size_t passed = 0;
+    {
+        std::lock_guard<std::mutex> guard(capture.lock);
+        for (auto &l : capture.lines)
+            if (!strncmp(l.c_str(), "alpha", 5) || !strncmp(l.c_str(), "beta", 4))
+                passed++;
+    }
+    CHECK(passed == 3);
+    Logging::setRateLimit(0);
+
+    Logging::removeAppender(&capture);
+    return hosttest::result();
+}
@@ -0,0 +1,139 @@
+// sources: logging.cpp segment-appender.cpp
+/**
+ * SegmentAppender on the in-memory file system: lines read back in order across segment wrap-around, errors committed
+ * right away, and recovery after power is cut at random points of writing
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+#include "segment-appender.hpp"
+
+using namespace esp32m;
+
+struct TestSegmentAppender : SegmentAppender
+{
+    using SegmentAppender::SegmentAppender;
+    bool put(const char *line) { return append(line); }
+    std::string readAll()
+    {
+        std::string result;
+        read([](const char *data, size_t len, void *arg) { ((std::string *)arg)->append(data, len); }, &result);
+        return result;
+    }
+};
+
+std::vector<std::string> split(const std::string &text)
+{
+    std::vector<std::string> lines;
+    size_t pos = 0;
+    for (size_t e; (e = text.find('\n', pos)) != std::string::npos; pos = e + 1)
+        lines.push_back(text.substr(pos, e - pos));
+    return lines;
+}
+
+/**
+ * Writes numbered lines of random length, remembering the ones reported as written
+ */
+void writeLines(TestSegmentAppender &a, int &next, int count, std::set<int> &written)
+{
+    for (int i = 0; i < count; i++, next++)
+    {
+        char line[64];
+        snprintf(line, sizeof(line), "line %d %s", next, std::string(rand() % 40, 'x').c_str());
+        if (a.put(line))
+            written.insert(next);
+    }
+}
+
+int main()
+{
+    srand(1);
+    FS fs;
+
+    // 3 segments of 8 full pages wrap around several times, only the newest lines are kept
+    {
+        TestSegmentAppender a(fs, "/log", 3, 2048, 256, 1000000);
+        int next = 0;
+        std::set<int> written;
+        writeLines(a, next, 500, written);
+        CHECK(written.size() == 500);
+        CHECK(a.commit());
+        auto lines = split(a.readAll());
+        CHECK(lines.size() > 50 && lines.size() < 500);
+        int prev = -1, gaps = 0;
+        for (auto &l : lines)
+        {
+            int n = -1;
+            if (sscanf(l.c_str(), "line %d", &n) != 1 || (prev >= 0 && n != prev + 1))
+                gaps++;
+            prev = n;
+        }
+        CHECK(gaps == 0);
+        CHECK(prev == 499);
+        for (int s = 0; s < 3; s++)
+            CHECK(hosttest::files["/log." + std::to_string(s)].size() == 2048);
+    }
+
+    // an error is committed at once, the rest waits for the page to fill
+    hosttest::files.clear();
+    {
+        TestSegmentAppender a(fs, "/log", 2, 1024, 256, 1000000);
+        Logging::addAppender(&a);
+        SimpleLoggable loggable("segment");
+        loggable.logger().log(LogLevel::Info, "buffered");
+        CHECK(a.readAll().empty());
+        loggable.logger().log(LogLevel::Error, "failure");
+        auto lines = split(a.readAll());
+        CHECK(lines.size() == 2 && lines[1].find("failure") != std::string::npos);
+        Logging::removeAppender(&a);
+    }
+
+    // power is cut somewhere in the writes, the appender that comes up next resumes after the intact pages
+    int failed = 0;
+    for (int round = 0; round < 200; round++)
+    {
+        hosttest::files.clear();
+        hosttest::fsWriteBudget = -1;
+        int next = 0;
+        std::set<int> written;
+        {
+            TestSegmentAppender a(fs, "/log", 3, 2048, 256, 0);
+            writeLines(a, next, 50, written);
+        }
+        hosttest::fsWriteBudget = rand() % 4000;
+        {
+            TestSegmentAppender a(fs, "/log", 3, 2048, 256, 0);
+            writeLines(a, next, 200, written);
+            hosttest::fsWriteBudget = 0;
+        }
+        hosttest::fsWriteBudget = -1;
+        TestSegmentAppender a(fs, "/log", 3, 2048, 256, 0);
+        a.put("after recovery");
+        auto lines = split(a.readAll());
+        bool ok = !lines.empty() && lines.back() == "after recovery";
+        // intact and in order
+        std::set<int> seen;
+        int prev = -1;
+        for (size_t i = 0; ok && i + 1 < lines.size(); i++)
+        {
+            int n;
+            ok = sscanf(lines[i].c_str(), "line %d", &n) == 1 && n > prev && n < next;
+            prev = n;
+            seen.insert(n);
+        }
+        // the newest lines reported as written survive
+        for (auto n : written)
+            if (ok && n > *written.rbegin() - 15)
+                ok = seen.count(n) != 0;
+        if (!ok)
+            failed++;
+    }
+    CHECK(failed == 0);
+    return hosttest::result();
+}
@@ -0,0 +1,111 @@
+// sources: logging.cpp
+/**
+ * Lines printed through the hooked UART by many tasks at once, while all the per-task buffers are taken and the rest share
+ * the last one, by an appender that prints back to the same UART
+ */
+#include <stdio.h>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+
+using namespace esp32m;
+
+void print(const char *text)
+{
+    for (auto p = text; *p; p++)
+        hosttest::putc1(*p);
+}
+
+/**
+ * Echoes every message back to the hooked UART, like an appender writing to Serial
+ */
+struct EchoAppender : LogAppender
+{
+    std::mutex lock;
+    std::vector<std::string> lines;
+    bool append(const LogMessage *message)
+    {
+        if (!message)
+            return true;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            lines.push_back(message->message());
+        }
+        print(message->message());
+        print("\n");
+        return true;
+    }
+};
+
+int main()
+{
+    EchoAppender echo;
+    Logging::addAppender(&echo);
+    Logging::hookUartLogger(128);
+
+    // these take all the per-task buffers
+    std::atomic<bool> done(false);
+    std::vector<std::thread> holders;
+    for (int t = 0; t < 8; t++)
+        holders.emplace_back([&] {
+            print("partial");
+            while (!done)
+                std::this_thread::yield();
+            print("\n");
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // one task writing to the shared buffer gets its lines logged as they are
+    const int Lines = 200;
+    char line[64];
+    std::thread([&] {
+        for (int i = 0; i < Lines; i++)
+        {
+            snprintf(line, sizeof(line), "shared line %d\n", i);
+            print(line);
+        }
+    }).join();
+    std::set<std::string> unique;
+    for (auto &l : echo.lines)
+        unique.insert(l);
+    CHECK(unique.size() == Lines);
+    snprintf(line, sizeof(line), "shared line %d", Lines - 1);
+    CHECK(unique.count(line) == 1);
+
+    // more of them mix their characters, but none is lost
+    echo.lines.clear();
+    const int Tasks = 4;
+    std::atomic<size_t> printed(0);
+    std::vector<std::thread> tasks;
+    for (int t = 0; t < Tasks; t++)
+        tasks.emplace_back([t, &printed] {
+            char line[64];
+            for (int i = 0; i < Lines; i++)
+            {
+                printed += snprintf(line, sizeof(line), "task %d line %d\n", t, i) - 1;
+                print(line);
+            }
+        });
+    for (auto &t : tasks)
+        t.join();
+    size_t logged = 0;
+    for (auto &l : echo.lines)
+        logged += l.size();
+    CHECK(logged == printed);
+
+    echo.lines.clear();
+    done = true;
+    for (auto &t : holders)
+        t.join();
+    CHECK(echo.lines.size() == 8);
+    Logging::hookUartLogger(0);
+    Logging::removeAppender(&echo);
+    return hosttest::result();
+}
@@ -0,0 +1,82 @@
+// sources: logging.cpp uart-appender.cpp
+/**
+ * UARTAppender on a slow line: overflow policies, errors written synchronously after the lines already buffered,
+ * and the appender destroyed while its task is still writing
+ */
+#include <string>
+#include <vector>
+
+#include "hosttest.hpp"
+#include "logging.hpp"
+#include "uart-appender.hpp"
+
+using namespace esp32m;
+
+std::vector<std::string> lines(const std::string &output)
+{
+    std::vector<std::string> result;
+    size_t start = 0, end;
+    while ((end = output.find('\n', start)) != std::string::npos)
+    {
+        result.push_back(output.substr(start, end - start));
+        start = end + 1;
+    }
+    return result;
+}
+
+void flood(Logger &logger, int count)
+{
+    for (int i = 0; i < count; i++)
+        logger.logf(LogLevel::Info, "info line %d with some padding to fill the buffer", i);
+    logger.logf(LogLevel::Error, "the error");
+    Logging::flush(5000);
+}
+
+void check(const std::string &output, int count, bool all)
+{
+    auto l = lines(output);
+    CHECK(!l.empty() && l.back().find("the error") != std::string::npos);
+    int infos = 0;
+    for (auto &line : l)
+        if (line.find("info line") != std::string::npos)
+            infos++;
+    if (all)
+        CHECK(infos == count);
+    else
+        CHECK(infos > 0 && infos < count);
+}
+
+int main()
+{
+    SimpleLoggable loggable("uart");
+    hosttest::uartWriteDelayMs = 2;
+    {
+        static UARTAppender uart(0, 512, UARTAppender::Overflow::Drop);
+        Logging::addAppender(&uart);
+        hosttest::takeUartOutput();
+        flood(loggable.logger(), 50);
+        check(hosttest::takeUartOutput(), 50, false);
+        CHECK(uart.dropped() > 0);
+        Logging::removeAppender(&uart);
+    }
+    {
+        static UARTAppender uart(0, 512, UARTAppender::Overflow::Block);
+        Logging::addAppender(&uart);
+        hosttest::takeUartOutput();
+        flood(loggable.logger(), 50);
+        check(hosttest::takeUartOutput(), 50, true);
+        CHECK(uart.dropped() == 0);
+        Logging::removeAppender(&uart);
+    }
+    // the destructor waits for the buffered lines to be written before freeing the buffer and the lock
+    {
+        UARTAppender uart(0, 2048, UARTAppender::Overflow::Block);
+        Logging::addAppender(&uart);
+        hosttest::takeUartOutput();
+        for (int i = 0; i < 20; i++)
+            loggable.logger().logf(LogLevel::Info, "info line %d", i);
+        Logging::removeAppender(&uart);
+    }
+    CHECK(lines(hosttest::takeUartOutput()).size() == 20);
+    return hosttest::result();
+}
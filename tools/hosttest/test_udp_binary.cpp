@@ -0,0 +1,147 @@
+// sources: logging.cpp udp-appender.cpp
+/**
+ * Binary UDP export decoded the way tools/logdecode does it: every message must resolve to its own logger and task names
+ * while the name dictionary is being churned, and a frame that fails to send must not make the message go out twice
+ */
+#include <string.h>
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "hosttest.hpp"
+#include "log-wire.hpp"
+#include "logging.hpp"
+#include "udp-appender.hpp"
+
+using namespace esp32m;
+
+struct CaptureUDPAppender : UDPAppender
+{
+    CaptureUDPAppender() : UDPAppender(Format::Binary) {}
+    std::mutex lock;
+    std::vector<std::string> frames;
+    int transmits = 0;
+    // every n-th datagram is lost to the full socket buffer
+    int failEvery = 0;
+
+protected:
+    bool ready() { return true; }
+    bool transmit(const LogSegment *segments, size_t count)
+    {
+        if (!segments)
+            return true;
+        std::lock_guard<std::mutex> guard(lock);
+        if (failEvery && ++transmits % failEvery == 0)
+            return false;
+        std::string frame;
+        for (size_t i = 0; i < count; i++)
+            frame.append(segments[i].data, segments[i].len);
+        frames.push_back(frame);
+        return true;
+    }
+};
+
+/**
+ * @return Texts of the messages, prefixed with the logger and task names resolved from the dictionary
+ */
+std::vector<std::string> decode(const std::vector<std::string> &frames)
+{
+    std::vector<std::string> result;
+    std::map<uint16_t, std::string> names;
+    for (auto &frame : frames)
+    {
+        logwire::FrameHeader h;
+        memcpy(&h, frame.data(), sizeof(h));
+        CHECK(h.magic == logwire::Magic && h.length == frame.size());
+        for (size_t pos = sizeof(h); pos < frame.size();)
+        {
+            logwire::RecordHeader r;
+            memcpy(&r, frame.data() + pos, sizeof(r));
+            if (r.type == logwire::RecordType::Name)
+            {
+                logwire::NameRecord n;
+                memcpy(&n, frame.data() + pos, sizeof(n));
+                names[n.id] = frame.substr(pos + sizeof(n), r.length - sizeof(n));
+            }
+            else if (r.type == logwire::RecordType::Message)
+            {
+                logwire::MessageRecord m;
+                memcpy(&m, frame.data() + pos, sizeof(m));
+                result.push_back(names[m.name] + "|" + names[m.task] + "|" + frame.substr(pos + sizeof(m), m.messageLength));
+            }
+            pos += r.length;
+        }
+    }
+    return result;
+}
+
+const int Loggers = 300;
+const int Tasks = 4;
+const int PerTask = 600;
+std::string names[Loggers];
+SimpleLoggable *loggers[Loggers];
+volatile int running = Tasks;
+
+void worker(void *)
+{
+    std::string task = pcTaskGetName(nullptr);
+    for (int i = 0; i < PerTask; i++)
+    {
+        auto n = (i * 7 + task.back()) % Loggers;
+        auto expected = names[n] + "|" + task;
+        loggers[n]->logger().log(LogLevel::Info, expected.c_str());
+    }
+    __sync_fetch_and_sub(&running, 1);
+}
+
+int main()
+{
+    for (int i = 0; i < Loggers; i++)
+    {
+        names[i] = "logger" + std::to_string(i);
+        loggers[i] = new SimpleLoggable(names[i].c_str());
+    }
+
+    {
+        CaptureUDPAppender udp;
+        Logging::addAppender(&udp);
+        for (int t = 0; t < Tasks; t++)
+            xTaskCreate(worker, ("worker" + std::to_string(t)).c_str(), 4096, nullptr, 1, nullptr);
+        while (running)
+            vTaskDelay(10);
+        Logging::system().log(LogLevel::Error, "system|main");
+        Logging::removeAppender(&udp);
+        auto messages = decode(udp.frames);
+        CHECK(messages.size() == Tasks * PerTask + 1);
+        int wrong = 0;
+        for (auto &m : messages)
+        {
+            // name|task|text, the text repeats the names it was logged with
+            auto first = m.find('|'), second = m.find('|', first + 1);
+            if (m.substr(0, second) != m.substr(second + 1))
+                wrong++;
+        }
+        CHECK(wrong == 0);
+    }
+
+    {
+        static CaptureUDPAppender udp;
+        udp.failEvery = 3;
+        Logging::addBufferedAppender(&udp, 8192, false);
+        for (int i = 0; i < 100; i++)
+            loggers[0]->logger().logf(LogLevel::Error, "error %d", i);
+        udp.failEvery = 0;
+        loggers[0]->logger().log(LogLevel::Error, "last");
+        auto messages = decode(udp.frames);
+        std::set<std::string> unique(messages.begin(), messages.end());
+        CHECK(messages.size() == 101);
+        CHECK(unique.size() == messages.size());
+    }
+    return hosttest::result();
+}
@@ -0,0 +1,588 @@
+/**
+ * Receives and renders logs exported by UDPAppender in the Binary mode, see include/log-wire.hpp
+ *
+ * Build on Linux:
+ *   g++ -std=c++11 -O2 -I../../include -o logdecode logdecode.cpp
+ *
+ * Usage:
+ *   logdecode [-j] [-a] -u port    receive UDP datagrams
+ *   logdecode [-j] [-a] -t port    accept TCP connections carrying the stream of frames
+ *   logdecode [-j] [-a] [file]     read the stream of frames from the file, or stdin
+ *
+ * Messages are printed to stdout, as text in the same format as on the device, or as JSON objects (-j),
+ * see LogMessage::toJson(...). Lost messages and new sessions are reported to stderr.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "log-wire.hpp"
+
+using namespace esp32m::logwire;
+
+namespace
+{
+    bool json = false;
+    bool showSource = false;
+
+    /**
+     * @brief State of the device sending the log, identified by its address
+     */
+    struct Source
+    {
+        bool started = false;
+        uint32_t session = 0;
+        uint32_t expected = 0;
+        uint64_t received = 0;
+        uint64_t lost = 0;
+        std::map<uint16_t, std::string> names;
+    };
+
+    std::map<std::string, Source> sources;
+
+    template <typename T>
+    T read(const uint8_t *p)
+    {
+        T v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    void put(std::string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+    void put(std::string &out, const char *format, ...)
+    {
+        char buf[64];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        out += buf;
+    }
+
+    void putJson(std::string &out, const char *s, size_t len)
+    {
+        out += '"';
+        for (size_t i = 0; i < len; i++)
+        {
+            auto c = (uint8_t)s[i];
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (c == '\n')
+                out += "\\n";
+            else if (c == '\r')
+                out += "\\r";
+            else if (c == '\t')
+                out += "\\t";
+            else if (c < 0x20)
+                put(out, "\\u%04x", c);
+            else
+                out += c;
+        }
+        out += '"';
+    }
+
+    void putJson(std::string &out, const std::string &s) { putJson(out, s.data(), s.size()); }
+
+    size_t fieldValueSize(uint8_t type)
+    {
+        switch (type)
+        {
+        case Bool:
+            return 1;
+        case Int:
+        case UInt:
+        case Float:
+            return 4;
+        case Int64:
+        case UInt64:
+        case Double:
+            return 8;
+        default:
+            return 0;
+        }
+    }
+
+    /**
+     * @brief Renders string value of the key=value pair, quoted if needed
+     */
+    void putValue(std::string &out, const char *s, size_t len)
+    {
+        bool quote = false;
+        for (size_t i = 0; !quote && i < len; i++)
+            quote = s[i] == ' ' || s[i] == '"' || s[i] == '=';
+        if (quote)
+            out += '"';
+        for (size_t i = 0; i < len; i++)
+        {
+            if (quote && (s[i] == '"' || s[i] == '\\'))
+                out += '\\';
+            out += s[i];
+        }
+        if (quote)
+            out += '"';
+    }
+
+    /**
+     * @brief Renders the field as key=value, or "key":value in JSON
+     */
+    void putField(std::string &out, uint8_t type, const char *key, size_t keyLen, const uint8_t *value, size_t valueLen)
+    {
+        if (json)
+        {
+            putJson(out, key, keyLen);
+            out += ':';
+        }
+        else
+        {
+            out.append(key, keyLen);
+            out += '=';
+        }
+        switch (type)
+        {
+        case Bool:
+            out += value[0] ? "true" : "false";
+            break;
+        case Int:
+            put(out, "%d", read<int32_t>(value));
+            break;
+        case UInt:
+            put(out, "%u", read<uint32_t>(value));
+            break;
+        case Int64:
+            put(out, "%lld", (long long)read<int64_t>(value));
+            break;
+        case UInt64:
+            put(out, "%llu", (unsigned long long)read<uint64_t>(value));
+            break;
+        case Float:
+        case Double:
+        {
+            double d = type == Float ? read<float>(value) : read<double>(value);
+            if (json && !isfinite(d))
+                out += "null";
+            else
+                put(out, "%g", d);
+            break;
+        }
+        case String:
+        {
+            if (json)
+                putJson(out, (const char *)value, valueLen);
+            else
+                putValue(out, (const char *)value, valueLen);
+            break;
+        }
+        }
+    }
+
+    /**
+     * @brief Renders encoded structured fields, separated by spaces, or commas in JSON
+     */
+    void putFields(std::string &out, const uint8_t *f, size_t size)
+    {
+        size_t offset = 0;
+        bool first = true;
+        while (offset + 2 <= size)
+        {
+            auto type = f[offset];
+            size_t keyLen = f[offset + 1];
+            auto key = (const char *)f + offset + 2;
+            auto pos = offset + 2 + keyLen;
+            size_t valueLen;
+            if (type == String)
+            {
+                if (pos + 1 > size)
+                    return;
+                valueLen = f[pos++];
+            }
+            else if (!(valueLen = fieldValueSize(type)))
+                return;
+            if (pos + valueLen > size)
+                return;
+            if (!first)
+                out += json ? ',' : ' ';
+            first = false;
+            putField(out, type, key, keyLen, f + pos, valueLen);
+            offset = pos + valueLen;
+        }
+    }
+
+    void putStamp(std::string &out, int64_t stamp)
+    {
+        if (stamp < 0)
+        {
+            stamp = -stamp;
+            char buf[32];
+            time_t now = stamp / 1000;
+            struct tm timeinfo;
+            localtime_r(&now, &timeinfo);
+            strftime(buf, sizeof(buf), "%F %T", &timeinfo);
+            put(out, "%s.%04d", buf, (int)(stamp % 1000));
+        }
+        else
+        {
+            int millis = stamp % 1000;
+            stamp /= 1000;
+            int seconds = stamp % 60;
+            stamp /= 60;
+            int minutes = stamp % 60;
+            stamp /= 60;
+            int hours = stamp % 24;
+            int days = stamp / 24;
+            put(out, "%d:%02d:%02d:%02d.%04d", days, hours, minutes, seconds, millis);
+        }
+    }
+
+    void printMessage(const std::string &from, Source &src, const MessageRecord &r, const uint8_t *body)
+    {
+        static const char *levels = "??EWIDV";
+        char l = r.level < 7 ? levels[r.level] : '?';
+        auto fieldsSize = r.header.length - sizeof(r) - r.messageLength;
+        auto fields = body + r.messageLength;
+        auto name = src.names.find(r.name);
+        std::string logger = name == src.names.end() ? "#" + std::to_string(r.name) : name->second;
+        std::string task;
+        bool hasTask = r.task != NoName;
+        if (hasTask)
+        {
+            auto t = src.names.find(r.task);
+            task = t == src.names.end() ? "#" + std::to_string(r.task) : t->second;
+        }
+        std::string out;
+        if (json)
+        {
+            put(out, "{\"t\":%lld,\"l\":\"%c\",\"n\":", (long long)r.stamp, l);
+            putJson(out, logger);
+            out += ",\"m\":";
+            putJson(out, (const char *)body, r.messageLength);
+            if (hasTask)
+            {
+                out += ",\"task\":";
+                putJson(out, task);
+            }
+            put(out, ",\"core\":%u", r.core);
+            if (r.span)
+                put(out, ",\"span\":%u", r.span);
+            if (showSource)
+            {
+                out += ",\"src\":";
+                putJson(out, from);
+            }
+            if (fieldsSize)
+            {
+                out += ",\"f\":{";
+                putFields(out, fields, fieldsSize);
+                out += '}';
+            }
+            out += '}';
+        }
+        else
+        {
+            if (showSource)
+                out += from + ' ';
+            putStamp(out, r.stamp);
+            out += ' ';
+            out += l;
+            out += ' ';
+            out += logger;
+            out += "  ";
+            out.append((const char *)body, r.messageLength);
+            if (fieldsSize)
+            {
+                out += ' ';
+                putFields(out, fields, fieldsSize);
+            }
+            if (hasTask)
+            {
+                out += " task=";
+                putValue(out, task.data(), task.size());
+            }
+            put(out, " core=%u", r.core);
+            if (r.span)
+                put(out, " span=%u", r.span);
+        }
+        out += '\n';
+        fwrite(out.data(), 1, out.size(), stdout);
+    }
+
+    /**
+     * @brief Decodes one frame
+     * @return @c false if the frame is malformed
+     */
+    bool decode(const std::string &from, const uint8_t *data, size_t len)
+    {
+        if (len < sizeof(FrameHeader))
+            return false;
+        auto h = read<FrameHeader>(data);
+        if (h.magic != Magic || h.version != Version || h.length > len || h.length < sizeof(FrameHeader))
+            return false;
+        auto &src = sources[from];
+        if (!src.started || src.session != h.session)
+        {
+            if (src.started)
+                fprintf(stderr, "# %s: new session %08x, %llu messages received, %llu lost in the previous one\n", from.c_str(), h.session,
+                        (unsigned long long)src.received, (unsigned long long)src.lost);
+            else
+                fprintf(stderr, "# %s: session %08x\n", from.c_str(), h.session);
+            src = Source();
+            src.started = true;
+            src.session = h.session;
+            src.expected = h.seq;
+        }
+        auto gap = (int32_t)(h.seq - src.expected);
+        if (gap > 0)
+        {
+            src.lost += gap;
+            fprintf(stderr, "# %s: lost %d messages, seq %u..%u\n", from.c_str(), gap, src.expected, h.seq - 1);
+        }
+        else if (gap < 0)
+            fprintf(stderr, "# %s: duplicate or reordered frame, seq %u, expected %u\n", from.c_str(), h.seq, src.expected);
+        if (gap >= 0)
+            src.expected = h.seq + h.count;
+        src.received += h.count;
+        size_t pos = sizeof(FrameHeader);
+        while (pos + sizeof(RecordHeader) <= h.length)
+        {
+            auto rh = read<RecordHeader>(data + pos);
+            if (rh.length < sizeof(RecordHeader) || pos + rh.length > h.length)
+                return false;
+            switch (rh.type)
+            {
+            case Message:
+            {
+                if (rh.length < sizeof(MessageRecord))
+                    return false;
+                auto r = read<MessageRecord>(data + pos);
+                if (sizeof(r) + r.messageLength > rh.length)
+                    return false;
+                printMessage(from, src, r, data + pos + sizeof(r));
+                break;
+            }
+            case Name:
+            {
+                if (rh.length < sizeof(NameRecord))
+                    return false;
+                auto r = read<NameRecord>(data + pos);
+                src.names[r.id].assign((const char *)data + pos + sizeof(r), rh.length - sizeof(r));
+                break;
+            }
+            default:
+                break;
+            }
+            pos += rh.length;
+        }
+        fflush(stdout);
+        return true;
+    }
+
+    std::string address(const struct sockaddr_in &addr)
+    {
+        char buf[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr.sin_addr, buf, sizeof(buf));
+        return buf;
+    }
+
+    /**
+     * @brief Splits the stream into frames, resynchronizing on the magic after garbage
+     */
+    class Stream
+    {
+    public:
+        explicit Stream(const std::string &from) : _from(from) {}
+        void feed(const uint8_t *data, size_t len)
+        {
+            _buf.insert(_buf.end(), data, data + len);
+            size_t pos = 0;
+            while (_buf.size() - pos >= sizeof(FrameHeader))
+            {
+                auto h = read<FrameHeader>(&_buf[pos]);
+                if (h.magic != Magic || h.length < sizeof(FrameHeader))
+                {
+                    pos++;
+                    continue;
+                }
+                if (_buf.size() - pos < h.length)
+                    break;
+                if (decode(_from, &_buf[pos], h.length))
+                    pos += h.length;
+                else
+                    pos++;
+            }
+            _buf.erase(_buf.begin(), _buf.begin() + pos);
+        }
+
+    private:
+        std::string _from;
+        std::vector<uint8_t> _buf;
+    };
+
+    int bound(int type, int port)
+    {
+        int fd = socket(AF_INET, type, 0);
+        if (fd < 0)
+            return -1;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || (type == SOCK_STREAM && listen(fd, 8) < 0))
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    int receiveUdp(int port)
+    {
+        int fd = bound(SOCK_DGRAM, port);
+        if (fd < 0)
+        {
+            perror("udp");
+            return 1;
+        }
+        std::vector<uint8_t> buf(65536);
+        for (;;)
+        {
+            struct sockaddr_in addr;
+            socklen_t al = sizeof(addr);
+            auto len = recvfrom(fd, buf.data(), buf.size(), 0, (struct sockaddr *)&addr, &al);
+            if (len < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                perror("recvfrom");
+                return 1;
+            }
+            auto from = address(addr);
+            if (!decode(from, buf.data(), len))
+                fprintf(stderr, "# %s: malformed datagram, %zd bytes\n", from.c_str(), len);
+        }
+    }
+
+    int receiveTcp(int port)
+    {
+        int lfd = bound(SOCK_STREAM, port);
+        if (lfd < 0)
+        {
+            perror("tcp");
+            return 1;
+        }
+        std::vector<struct pollfd> fds{{lfd, POLLIN, 0}};
+        std::vector<Stream> streams{Stream("")};
+        uint8_t buf[4096];
+        for (;;)
+        {
+            if (poll(fds.data(), fds.size(), -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                perror("poll");
+                return 1;
+            }
+            for (size_t i = fds.size(); i-- > 1;)
+            {
+                if (!fds[i].revents)
+                    continue;
+                auto len = recv(fds[i].fd, buf, sizeof(buf), 0);
+                if (len > 0)
+                    streams[i].feed(buf, len);
+                else
+                {
+                    close(fds[i].fd);
+                    fds.erase(fds.begin() + i);
+                    streams.erase(streams.begin() + i);
+                }
+            }
+            if (fds[0].revents & POLLIN)
+            {
+                struct sockaddr_in addr;
+                socklen_t al = sizeof(addr);
+                int fd = accept(lfd, (struct sockaddr *)&addr, &al);
+                if (fd >= 0)
+                {
+                    fds.push_back({fd, POLLIN, 0});
+                    streams.push_back(Stream(address(addr)));
+                }
+            }
+        }
+    }
+
+    int readFile(const char *path)
+    {
+        auto f = path && strcmp(path, "-") ? fopen(path, "rb") : stdin;
+        if (!f)
+        {
+            perror(path);
+            return 1;
+        }
+        Stream stream(path ? path : "-");
+        uint8_t buf[4096];
+        size_t len;
+        while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+            stream.feed(buf, len);
+        if (f != stdin)
+            fclose(f);
+        return 0;
+    }
+
+    int usage()
+    {
+        fprintf(stderr, "usage: logdecode [-j] [-a] [-u port | -t port | file]\n"
+                        "  -u port  receive UDP datagrams\n"
+                        "  -t port  accept TCP connections\n"
+                        "  file     read frames from the file, stdin if omitted\n"
+                        "  -j       print JSON objects instead of text\n"
+                        "  -a       include the address of the sender\n");
+        return 2;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int udp = 0, tcp = 0, opt;
+    while ((opt = getopt(argc, argv, "jau:t:")) != -1)
+        switch (opt)
+        {
+        case 'j':
+            json = true;
+            break;
+        case 'a':
+            showSource = true;
+            break;
+        case 'u':
+            udp = atoi(optarg);
+            break;
+        case 't':
+            tcp = atoi(optarg);
+            break;
+        default:
+            return usage();
+        }
+    if ((udp && tcp) || ((udp || tcp) && optind < argc) || optind + 1 < argc)
+        return usage();
+    if (udp)
+        return receiveUdp(udp);
+    if (tcp)
+        return receiveTcp(tcp);
+    return readFile(optind < argc ? argv[optind] : nullptr);
+}